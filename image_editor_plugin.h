@@ -0,0 +1,110 @@
+/*
+ * C interface for operation plugins.
+ *
+ * A plugin is a shared library (.so, .dylib or .dll) in the plugin directory: the
+ * "plugins" folder next to the executable, or $IMAGE_EDITOR_PLUGIN_DIR when set. Every
+ * library in it is loaded at startup and must export
+ *
+ *     IE_PLUGIN_EXPORT const IEOperation* image_editor_plugin_operations(uint32_t host_api_version, int* count);
+ *
+ * returning an array of `*count` operations that stays valid while the library is loaded
+ * (static storage), or NULL when it cannot run on this host version. Each operation gets
+ * a button and a properties panel with widgets generated from its parameters, and is
+ * recorded, undone and replayed like the built-in operations.
+ *
+ * The host cuts the image into tiles and calls `process` on several threads at once, so
+ * it must be reentrant. Every input tile is padded by the operation's radius on all sides
+ * (mirrored at the image border), the output tile covers the same padded rectangle, and
+ * only its interior is kept. Only this header is needed to build a plugin; it is plain C
+ * so plugins can be built with any compiler.
+ */
+#ifndef IMAGE_EDITOR_PLUGIN_H
+#define IMAGE_EDITOR_PLUGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped whenever a structure below changes layout */
+#define IE_PLUGIN_API_VERSION 1
+
+/* Name of the function every plugin library exports */
+#define IE_PLUGIN_ENTRY_POINT "image_editor_plugin_operations"
+
+/* Most parameters an operation may declare */
+#define IE_MAX_PARAMS 16
+
+#if defined(_WIN32)
+#define IE_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define IE_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+/* Pixel formats, as bits of IEOperation::formats. Values are 0..255, 0..65535 and 0..1 */
+typedef enum IEFormat {
+    IE_FORMAT_8U = 1,
+    IE_FORMAT_16U = 2,
+    IE_FORMAT_32F = 4
+} IEFormat;
+
+/* Widget generated for a parameter. Every value is passed to the plugin as a float */
+typedef enum IEParamType {
+    IE_PARAM_FLOAT,   /* Slider from min_value to max_value */
+    IE_PARAM_INT,     /* Integer slider from min_value to max_value */
+    IE_PARAM_BOOL,    /* Checkbox; 0 or 1 */
+    IE_PARAM_CHOICE   /* Combo box over `choices`; the index of the selected entry */
+} IEParamType;
+
+typedef struct IEParam {
+    const char* name;       /* Widget label, unique within the operation */
+    IEParamType type;
+    float min_value;
+    float max_value;
+    float default_value;
+    const char* choices;    /* IE_PARAM_CHOICE: labels each ending in '\0', then an empty one */
+} IEParam;
+
+/* A tile of pixels, interleaved with `channels` values per pixel (1 for gray, 3 for BGR) */
+typedef struct IEImage {
+    void* data;             /* First pixel of the top row */
+    int width;
+    int height;
+    size_t stride;          /* Bytes from one row to the next */
+    int channels;
+    IEFormat format;
+} IEImage;
+
+/* Where a tile lies. Coordinates are those of the whole image, so position-dependent
+ * operations line up across tiles and with the same operation applied to a region */
+typedef struct IETile {
+    int x;                  /* Top-left pixel of the padded tile; negative at the image border */
+    int y;
+    int image_width;
+    int image_height;
+} IETile;
+
+typedef struct IEOperation {
+    const char* name;           /* Unique; button label and the key recorded pipelines refer to */
+    const char* description;    /* Shown in the properties panel; may be NULL */
+    const IEParam* params;
+    int param_count;            /* At most IE_MAX_PARAMS */
+    unsigned formats;           /* IEFormat bits `process` accepts; other images are converted */
+
+    /* Pixels read around each output pixel for the given parameter values; NULL for 0 */
+    int (*radius)(const float* values);
+
+    /* Fill `out` (same size, format and channels as `in`) from `in`. Returns 0 on
+     * success; on any other value the operation is abandoned and the image left as it was */
+    int (*process)(const IEImage* in, IEImage* out, const IETile* tile, const float* values);
+} IEOperation;
+
+typedef const IEOperation* (*IEPluginEntryPoint)(uint32_t host_api_version, int* count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IMAGE_EDITOR_PLUGIN_H */
@@ -1,4 +1,5 @@
 #include <opencv2/opencv.hpp>
+#include <opencv2/core/hal/intrin.hpp>
 #include <string>
 #include <iostream>
 #include <vector>
@@ -10,12 +11,38 @@
 #include "external/imgui/backends/imgui_impl_opengl3.h"
 #include <algorithm> // Add this for std::clamp
 #include <sys/stat.h> // Add this for stat functionality
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <limits>
+#include <array>
+#include <map>
+#include <filesystem>
+#include <set>
+#include "image_editor_plugin.h"
 
 // For file dialogs
 #ifdef _WIN32
 #include <windows.h>
+#include <shlobj.h>
 #else
 #include <cstdlib>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
 #endif
 
 using namespace std;
@@ -130,599 +157,4049 @@ string saveFileDialog() {
 #endif
 }
 
-class ImageEditorGUI {
-private:
-    Mat originalImage;     // Store original image for reset
-    Mat workingImage;      // Current working image
-    string imagePath;
-    bool cropMode = false;
-    Rect cropRect;
-    Point startPoint;
-    Mat tempImage;
+// Function to open a file dialog for selecting several images
+vector<string> openFilesDialog() {
+    vector<string> paths;
+#ifdef _WIN32
+    char buffer[8192];
     
-    // History stack for undo operations
-    vector<Mat> historyStack;
-    size_t currentHistoryIndex = 0;
-    const size_t maxHistorySize = 20;  // Limit history size to prevent excessive memory usage
+    OPENFILENAME ofn;
+    ZeroMemory(&ofn, sizeof(ofn));
+    ofn.lStructSize = sizeof(ofn);
+    ofn.hwndOwner = NULL;
+    ofn.lpstrFilter = "Image Files\0*.bmp;*.jpg;*.jpeg;*.png;*.tif;*.tiff\0All Files\0*.*\0";
+    ofn.lpstrFile = buffer;
+    ofn.lpstrFile[0] = '\0';
+    ofn.nMaxFile = sizeof(buffer);
+    ofn.lpstrTitle = "Select Images";
+    ofn.Flags = OFN_FILEMUSTEXIST | OFN_PATHMUSTEXIST | OFN_ALLOWMULTISELECT | OFN_EXPLORER;
     
-    // Parameters for adjustments
-    struct {
-        float brightness = 0.0f;      // Range -100 to 100
-        float contrast = 100.0f;      // Range 0 to 300 (100 is normal)
-        float blurSize = 0.0f;        // Range 0 to 15
-        float rotationAngle = 0.0f;   // Range 0 to 360
-        // float resizeRatio = 100.0f;   // Range 10 to 300 (percentage)
-        
-        // Advanced blur parameters
-        float gaussianBlurRadius = 5.0f;  // Range 1 to 20
-        float directionalBlurAngle = 0.0f; // Range 0 to 360
-        bool useDirectionalBlur = false;   // Toggle between uniform and directional blur
-        
-        // Threshold parameters
-        int thresholdValue = 128;     // Range 0 to 255
-        int thresholdMaxValue = 255;  // Maximum value for binary threshold
-        int adaptiveBlockSize = 11;   // Block size for adaptive threshold (must be odd)
-        int adaptiveC = 2;            // Constant subtracted from mean for adaptive threshold
-        int thresholdMethod = 0;      // 0: Binary, 1: Adaptive, 2: Otsu
-        
-        // Edge detection parameters
-        int edgeDetectionMethod = 0;  // 0: Sobel, 1: Canny
-        int sobelKernelSize = 3;      // Kernel size for Sobel (must be odd)
-        int cannyThreshold1 = 50;     // First threshold for Canny
-        int cannyThreshold2 = 150;    // Second threshold for Canny
-        bool overlayEdges = false;    // Whether to overlay edges on original image
-        float edgeColor[3] = {0.0f, 1.0f, 0.0f}; // Green color for edges (BGR)
-        float edgeOpacity = 0.7f;     // Opacity of edge overlay (0-1)
-        
-        // Blend parameters
-        int blendMode = 0;            // 0: Normal, 1: Multiply, 2: Screen, 3: Overlay, 4: Difference
-        float blendOpacity = 1.0f;    // Range 0 to 1
-        string blendImagePath = "";    // Path to the second image for blending
-        
-        // Noise parameters
-        int noiseType = 0;            // 0: Perlin, 1: Simplex, 2: Worley, 3: Value, 4: Fractal Brownian Motion
-        float noiseScale = 10.0f;     // Scale of the noise (higher = finer detail)
-        float noiseAmplitude = 1.0f;  // Amplitude of the noise (0-1)
-        int noiseOctaves = 4;         // Number of octaves for FBM (1-8)
-        float noisePersistence = 0.5f; // Persistence for FBM (0-1)
-        float noiseLacunarity = 2.0f; // Lacunarity for FBM (1-4)
-        bool noiseInvert = false;     // Invert the noise pattern
-        bool noiseColorize = false;   // Apply color to the noise
-        float noiseColor[3] = {0.0f, 0.5f, 1.0f}; // Color for noise (BGR)
-
-        // Convolution parameters
-        int kernelSize = 3;           // 3x3 or 5x5
-        float kernel[25] = {0};       // Max size for 5x5 kernel
-        float kernelScale = 1.0f;     // Scale factor for kernel values
-        float kernelOffset = 0.0f;    // Offset added to result
-        int currentPreset = 0;        // 0: Custom, 1: Sharpen, 2: Emboss, 3: Edge Enhance
-    } params;
+    if (GetOpenFileName(&ofn)) {
+        // A single file comes back as a full path; several as the directory followed by the file names
+        string directory = buffer;
+        const char* name = buffer + directory.size() + 1;
+        if (*name == '\0') {
+            paths.push_back(directory);
+        }
+        while (*name != '\0') {
+            paths.push_back(directory + "\\" + name);
+            name += strlen(name) + 1;
+        }
+    }
+    return paths;
+#else
+    // For Linux systems, use zenity for a graphical file dialog
+    string command = "zenity --file-selection --multiple --separator=\"|\" --title=\"Select Images\" --file-filter=\"Image Files | *.jpg *.jpeg *.png *.bmp *.tif *.tiff\" --file-filter=\"All Files | *.*\"";
     
-    // OpenGL texture for displaying the image
-    GLuint imageTexture = 0;
-    int imageWidth = 0;
-    int imageHeight = 0;
+    FILE* pipe = popen(command.c_str(), "r");
+    if (!pipe) {
+        cerr << "Failed to open file dialog." << endl;
+        return paths;
+    }
     
-    // Window dimensions
-    int windowWidth = 2400;
-    int windowHeight = 1800;
+    char buffer[1024];
+    string result = "";
+    while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
+        result += buffer;
+    }
+    pclose(pipe);
     
-    // UI state
-    bool showDemoWindow = false;
-    bool showAboutWindow = false;
-    bool showHelpWindow = false;
-    bool showBlurOptions = false;  // For advanced blur options window
-    bool showThresholdOptions = false;  // For threshold options window
-    bool showEdgeDetectionOptions = false;  // For edge detection options window
-    bool showBlendOptions = false;  // For blend options window
-    bool showBrightnessOptions = false;  // For brightness options window
-    bool showContrastOptions = false;  // For contrast options window
-    bool showRotationOptions = false;  // For rotation options window
+    // Remove trailing newline if present
+    if (!result.empty() && result[result.length() - 1] == '\n') {
+        result.erase(result.length() - 1);
+    }
     
-    // Resizable pane heights
-    float imagePaneHeight = 600.0f;
-    float propertiesPaneHeight = 600.0f;
-    float imageInfoPaneHeight = 200.0f;
+    // Split the '|' separated list
+    size_t start = 0;
+    while (start < result.size()) {
+        size_t end = result.find('|', start);
+        if (end == string::npos) end = result.size();
+        if (end > start) {
+            paths.push_back(result.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return paths;
+#endif
+}
+
+// Function to open a folder selection dialog; returns an empty string when cancelled
+string openFolderDialog() {
+#ifdef _WIN32
+    char folder[MAX_PATH];
     
-    // Crop mode state
-    bool isDragging = false;
-    ImVec2 dragStart;
-    ImVec2 dragEnd;
+    BROWSEINFOA info;
+    ZeroMemory(&info, sizeof(info));
+    info.pszDisplayName = folder;
+    info.lpszTitle = "Select a Folder";
+    info.ulFlags = BIF_RETURNONLYFSDIRS | BIF_NEWDIALOGSTYLE;
     
-    // Channel splitter state
-    bool showChannelSplitter = false;
-    bool showGrayscaleChannels = false;
-    vector<Mat> splitChannels;
-    vector<GLuint> channelTextures;
-    vector<Mat> grayscaleChannels;
-    vector<GLuint> grayscaleTextures;
+    LPITEMIDLIST item = SHBrowseForFolderA(&info);
+    if (!item) return "";
+    bool found = SHGetPathFromIDListA(item, folder);
+    CoTaskMemFree(item);
+    return found ? string(folder) : "";
+#else
+    // For Linux systems, use zenity for a graphical file dialog
+    string command = "zenity --file-selection --directory --title=\"Select a Folder\"";
     
-    // Active operation for properties pane
-    enum ActiveOperation {
-        NONE,
-        BRIGHTNESS,
-        CONTRAST,
-        ROTATION,
-        BLUR,
-        THRESHOLD,
-        EDGE_DETECTION,
-        BLEND,
-        NOISE,
-        CONVOLUTION
-    };
-    ActiveOperation activeOperation = NONE;
+    FILE* pipe = popen(command.c_str(), "r");
+    if (!pipe) {
+        cerr << "Failed to open folder dialog." << endl;
+        return "";
+    }
+    
+    char buffer[1024];
+    string result = "";
+    while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
+        result += buffer;
+    }
+    pclose(pipe);
+    
+    // Remove trailing newline if present
+    if (!result.empty() && result[result.length() - 1] == '\n') {
+        result.erase(result.length() - 1);
+    }
+    return result;
+#endif
+}
 
-    // Initialize default kernels
-    void initializeDefaultKernels() {
-        // Initialize kernel with zeros
-        std::fill(params.kernel, params.kernel + 25, 0.0f);
-        
-        // Set default 3x3 identity kernel
-        if (params.kernelSize == 3) {
-            params.kernel[0] = 0.0f; params.kernel[1] = 0.0f; params.kernel[2] = 0.0f;
-            params.kernel[3] = 0.0f; params.kernel[4] = 1.0f; params.kernel[5] = 0.0f;
-            params.kernel[6] = 0.0f; params.kernel[7] = 0.0f; params.kernel[8] = 0.0f;
-        } else {
-            // 5x5 identity kernel
-            params.kernel[12] = 1.0f; // Center pixel for 5x5
-        }
+// Reduced decode mode for a quick preview of `path`, or 0 when a preview would not arrive
+// noticeably sooner than the full image. Only JPEG decodes at reduced size directly (the
+// decoder scales the DCT), so other formats are always decoded in full
+int previewReadMode(const string& path) {
+    string extension;
+    size_t dotPos = path.find_last_of(".");
+    if (dotPos != string::npos) {
+        extension = path.substr(dotPos + 1);
+        transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
     }
+    if (extension != "jpg" && extension != "jpeg") return 0;
+    
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || st.st_size < 512 * 1024) return 0;
+    return st.st_size > 4 * 1024 * 1024 ? IMREAD_REDUCED_COLOR_8 : IMREAD_REDUCED_COLOR_4;
+}
 
-    void applyPresetKernel() {
-        std::fill(params.kernel, params.kernel + 25, 0.0f);
-        params.kernelScale = 1.0f;
-        params.kernelOffset = 0.0f;
-        
-        switch (params.currentPreset) {
-            case 1: // Sharpen
-                params.kernelSize = 3;
-                params.kernel[0] = 0.0f; params.kernel[1] = -1.0f; params.kernel[2] = 0.0f;
-                params.kernel[3] = -1.0f; params.kernel[4] = 5.0f; params.kernel[5] = -1.0f;
-                params.kernel[6] = 0.0f; params.kernel[7] = -1.0f; params.kernel[8] = 0.0f;
-                break;
-                
-            case 2: // Emboss
-                params.kernelSize = 3;
-                params.kernel[0] = -2.0f; params.kernel[1] = -1.0f; params.kernel[2] = 0.0f;
-                params.kernel[3] = -1.0f; params.kernel[4] = 1.0f; params.kernel[5] = 1.0f;
-                params.kernel[6] = 0.0f; params.kernel[7] = 1.0f; params.kernel[8] = 2.0f;
-                params.kernelScale = 1.0f;
-                params.kernelOffset = 128.0f;
-                break;
-                
-            case 3: // Edge Enhance
-                params.kernelSize = 3;
-                params.kernel[0] = 0.0f; params.kernel[1] = -1.0f; params.kernel[2] = 0.0f;
-                params.kernel[3] = -1.0f; params.kernel[4] = 4.0f; params.kernel[5] = -1.0f;
-                params.kernel[6] = 0.0f; params.kernel[7] = -1.0f; params.kernel[8] = 0.0f;
-                break;
+// Thumbnails for the folder browser, kept on disk between sessions. Entries are keyed by the
+// image's path, modification time and size, so an edited file gets a new thumbnail and the
+// stale one is never read again
+class ThumbnailCache {
+public:
+    static constexpr int thumbnailSize = 96;  // Longest side in pixels
+    
+    explicit ThumbnailCache(const string& directory = defaultDirectory()) : directory(directory) {
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+    }
+    
+    // $XDG_CACHE_HOME/image_editor/thumbnails, or the same under ~/.cache (%LOCALAPPDATA% on Windows)
+    static string defaultDirectory() {
+        std::filesystem::path base;
+#ifdef _WIN32
+        if (const char* local = getenv("LOCALAPPDATA")) base = local;
+#else
+        if (const char* cache = getenv("XDG_CACHE_HOME")) {
+            base = cache;
+        } else if (const char* home = getenv("HOME")) {
+            base = std::filesystem::path(home) / ".cache";
         }
+#endif
+        if (base.empty()) base = std::filesystem::temp_directory_path();
+        return (base / "image_editor" / "thumbnails").string();
     }
-
-    void applyConvolution() {
-        if (!workingImage.data) return;
-        
-        Mat result;
-        int kSize = params.kernelSize;
-        Mat kernelMat = Mat(kSize, kSize, CV_32F);
-        
-        // Copy kernel values to Mat
-        for (int i = 0; i < kSize; i++) {
-            for (int j = 0; j < kSize; j++) {
-                kernelMat.at<float>(i, j) = params.kernel[i * kSize + j] * params.kernelScale;
-            }
+    
+    // 8-bit BGR thumbnail of `path` that fits in thumbnailSize, from the cache when it has one.
+    // Otherwise JPEGs are decoded at 1/2 to 1/8 scale, which is most of the saving, and the
+    // result is stored. Empty when the file cannot be decoded
+    Mat thumbnail(const string& path, bool* cacheHit = nullptr) const {
+        if (cacheHit) *cacheHit = false;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) return Mat();
+        
+        string entry = entryPath(path, st);
+        Mat cached = imread(entry, IMREAD_COLOR);
+        if (!cached.empty()) {
+            if (cacheHit) *cacheHit = true;
+            return cached;
         }
         
-        // Apply convolution
-        Mat temp;
-        if (workingImage.channels() == 1) {
-            filter2D(workingImage, temp, -1, kernelMat, Point(-1, -1), params.kernelOffset);
-        } else {
-            vector<Mat> channels;
-            split(workingImage, channels);
-            
-            vector<Mat> results;
-            for (auto& channel : channels) {
-                Mat channelResult;
-                filter2D(channel, channelResult, -1, kernelMat, Point(-1, -1), params.kernelOffset);
-                results.push_back(channelResult);
-            }
-            
-            merge(results, temp);
+        Mat decoded = imread(path, reducedReadMode(path, st.st_size));
+        if (decoded.empty()) return Mat();
+        double scale = static_cast<double>(thumbnailSize) / std::max(decoded.cols, decoded.rows);
+        Mat small = decoded;
+        if (scale < 1.0) {
+            Size size(std::max(1, cvRound(decoded.cols * scale)), std::max(1, cvRound(decoded.rows * scale)));
+            resize(decoded, small, size, 0, 0, INTER_AREA);
         }
         
-        // Add to history and update
-        addToHistory(workingImage);
-        temp.copyTo(workingImage);
-        updateTexture();
+        // Written under a temporary name and renamed, so a reader never sees half a file
+        string temporary = entry + "." + to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".jpg";
+        if (imwrite(temporary, small, {IMWRITE_JPEG_QUALITY, 90})) {
+            std::error_code error;
+            std::filesystem::rename(temporary, entry, error);
+            if (error) std::filesystem::remove(temporary, error);
+        }
+        return small;
+    }
+
+private:
+    // Decode mode for a thumbnail. JPEGs decode at reduced size directly; the reduction
+    // is chosen from the file size so typical photos still come out larger than a thumbnail
+    static int reducedReadMode(const string& path, long long fileSize) {
+        string extension = std::filesystem::path(path).extension().string();
+        transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (extension != ".jpg" && extension != ".jpeg") return IMREAD_COLOR;
+        if (fileSize > 1024 * 1024) return IMREAD_REDUCED_COLOR_8;
+        if (fileSize > 256 * 1024) return IMREAD_REDUCED_COLOR_4;
+        return IMREAD_REDUCED_COLOR_2;
     }
+    
+    // Cache file for an image: a 64-bit FNV-1a hash of path, modification time and size
+    string entryPath(const string& path, const struct stat& st) const {
+        string key = path + "|" + to_string(static_cast<long long>(st.st_mtime)) + "|" + to_string(static_cast<long long>(st.st_size));
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : key) {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.jpg", static_cast<unsigned long long>(hash));
+        return (std::filesystem::path(directory) / name).string();
+    }
+    
+    string directory;
+};
 
+// Work-stealing thread pool that runs image operations on cache-sized tiles.
+// Every worker owns a task deque: it pops from the back of its own deque and
+// steals from the front of the others once it runs dry.
+class TileScheduler {
 public:
-    ImageEditorGUI(const string& path = "") {
-        imagePath = path;
-        
-        // Initialize default kernels
-        initializeDefaultKernels();
+    // Per-tile information handed to every operation of a chain
+    struct TileContext {
+        Rect region;        // Padded tile rectangle in image coordinates (may reach past the image edges)
+        const Mat& source;  // Padded input of the whole chain, e.g. the original colours for overlays
+    };
+    
+    // One step of a tile chain. `radius` is how far the kernel reads around each
+    // output pixel (0 for point operations); the radii of a chain add up to the
+    // halo that is fetched around every tile.
+    struct TileOp {
+        int radius = 0;
+        std::function<void(const Mat& in, Mat& out, const TileContext& context)> process;
+    };
+    
+    static TileScheduler& instance() {
+        static TileScheduler scheduler;
+        return scheduler;
+    }
+    
+    explicit TileScheduler(unsigned threadCount = 0) {
+        if (threadCount == 0) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        cacheBytes = detectCacheBytes();
         
-        // If path is provided, load the image
-        if (!path.empty()) {
-            loadImage(path);
+        for (unsigned i = 0; i < threadCount; i++) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        // Deque 0 belongs to the calling thread, which helps with every batch
+        for (unsigned i = 1; i < threadCount; i++) {
+            threads.emplace_back([this, i]() { workerLoop(i); });
         }
     }
     
-    ~ImageEditorGUI() {
-        // Clean up OpenGL texture
-        if (imageTexture != 0) {
-            glDeleteTextures(1, &imageTexture);
+    ~TileScheduler() {
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            stopping = true;
         }
-        
-        // Clean up channel textures
-        for (auto& texture : channelTextures) {
-            if (texture != 0) {
-                glDeleteTextures(1, &texture);
-            }
-        }
-        
-        // Clean up grayscale textures
-        for (auto& texture : grayscaleTextures) {
-            if (texture != 0) {
-                glDeleteTextures(1, &texture);
-            }
+        wake.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
         }
     }
     
-    void loadImage(const string& path) {
-        imagePath = path;
-        originalImage = imread(path, IMREAD_COLOR);
-        
-        if (originalImage.empty()) {
-            cerr << "Error: Could not open or find the image: " << path << endl;
+    size_t threadCount() const {
+        return workers.size();
+    }
+    
+    // Run body(i) for every i in [0, count) and wait for all of them.
+    // The caller executes tasks as well, so nested calls cannot deadlock.
+    void parallelFor(int count, const std::function<void(int)>& body) {
+        if (count <= 0) return;
+        if (count == 1 || workers.size() == 1) {
+            for (int i = 0; i < count; i++) {
+                body(i);
+            }
             return;
         }
         
-        workingImage = originalImage.clone();
-        
-        // Update image dimensions
-        imageWidth = workingImage.cols;
-        imageHeight = workingImage.rows;
+        std::atomic<int> remaining(count);
+        std::exception_ptr failure;
+        std::mutex failureLock;
+        
+        for (int i = 0; i < count; i++) {
+            push(i % workers.size(), [&, i]() {
+                try {
+                    body(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> guard(failureLock);
+                    if (!failure) failure = std::current_exception();
+                }
+                remaining.fetch_sub(1, std::memory_order_acq_rel);
+            });
+        }
         
-        // Create or update OpenGL texture
-        updateTexture();
+        // Taking the lock once guarantees no worker misses the wake-up
+        { std::lock_guard<std::mutex> guard(sleepLock); }
+        wake.notify_all();
         
-        // Clear history and add the original image as the first state
-        clearHistory();
-        addToHistory(originalImage);
-    }
-    
-    // Add current image state to history
-    void addToHistory(const Mat& image) {
-        // If we're not at the end of the history, remove all states after the current one
-        if (currentHistoryIndex < historyStack.size()) {
-            historyStack.resize(currentHistoryIndex);
+        // Help until the whole batch is done
+        std::function<void()> task;
+        while (remaining.load(std::memory_order_acquire) > 0) {
+            if (popTask(0, task)) {
+                task();
+                task = nullptr;
+            } else {
+                std::this_thread::yield();
+            }
         }
         
-        // Add the new state
-        historyStack.push_back(image.clone());
-        currentHistoryIndex = historyStack.size();
-        
-        // Limit history size
-        if (historyStack.size() > maxHistorySize) {
-            historyStack.erase(historyStack.begin());
-            currentHistoryIndex--;
+        if (failure) {
+            std::rethrow_exception(failure);
         }
     }
     
-    // Clear history
-    void clearHistory() {
-        historyStack.clear();
-        currentHistoryIndex = 0;
-    }
-    
-    // Undo the last operation
-    bool undo() {
-        if (currentHistoryIndex <= 1) {
-            cout << "Nothing to undo." << endl;
-            return false;
-        }
-        
-        currentHistoryIndex--;
-        workingImage = historyStack[currentHistoryIndex].clone();
-        updateTexture();
-        return true;
+    // Split [0, rows) into strips and run body(begin, end) on each of them
+    void parallelRows(int rows, const std::function<void(int begin, int end)>& body) {
+        int strips = std::min(rows, static_cast<int>(workers.size()) * 4);
+        parallelFor(strips, [&](int strip) {
+            int begin = static_cast<int>(static_cast<long long>(rows) * strip / strips);
+            int end = static_cast<int>(static_cast<long long>(rows) * (strip + 1) / strips);
+            if (begin < end) body(begin, end);
+        });
     }
     
-    // Check if undo is available
-    bool canUndo() const {
-        return currentHistoryIndex > 1;
+    // Tile edge length for which the padded tile and its ping-pong buffers stay in L2
+    Size tileSizeFor(const Mat& image, int halo) const {
+        double pixelBytes = static_cast<double>(std::max<size_t>(image.elemSize(), 1));
+        int side = static_cast<int>(std::sqrt(cacheBytes / (3.0 * pixelBytes)));
+        // Never let the halo dominate the tile, even if it spills the cache
+        int edge = std::max(side - 2 * halo, std::max(64, 4 * halo));
+        return Size(std::min(edge, image.cols), std::min(edge, image.rows));
     }
     
-    void updateTexture() {
-        if (workingImage.empty()) return;
-        
-        // Convert OpenCV Mat to OpenGL texture
-        if (imageTexture == 0) {
-            glGenTextures(1, &imageTexture);
+    // Run a chain of operations tile by tile. Each tile is fetched once with a
+    // halo covering the summed kernel radii, passed through every operation of
+    // the chain while it is still in cache, and its interior is written to dst.
+    // Half-float tiles are widened to float on the way in and narrowed again on
+    // the way out, so kernels only ever see 8U, 16U or 32F data.
+    void runTiles(const Mat& src, Mat& dst, const vector<TileOp>& chain, int dstType = -1) {
+        if (src.empty() || chain.empty()) return;
+        
+        int halo = 0;
+        for (const auto& op : chain) {
+            halo += op.radius;
         }
         
-        glBindTexture(GL_TEXTURE_2D, imageTexture);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        // dst may alias src for in-place calls, so render into a fresh buffer
+        Mat output(src.size(), dstType < 0 ? src.type() : dstType);
+        Size tile = tileSizeFor(src, halo);
+        int tilesX = (src.cols + tile.width - 1) / tile.width;
+        int tilesY = (src.rows + tile.height - 1) / tile.height;
         
-        // OpenCV uses BGR format, we need to convert to RGB for OpenGL
-        Mat rgbImage;
-        cvtColor(workingImage, rgbImage, COLOR_BGR2RGB);
+        parallelFor(tilesX * tilesY, [&](int index) {
+            Rect inner((index % tilesX) * tile.width, (index / tilesX) * tile.height, 0, 0);
+            inner.width = std::min(tile.width, src.cols - inner.x);
+            inner.height = std::min(tile.height, src.rows - inner.y);
+            
+            Mat input;
+            if (halo > 0) {
+                // The halo is read from neighbouring pixels; only the image border is extrapolated
+                copyMakeBorder(src(inner), input, halo, halo, halo, halo, BORDER_REFLECT_101);
+            } else {
+                input = src(inner);
+            }
+            if (input.depth() == CV_16F) {
+                input.convertTo(input, CV_32F);
+            }
+            
+            TileContext context{Rect(inner.x - halo, inner.y - halo, inner.width + 2 * halo, inner.height + 2 * halo), input};
+            Mat buffers[2];
+            Mat current = input;
+            for (size_t i = 0; i < chain.size(); i++) {
+                Mat& out = buffers[i % 2];
+                chain[i].process(current, out, context);
+                current = out;
+            }
+            
+            Mat interior = current(Rect(halo, halo, inner.width, inner.height));
+            if (interior.type() == output.type()) {
+                interior.copyTo(output(inner));
+            } else {
+                interior.convertTo(output(inner), output.depth());
+            }
+        });
         
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, rgbImage.cols, rgbImage.rows, 0, GL_RGB, GL_UNSIGNED_BYTE, rgbImage.data);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        dst = output;
     }
+
+private:
+    struct Worker {
+        std::deque<std::function<void()>> tasks;
+        std::mutex lock;
+    };
     
-    // Apply all current transformations to the image
-    void applyTransformations(Mat& image) {
-        if (image.empty()) return;  // Skip if image is empty
-        
-        // Apply rotation if not 0
-        if (params.rotationAngle != 0.0f) {
-            Point2f center(image.cols / 2.0f, image.rows / 2.0f);
-            Mat rotMat = getRotationMatrix2D(center, params.rotationAngle, 1.0);
-            warpAffine(image, image, rotMat, image.size());
-        }
-        
-        // Apply brightness and contrast
-        double alpha = params.contrast / 100.0;
-        int beta = static_cast<int>(params.brightness);
-        image.convertTo(image, -1, alpha, beta);
-        
-        // Apply blur if greater than 0
-        if (params.blurSize > 0.0f) {
-            int blurSize = static_cast<int>(params.blurSize) * 2 + 1;
-            GaussianBlur(image, image, Size(blurSize, blurSize), 0);
-        }
-    }
+    vector<std::unique_ptr<Worker>> workers;
+    vector<std::thread> threads;
+    std::atomic<int> queued{0};
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    bool stopping = false;
+    size_t cacheBytes = 256 * 1024;
     
-    // Update the image with current parameters
-    void updateImage() {
-        if (originalImage.empty()) return;  // Skip if no image loaded
-        
-        // Start with original image
-        Mat processedImage = originalImage.clone();
-        
-        // Apply all transformations
-        applyTransformations(processedImage);
-        
-        // Update the working image
-        workingImage = processedImage.clone();
-        
-        // Add to history
-        addToHistory(workingImage);
-        
-        // Update the texture
-        updateTexture();
+    static size_t detectCacheBytes() {
+#ifdef _SC_LEVEL2_CACHE_SIZE
+        long size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+        if (size > 0) return static_cast<size_t>(size);
+#endif
+        return 256 * 1024;
     }
     
-    // Button handlers
-    void openImageDialog() {
-        string path = ::openFileDialog();
-        if (!path.empty()) {
-            loadImage(path);
-        }
+    void push(size_t index, std::function<void()> task) {
+        Worker& worker = *workers[index];
+        std::lock_guard<std::mutex> guard(worker.lock);
+        worker.tasks.push_back(std::move(task));
+        queued++;
     }
     
-    void saveImageDialog() {
-        if (workingImage.empty()) {
-            cout << "No image to save." << endl;
-            return;
+    // Pop from the back of our own deque, otherwise steal from the front of another one
+    bool popTask(size_t self, std::function<void()>& task) {
+        {
+            Worker& own = *workers[self];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                queued--;
+                return true;
+            }
         }
         
-        string path = ::saveFileDialog();
-        if (!path.empty()) {
-            // Ensure the path has a valid extension
-            if (path.find('.') == string::npos) {
-                path += ".png"; // Default to PNG if no extension is provided
-            }
-            
-            bool success = imwrite(path, workingImage);
-            if (success) {
-                cout << "Image saved successfully to " << path << endl;
-            } else {
-                cerr << "Failed to save image to " << path << endl;
+        for (size_t i = 1; i < workers.size(); i++) {
+            Worker& victim = *workers[(self + i) % workers.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                queued--;
+                return true;
             }
         }
+        return false;
     }
     
-    void resetImage() {
-        if (originalImage.empty()) {
-            cout << "No image loaded yet." << endl;
-            return;
+    void workerLoop(size_t index) {
+        std::function<void()> task;
+        while (true) {
+            if (popTask(index, task)) {
+                task();
+                task = nullptr;
+                continue;
+            }
+            
+            std::unique_lock<std::mutex> guard(sleepLock);
+            wake.wait(guard, [this]() { return stopping || queued.load() > 0; });
+            if (stopping) return;
         }
-        
-        // Reset image to original
-        workingImage = originalImage.clone();
-        
-        // Reset parameters
-        params.brightness = 0.0f;
-        params.contrast = 100.0f;
-        params.blurSize = 0.0f;
-        params.rotationAngle = 0.0f;
-        
-        // Exit crop mode if active
-        cropMode = false;
-        
-        // Add to history
-        addToHistory(workingImage);
-        
-        // Update the texture
-        updateTexture();
     }
+};
+
+// Pool of large pixel buffers, installed as OpenCV's default allocator so that every
+// full-frame Mat (results, temporaries, texture uploads) reuses a buffer released by an
+// earlier operation instead of mapping and faulting in fresh pages. Buffers are bucketed
+// by size class; small allocations go straight to the system allocator
+class BufferPool : public MatAllocator {
+public:
+    // Smaller buffers are not worth pooling; the system allocator recycles them well
+    static constexpr size_t minPooledBytes = 256 * 1024;
     
-    void applyGrayscale() {
-        if (workingImage.empty()) {
-            cout << "No image loaded yet." << endl;
-            return;
+    struct Settings {
+        size_t maxIdleBytes = 512ull * 1024 * 1024;  // Idle buffers beyond this are freed at once
+        double maxIdleSeconds = 30.0;                // Idle buffers older than this are trimmed
+        bool trimOnMemoryPressure = true;            // Free every idle buffer when the system runs low
+        size_t lowMemoryBytes = 256ull * 1024 * 1024; // Available system memory counted as low
+    };
+    
+    struct Stats {
+        size_t requests = 0;       // Pooled-size allocations
+        size_t hits = 0;           // ... served from an idle buffer
+        size_t bytesInUse = 0;     // Pooled buffers currently held by Mats
+        size_t bytesIdle = 0;      // Pooled buffers waiting for reuse
+        size_t peakBytes = 0;      // Highest bytesInUse + bytesIdle so far
+        size_t trimmedBytes = 0;   // Idle bytes given back to the system
+        
+        double hitRate() const {
+            return requests > 0 ? static_cast<double>(hits) / requests : 0.0;
         }
-        
-        // Add current state to history before applying changes
-        addToHistory(workingImage);
-        
-        Mat gray;
-        cvtColor(workingImage, gray, COLOR_BGR2GRAY);
-        cvtColor(gray, workingImage, COLOR_GRAY2BGR);  // Convert back to 3 channels
-        
-        // Update the texture
-        updateTexture();
+    };
+    
+    // Never destroyed, so Mats released during static destruction still find their allocator
+    static BufferPool& instance() {
+        static BufferPool* pool = new BufferPool();
+        return *pool;
     }
     
-    void applySharpen() {
-        if (workingImage.empty()) {
-            cout << "No image loaded yet." << endl;
-            return;
+    UMatData* allocate(int dims, const int* sizes, int type, void* data0, size_t* step,
+                       AccessFlag, UMatUsageFlags) const override {
+        // Same layout as OpenCV's standard allocator
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; i--) {
+            if (step) {
+                if (data0 && step[i] != CV_AUTOSTEP) {
+                    CV_Assert(total <= step[i]);
+                    total = step[i];
+                } else {
+                    step[i] = total;
+                }
+            }
+            total *= sizes[i];
         }
         
-        // Add current state to history before applying changes
-        addToHistory(workingImage);
-        
-        Mat sharpeningKernel = (Mat_<float>(3, 3) << 0, -1, 0, -1, 5, -1, 0, -1, 0);
-        filter2D(workingImage, workingImage, workingImage.depth(), sharpeningKernel);
-        
-        // Update the texture
-        updateTexture();
+        UMatData* u = new UMatData(this);
+        u->size = total;
+        if (data0) {
+            u->data = u->origdata = static_cast<uchar*>(data0);
+            u->flags |= UMatData::USER_ALLOCATED;
+        } else {
+            u->data = u->origdata = static_cast<uchar*>(acquire(total));
+        }
+        return u;
     }
     
-    void applyInvert() {
-        if (workingImage.empty()) {
-            cout << "No image loaded yet." << endl;
-            return;
+    bool allocate(UMatData* u, AccessFlag, UMatUsageFlags) const override {
+        return u != nullptr;
+    }
+    
+    void deallocate(UMatData* u) const override {
+        if (!u) return;
+        CV_Assert(u->urefcount == 0);
+        CV_Assert(u->refcount == 0);
+        if (!(u->flags & UMatData::USER_ALLOCATED)) {
+            release(u->origdata, u->size);
+            u->origdata = nullptr;
         }
-        
-        // Add current state to history before applying changes
-        addToHistory(workingImage);
-        
-        bitwise_not(workingImage, workingImage);
-        
-        // Update the texture
-        updateTexture();
+        delete u;
     }
     
-    void applyEdgeDetection() {
-        if (workingImage.empty()) {
-            cout << "No image loaded yet." << endl;
+    Settings settings() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return config;
+    }
+    
+    void setSettings(const Settings& settings) {
+        std::lock_guard<std::mutex> guard(lock);
+        config = settings;
+        trimLocked(config.maxIdleBytes);
+    }
+    
+    Stats stats() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return counters;
+    }
+    
+    // Free idle buffers until at most `keepBytes` remain, oldest first
+    void trim(size_t keepBytes = 0) {
+        std::lock_guard<std::mutex> guard(lock);
+        trimLocked(keepBytes);
+    }
+    
+    // Periodic upkeep, cheap enough to call every frame: drops buffers that have been idle
+    // too long, and everything idle when the system is short of memory
+    void maintain() {
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> guard(lock);
+        if (now - lastMaintenance < std::chrono::seconds(1)) return;
+        lastMaintenance = now;
+        
+        if (config.trimOnMemoryPressure && counters.bytesIdle > 0 &&
+            availableSystemMemory() < config.lowMemoryBytes) {
+            trimLocked(0);
             return;
         }
         
-        // Add current state to history before applying changes
-        addToHistory(workingImage);
-        
-        // Convert to grayscale if not already
-        Mat grayImage;
-        if (workingImage.channels() == 3) {
-            cvtColor(workingImage, grayImage, COLOR_BGR2GRAY);
-        } else {
-            grayImage = workingImage.clone();
+        auto maxAge = std::chrono::duration<double>(config.maxIdleSeconds);
+        while (!idleOrder.empty() && now - idleOrder.front().released > maxAge) {
+            freeOldestLocked();
         }
-        
-        // Apply edge detection based on selected method
-        Mat edges;
-        
-        if (params.edgeDetectionMethod == 0) { // Sobel
-            // Ensure kernel size is odd
-            int kernelSize = params.sobelKernelSize;
-            if (kernelSize % 2 == 0) kernelSize++;
-            
-            // Apply Sobel edge detection
-            Mat gradX, gradY, absGradX, absGradY;
-            
-            // Gradient X
-            Sobel(grayImage, gradX, CV_16S, 1, 0, kernelSize);
-            convertScaleAbs(gradX, absGradX);
-            
-            // Gradient Y
-            Sobel(grayImage, gradY, CV_16S, 0, 1, kernelSize);
-            convertScaleAbs(gradY, absGradY);
-            
-            // Total gradient
-            addWeighted(absGradX, 0.5, absGradY, 0.5, 0, edges);
-            
-        } else if (params.edgeDetectionMethod == 1) { // Canny
-            // Apply Canny edge detection
-            Canny(grayImage, edges, params.cannyThreshold1, params.cannyThreshold2);
+    }
+
+private:
+    struct IdleBuffer {
+        void* data;
+        size_t capacity;
+        std::chrono::steady_clock::time_point released;
+    };
+    
+    BufferPool() = default;
+    
+    // Round up to one of four size classes per power of two, wasting at most a quarter
+    static size_t sizeClass(size_t bytes) {
+        size_t power = 1;
+        while (power * 2 <= bytes) power *= 2;
+        size_t quarter = std::max<size_t>(power / 4, 1);
+        return (bytes + quarter - 1) / quarter * quarter;
+    }
+    
+    // Bytes of memory the system can still hand out, or SIZE_MAX when unknown
+    static size_t availableSystemMemory() {
+#ifdef _WIN32
+        MEMORYSTATUSEX status;
+        status.dwLength = sizeof(status);
+        if (GlobalMemoryStatusEx(&status)) return static_cast<size_t>(status.ullAvailPhys);
+        return SIZE_MAX;
+#elif defined(_SC_AVPHYS_PAGES)
+        long pages = sysconf(_SC_AVPHYS_PAGES);
+        long pageSize = sysconf(_SC_PAGESIZE);
+        if (pages < 0 || pageSize < 0) return SIZE_MAX;
+        return static_cast<size_t>(pages) * static_cast<size_t>(pageSize);
+#else
+        return SIZE_MAX;
+#endif
+    }
+    
+    void* acquire(size_t bytes) const {
+        if (bytes < minPooledBytes) {
+            return fastMalloc(bytes);
         }
         
-        // If overlay is enabled, blend the edges with the original image
-        if (params.overlayEdges) {
-            // Convert edges to BGR if it's grayscale
-            Mat edgesBGR;
-            if (edges.channels() == 1) {
-                cvtColor(edges, edgesBGR, COLOR_GRAY2BGR);
-            } else {
-                edgesBGR = edges.clone();
-            }
-            
-            // Create a colored version of the edges
-            Mat coloredEdges;
-            edgesBGR.copyTo(coloredEdges);
+        size_t capacity = sizeClass(bytes);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            counters.requests++;
             
-            // Set the color of the edges
-            for (int y = 0; y < coloredEdges.rows; y++) {
-                for (int x = 0; x < coloredEdges.cols; x++) {
-                    if (edges.at<uchar>(y, x) > 0) {
-                        coloredEdges.at<Vec3b>(y, x)[0] = static_cast<uchar>(params.edgeColor[0] * 255); // B
-                        coloredEdges.at<Vec3b>(y, x)[1] = static_cast<uchar>(params.edgeColor[1] * 255); // G
-                        coloredEdges.at<Vec3b>(y, x)[2] = static_cast<uchar>(params.edgeColor[2] * 255); // R
-                    }
+            // Most recently released first, it is the likeliest to still be in cache
+            for (auto it = idleOrder.rbegin(); it != idleOrder.rend(); ++it) {
+                if (it->capacity == capacity) {
+                    void* data = it->data;
+                    idleOrder.erase(std::next(it).base());
+                    counters.hits++;
+                    counters.bytesIdle -= capacity;
+                    counters.bytesInUse += capacity;
+                    return data;
                 }
             }
-            
-            // Blend the colored edges with the original image
-            Mat originalBGR = workingImage.clone();
-            addWeighted(originalBGR, 1.0 - params.edgeOpacity, coloredEdges, params.edgeOpacity, 0, workingImage);
-        } else {
-            // Just use the edges as the result
-            if (edges.channels() == 1) {
-        cvtColor(edges, workingImage, COLOR_GRAY2BGR);
-            } else {
-                workingImage = edges.clone();
-            }
+            counters.bytesInUse += capacity;
+            counters.peakBytes = std::max(counters.peakBytes, counters.bytesInUse + counters.bytesIdle);
         }
-        
-        // Update the texture
-        updateTexture();
+        return fastMalloc(capacity);
     }
     
-    void applyBlur() {
-        if (workingImage.empty()) {
-            cout << "No image loaded yet." << endl;
+    void release(void* data, size_t bytes) const {
+        if (bytes < minPooledBytes) {
+            fastFree(data);
             return;
         }
         
-        // Add current state to history before applying changes
-        addToHistory(workingImage);
-        
-        // Apply blur based on selected options
-        if (params.useDirectionalBlur) {
-            // Directional blur (motion blur)
+        size_t capacity = sizeClass(bytes);
+        std::lock_guard<std::mutex> guard(lock);
+        counters.bytesInUse -= capacity;
+        idleOrder.push_back({data, capacity, std::chrono::steady_clock::now()});
+        counters.bytesIdle += capacity;
+        trimLocked(config.maxIdleBytes);
+    }
+    
+    void freeOldestLocked() const {
+        IdleBuffer oldest = idleOrder.front();
+        idleOrder.pop_front();
+        fastFree(oldest.data);
+        counters.bytesIdle -= oldest.capacity;
+        counters.trimmedBytes += oldest.capacity;
+    }
+    
+    void trimLocked(size_t keepBytes) const {
+        while (!idleOrder.empty() && counters.bytesIdle > keepBytes) {
+            freeOldestLocked();
+        }
+    }
+    
+    // MatAllocator's interface is const, so the pool state is mutable
+    mutable std::mutex lock;
+    mutable std::deque<IdleBuffer> idleOrder;  // Released buffers, oldest first
+    mutable Stats counters;
+    Settings config;
+    std::chrono::steady_clock::time_point lastMaintenance;
+};
+
+// Value of full white for a pixel depth: 8-bit and 16-bit images use their integer
+// range, floating point images (including half floats) are normalised to 0..1
+double whiteLevel(int depth) {
+    switch (depth) {
+        case CV_8U: return 255.0;
+        case CV_16U: return 65535.0;
+        default: return 1.0;
+    }
+}
+
+// Quantise an image to 8 bits; only used for display, export and 8-bit-only inputs
+Mat quantizeTo8U(const Mat& image) {
+    if (image.empty() || image.depth() == CV_8U) return image;
+    Mat quantized;
+    image.convertTo(quantized, CV_8U, 255.0 / whiteLevel(image.depth()));
+    return quantized;
+}
+
+// Human readable name of an image's storage format
+const char* describeStorage(const Mat& image) {
+    switch (image.depth()) {
+        case CV_8U: return image.channels() == 3 ? "8-bit BGR" : "8-bit";
+        case CV_16U: return image.channels() == 3 ? "16-bit BGR" : "16-bit";
+        case CV_16F: return image.channels() == 3 ? "Half-float BGR" : "Half-float";
+        case CV_32F: return image.channels() == 3 ? "32-bit float BGR" : "32-bit float";
+        default: return "Other";
+    }
+}
+
+// Typed pixel kernels. The per-pixel loops of point operations are written once as a row
+// function over raw pointers, templated on the element type and the channel count, and
+// the helpers here run it over every row of the images involved. With both fixed at
+// compile time the inner loops have constant strides and none of the per-pixel index
+// arithmetic of Mat::at. Kept free of calls (saturate_cast goes through cvRound, saturate
+// below does not) and of branches other than selects, unit-stride loops are vectorised by
+// GCC at -O3, the optimisation of the default Release build (check with -fopt-info-vec).
+// Interleaved three-channel loops need SSSE3 shuffles, which a baseline x86-64 build does
+// not have, so the hot 8-bit kernels use OpenCV's universal intrinsics instead, with the
+// scalar loop for the tail of each run. Continuous images are handled as one long row, and large images are
+// split across the scheduler's workers; tiles that are already running on a worker are
+// too small to be split again.
+namespace PixelKernels {
+
+// Fewest pixels worth handing to another worker
+constexpr long long minPixelsPerTask = 1 << 16;
+
+// Split the pixels of `size` into strips and call strip(rows, cols) on each of them,
+// where every row of `rows` is a run of pixels from cols.start to cols.end. With
+// `continuous` the image is treated as a single row, so the runs can wrap past its width
+template <typename Strip>
+void forEachStrip(Size size, bool continuous, const Strip& strip) {
+    if (size.width <= 0 || size.height <= 0) return;
+    if (continuous) {
+        size = Size(size.width * size.height, 1);
+    }
+    
+    TileScheduler& scheduler = TileScheduler::instance();
+    long long pixels = static_cast<long long>(size.width) * size.height;
+    int tasks = static_cast<int>(std::min<long long>(pixels / minPixelsPerTask, scheduler.threadCount() * 4));
+    if (tasks <= 1) {
+        strip(Range(0, size.height), Range(0, size.width));
+        return;
+    }
+    
+    if (size.height == 1) {
+        scheduler.parallelFor(tasks, [&](int task) {
+            strip(Range(0, 1), Range(static_cast<int>(pixels * task / tasks), static_cast<int>(pixels * (task + 1) / tasks)));
+        });
+    } else {
+        tasks = std::min(tasks, size.height);
+        scheduler.parallelFor(tasks, [&](int task) {
+            int begin = static_cast<int>(static_cast<long long>(size.height) * task / tasks);
+            int end = static_cast<int>(static_cast<long long>(size.height) * (task + 1) / tasks);
+            strip(Range(begin, end), Range(0, size.width));
+        });
+    }
+}
+
+// Pointer to pixel (x, y) of an image with elements of type T
+template <typename T>
+T* pixelAt(const Mat& image, int y, int x) {
+    return const_cast<T*>(image.ptr<T>(y)) + static_cast<size_t>(x) * image.channels();
+}
+
+// out = row(in) pixel by pixel: row(const TIn* in, TOut* out, int pixels).
+// `out` is (re)allocated as `outType`; it may be `in` when the types match
+template <typename TIn, typename TOut, typename Row>
+void transform(const Mat& in, Mat& out, int outType, const Row& row) {
+    Mat source = in;  // Keeps the input alive if `out` is reallocated over it
+    out.create(source.size(), outType);
+    bool continuous = source.isContinuous() && out.isContinuous();
+    forEachStrip(source.size(), continuous, [&](const Range& rows, const Range& cols) {
+        for (int y = rows.start; y < rows.end; y++) {
+            row(pixelAt<TIn>(source, y, cols.start), pixelAt<TOut>(out, y, cols.start), cols.size());
+        }
+    });
+}
+
+// out = row(a, b) pixel by pixel: row(const TA* a, const TB* b, TOut* out, int pixels).
+// `a` and `b` have the same size but may differ in type and channel count
+template <typename TA, typename TB, typename TOut, typename Row>
+void combine(const Mat& a, const Mat& b, Mat& out, int outType, const Row& row) {
+    CV_Assert(a.size() == b.size());
+    Mat first = a, second = b;
+    out.create(first.size(), outType);
+    bool continuous = first.isContinuous() && second.isContinuous() && out.isContinuous();
+    forEachStrip(first.size(), continuous, [&](const Range& rows, const Range& cols) {
+        for (int y = rows.start; y < rows.end; y++) {
+            row(pixelAt<TA>(first, y, cols.start), pixelAt<TB>(second, y, cols.start), pixelAt<TOut>(out, y, cols.start), cols.size());
+        }
+    });
+}
+
+// Fold the pixels of `in` into a value: every strip accumulates its own copy of `zero`
+// with row(Acc& acc, const T* in, int pixels), and the copies are merged with
+// merge(Acc& total, const Acc& part)
+template <typename T, typename Acc, typename Row, typename Merge>
+Acc reduce(const Mat& in, const Acc& zero, const Row& row, const Merge& merge) {
+    Acc total = zero;
+    std::mutex mergeLock;
+    forEachStrip(in.size(), in.isContinuous(), [&](const Range& rows, const Range& cols) {
+        Acc part = zero;
+        for (int y = rows.start; y < rows.end; y++) {
+            row(part, static_cast<const T*>(pixelAt<T>(in, y, cols.start)), cols.size());
+        }
+        std::lock_guard<std::mutex> guard(mergeLock);
+        merge(total, part);
+    });
+    return total;
+}
+
+// saturate_cast<T>(value) without the call to cvRound: integers are rounded half up, not
+// to even, and clamped in integer arithmetic, which the vectoriser handles; floats pass
+template <typename T>
+inline T saturate(float value) {
+    if constexpr (std::is_integral_v<T>) {
+        int level = static_cast<int>(value + 0.5f);
+        return static_cast<T>(std::min(std::max(level, 0), static_cast<int>(std::numeric_limits<T>::max())));
+    } else {
+        return value;
+    }
+}
+
+// Fill `out` pixel by pixel from its coordinates: row(T* out, int x, int y, int pixels)
+// writes the run of `pixels` starting at (x, y)
+template <typename T, typename Row>
+void generate(Mat& out, const Row& row) {
+    forEachStrip(out.size(), false, [&](const Range& rows, const Range& cols) {
+        for (int y = rows.start; y < rows.end; y++) {
+            row(pixelAt<T>(out, y, cols.start), cols.start, y, cols.size());
+        }
+    });
+}
+
+// Call f(T()) with the element type of `depth`. Half floats are widened before kernels run
+template <typename F>
+void dispatchDepth(int depth, const F& f) {
+    switch (depth) {
+        case CV_8U: f(uchar()); break;
+        case CV_16U: f(ushort()); break;
+        default:
+            CV_Assert(depth == CV_32F);
+            f(float());
+            break;
+    }
+}
+
+// Call f(std::integral_constant<int, CN>()) with the channel count CN as a constant
+template <typename F>
+void dispatchChannels(int channels, const F& f) {
+    switch (channels) {
+        case 1: f(std::integral_constant<int, 1>()); break;
+        case 3: f(std::integral_constant<int, 3>()); break;
+        default:
+            CV_Assert(channels == 4);
+            f(std::integral_constant<int, 4>());
+            break;
+    }
+}
+
+} // namespace PixelKernels
+
+// 3D colour lookup table loaded from a .cube file. The lattice is stored as RGB float
+// triplets with red varying fastest, the order of the file, so the eight corners of a
+// cell are at fixed strides from each other
+class ColorLut3D {
+public:
+    // Parse a .cube file; returns null and sets `error` when it cannot be used
+    static shared_ptr<ColorLut3D> load(const string& path, string& error) {
+        ifstream file(path);
+        if (!file) {
+            error = "cannot open " + path;
+            return nullptr;
+        }
+        
+        auto lut = make_shared<ColorLut3D>();
+        string line;
+        while (getline(file, line)) {
+            size_t start = line.find_first_not_of(" \t\r");
+            if (start == string::npos || line[start] == '#') continue;
+            
+            istringstream fields(line.substr(start));
+            string keyword;
+            fields >> keyword;
+            if (keyword == "TITLE") {
+                continue;
+            } else if (keyword == "LUT_3D_SIZE") {
+                fields >> lut->size;
+                if (lut->size < 2 || lut->size > 256) {
+                    error = "unsupported LUT_3D_SIZE";
+                    return nullptr;
+                }
+                lut->lattice.reserve(static_cast<size_t>(lut->size) * lut->size * lut->size * 3);
+            } else if (keyword == "LUT_1D_SIZE") {
+                error = "1D LUTs are not supported";
+                return nullptr;
+            } else if (keyword == "DOMAIN_MIN") {
+                if (!(fields >> lut->domainMin[0] >> lut->domainMin[1] >> lut->domainMin[2])) {
+                    error = "malformed DOMAIN_MIN";
+                    return nullptr;
+                }
+            } else if (keyword == "DOMAIN_MAX") {
+                if (!(fields >> lut->domainMax[0] >> lut->domainMax[1] >> lut->domainMax[2])) {
+                    error = "malformed DOMAIN_MAX";
+                    return nullptr;
+                }
+            } else if (keyword == "LUT_3D_INPUT_RANGE") {
+                // Resolve's form of the domain: one range for all three axes
+                float low, high;
+                if (!(fields >> low >> high)) {
+                    error = "malformed LUT_3D_INPUT_RANGE";
+                    return nullptr;
+                }
+                std::fill(lut->domainMin, lut->domainMin + 3, low);
+                std::fill(lut->domainMax, lut->domainMax + 3, high);
+            } else if (isalpha(static_cast<unsigned char>(keyword[0]))) {
+                // Other keywords (LUT_1D_INPUT_RANGE, vendor extensions) do not affect a 3D table
+                continue;
+            } else {
+                // A data line: the keyword is the red value
+                float r, g, b;
+                istringstream values(line.substr(start));
+                if (!(values >> r >> g >> b)) {
+                    error = "unexpected line: " + line;
+                    return nullptr;
+                }
+                lut->lattice.insert(lut->lattice.end(), {r, g, b});
+            }
+        }
+        
+        // The domain is divided by its width on every lookup
+        for (int c = 0; c < 3; c++) {
+            if (!(lut->domainMax[c] > lut->domainMin[c])) {
+                error = "DOMAIN_MAX must be greater than DOMAIN_MIN";
+                return nullptr;
+            }
+        }
+        
+        size_t expected = static_cast<size_t>(lut->size) * lut->size * lut->size * 3;
+        if (lut->size == 0 || lut->lattice.size() != expected) {
+            error = "expected " + to_string(expected / 3) + " entries, found " + to_string(lut->lattice.size() / 3);
+            return nullptr;
+        }
+        return lut;
+    }
+    
+    int latticeSize() const {
+        return size;
+    }
+    
+    // Map a BGR image (8U, 16U or 32F) through the table, mixing `strength` of the graded
+    // colour with the original. Rows are processed in parallel strips
+    void apply(const Mat& src, Mat& dst, float strength) {
+        // For large 8-bit frames every possible colour is graded once, after which each
+        // pixel is a single lookup; smaller frames interpolate directly
+        if (src.depth() == CV_8U && (!directTable.empty() || src.total() >= directTableMinPixels)) {
+            buildDirectTable();
+        }
+        
+        bool direct = src.depth() == CV_8U && !directTable.empty();
+        float white = static_cast<float>(whiteLevel(src.depth()));
+        Mat output(src.size(), src.type());
+        TileScheduler::instance().parallelRows(src.rows, [&](int begin, int end) {
+            for (int y = begin; y < end; y++) {
+                if (direct) {
+                    lookupRow(src.ptr<uchar>(y), output.ptr<uchar>(y), src.cols, strength);
+                    continue;
+                }
+                switch (src.depth()) {
+                    case CV_8U: interpolateRow<uchar>(src.ptr<uchar>(y), output.ptr<uchar>(y), src.cols, white, strength); break;
+                    case CV_16U: interpolateRow<ushort>(src.ptr<ushort>(y), output.ptr<ushort>(y), src.cols, white, strength); break;
+                    default: interpolateRow<float>(src.ptr<float>(y), output.ptr<float>(y), src.cols, white, strength); break;
+                }
+            }
+        });
+        dst = output;
+    }
+
+private:
+    // Building the 256^3 table costs about as much as grading a frame of this size
+    static constexpr size_t directTableMinPixels = 2 * 1024 * 1024;
+    
+    int size = 0;
+    float domainMin[3] = {0.0f, 0.0f, 0.0f};
+    float domainMax[3] = {1.0f, 1.0f, 1.0f};
+    vector<float> lattice;
+    vector<uchar> directTable;  // BGR output for every 8-bit BGR input, indexed by (b << 16 | g << 8 | r)
+    std::mutex directTableLock;
+    
+    // Tetrahedral interpolation of an RGB colour on the 0..1 domain scale. The cell is split
+    // into six tetrahedra along its main diagonal; ordering the fractions picks the one holding
+    // the colour, and four corners are blended instead of trilinear's eight
+    void lookup(float r, float g, float b, float* out) const {
+        float scale = static_cast<float>(size - 1);
+        float pr = std::min(std::max((r - domainMin[0]) / (domainMax[0] - domainMin[0]), 0.0f), 1.0f) * scale;
+        float pg = std::min(std::max((g - domainMin[1]) / (domainMax[1] - domainMin[1]), 0.0f), 1.0f) * scale;
+        float pb = std::min(std::max((b - domainMin[2]) / (domainMax[2] - domainMin[2]), 0.0f), 1.0f) * scale;
+        int r0 = std::min(static_cast<int>(pr), size - 2);
+        int g0 = std::min(static_cast<int>(pg), size - 2);
+        int b0 = std::min(static_cast<int>(pb), size - 2);
+        float fr = pr - r0;
+        float fg = pg - g0;
+        float fb = pb - b0;
+        
+        const size_t strideR = 3;
+        const size_t strideG = 3 * static_cast<size_t>(size);
+        const size_t strideB = strideG * size;
+        const float* c000 = &lattice[b0 * strideB + g0 * strideG + r0 * strideR];
+        const float* c111 = c000 + strideR + strideG + strideB;
+        
+        // Corners visited from c000 to c111 and their weights
+        const float* first;
+        const float* second;
+        float w0, w1, w2, w3;
+        if (fr > fg) {
+            if (fg > fb) {        // r > g > b
+                first = c000 + strideR; second = first + strideG;
+                w0 = 1.0f - fr; w1 = fr - fg; w2 = fg - fb; w3 = fb;
+            } else if (fr > fb) { // r > b >= g
+                first = c000 + strideR; second = first + strideB;
+                w0 = 1.0f - fr; w1 = fr - fb; w2 = fb - fg; w3 = fg;
+            } else {              // b >= r > g
+                first = c000 + strideB; second = first + strideR;
+                w0 = 1.0f - fb; w1 = fb - fr; w2 = fr - fg; w3 = fg;
+            }
+        } else {
+            if (fb > fg) {        // b > g >= r
+                first = c000 + strideB; second = first + strideG;
+                w0 = 1.0f - fb; w1 = fb - fg; w2 = fg - fr; w3 = fr;
+            } else if (fb > fr) { // g >= b > r
+                first = c000 + strideG; second = first + strideB;
+                w0 = 1.0f - fg; w1 = fg - fb; w2 = fb - fr; w3 = fr;
+            } else {              // g >= r >= b
+                first = c000 + strideG; second = first + strideR;
+                w0 = 1.0f - fg; w1 = fg - fr; w2 = fr - fb; w3 = fb;
+            }
+        }
+        
+        for (int c = 0; c < 3; c++) {
+            out[c] = w0 * c000[c] + w1 * first[c] + w2 * second[c] + w3 * c111[c];
+        }
+    }
+    
+    void buildDirectTable() {
+        std::lock_guard<std::mutex> guard(directTableLock);
+        if (!directTable.empty()) return;
+        
+        vector<uchar> table(256 * 256 * 256 * 3);
+        TileScheduler::instance().parallelFor(256, [&](int b) {
+            float rgb[3];
+            uchar* out = &table[static_cast<size_t>(b) * 256 * 256 * 3];
+            for (int g = 0; g < 256; g++) {
+                for (int r = 0; r < 256; r++) {
+                    lookup(r / 255.0f, g / 255.0f, b / 255.0f, rgb);
+                    out[0] = saturate_cast<uchar>(rgb[2] * 255.0f);
+                    out[1] = saturate_cast<uchar>(rgb[1] * 255.0f);
+                    out[2] = saturate_cast<uchar>(rgb[0] * 255.0f);
+                    out += 3;
+                }
+            }
+        });
+        directTable.swap(table);
+    }
+    
+    void lookupRow(const uchar* in, uchar* out, int cols, float strength) const {
+        float keep = 1.0f - strength;
+        for (int x = 0; x < cols; x++) {
+            const uchar* pixel = in + 3 * x;
+            const uchar* graded = &directTable[((static_cast<size_t>(pixel[0]) << 16) | (pixel[1] << 8) | pixel[2]) * 3];
+            for (int c = 0; c < 3; c++) {
+                out[3 * x + c] = saturate_cast<uchar>(pixel[c] * keep + graded[c] * strength);
+            }
+        }
+    }
+    
+    template <typename T>
+    void interpolateRow(const T* in, T* out, int cols, float white, float strength) const {
+        float keep = 1.0f - strength;
+        float rgb[3];
+        for (int x = 0; x < cols; x++) {
+            const T* pixel = in + 3 * x;
+            T* result = out + 3 * x;
+            lookup(pixel[2] / white, pixel[1] / white, pixel[0] / white, rgb);
+            for (int c = 0; c < 3; c++) {
+                result[c] = saturate_cast<T>(pixel[c] * keep + rgb[2 - c] * white * strength);
+            }
+        }
+    }
+};
+
+// Operations loaded from plugin libraries (see image_editor_plugin.h). Libraries stay
+// loaded until the process exits, since recorded pipelines refer to their operations
+class PluginRegistry {
+public:
+    static PluginRegistry& instance() {
+        static PluginRegistry registry;
+        return registry;
+    }
+    
+    // Default plugin directory: $IMAGE_EDITOR_PLUGIN_DIR, else "plugins" next to the executable
+    static string defaultDirectory(const char* executablePath) {
+        if (const char* directory = getenv("IMAGE_EDITOR_PLUGIN_DIR")) {
+            return directory;
+        }
+        return (std::filesystem::path(executablePath).parent_path() / "plugins").string();
+    }
+    
+    // Load every shared library in `directory`; a missing directory simply has no plugins
+    void loadDirectory(const string& directory) {
+        std::error_code error;
+        if (!std::filesystem::is_directory(directory, error)) return;
+        
+        vector<string> paths;
+        for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+            string extension = entry.path().extension().string();
+            if (extension == ".so" || extension == ".dylib" || extension == ".dll") {
+                paths.push_back(entry.path().string());
+            }
+        }
+        // Load in a fixed order, so duplicate names resolve the same way every time
+        std::sort(paths.begin(), paths.end());
+        for (const string& path : paths) {
+            loadLibrary(path);
+        }
+    }
+    
+    const vector<const IEOperation*>& operations() const {
+        return loaded;
+    }
+    
+    const IEOperation* find(const string& name) const {
+        for (const IEOperation* op : loaded) {
+            if (name == op->name) return op;
+        }
+        return nullptr;
+    }
+
+private:
+    void loadLibrary(const string& path) {
+#ifdef _WIN32
+        HMODULE library = LoadLibraryA(path.c_str());
+        if (!library) {
+            cerr << "Skipping plugin " << path << ": cannot load it (error " << GetLastError() << ")" << endl;
+            return;
+        }
+        auto entry = reinterpret_cast<IEPluginEntryPoint>(GetProcAddress(library, IE_PLUGIN_ENTRY_POINT));
+#else
+        void* library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!library) {
+            cerr << "Skipping plugin " << path << ": " << dlerror() << endl;
+            return;
+        }
+        auto entry = reinterpret_cast<IEPluginEntryPoint>(dlsym(library, IE_PLUGIN_ENTRY_POINT));
+#endif
+        if (!entry) {
+            cerr << "Skipping plugin " << path << ": it does not export " << IE_PLUGIN_ENTRY_POINT << endl;
+            return;
+        }
+        
+        int count = 0;
+        const IEOperation* ops = entry(IE_PLUGIN_API_VERSION, &count);
+        if (!ops) {
+            cerr << "Skipping plugin " << path << ": it does not support plugin API version " << IE_PLUGIN_API_VERSION << endl;
+            return;
+        }
+        
+        for (int i = 0; i < count; i++) {
+            const IEOperation* op = &ops[i];
+            string problem;
+            if (!op->name || !op->process) {
+                problem = "it has no name or process function";
+            } else if (op->param_count < 0 || op->param_count > IE_MAX_PARAMS || (op->param_count > 0 && !op->params)) {
+                problem = "its parameter list is missing or longer than " + to_string(IE_MAX_PARAMS) + " entries";
+            } else if ((op->formats & (IE_FORMAT_8U | IE_FORMAT_16U | IE_FORMAT_32F)) == 0) {
+                problem = "it accepts no pixel format";
+            } else if (find(op->name)) {
+                problem = "an operation with this name is already loaded";
+            }
+            if (!problem.empty()) {
+                cerr << "Skipping operation " << i << " of plugin " << path << ": " << problem << endl;
+                continue;
+            }
+            loaded.push_back(op);
+            cout << "Loaded plugin operation " << op->name << " from " << path << endl;
+        }
+    }
+    
+    vector<const IEOperation*> loaded;
+};
+
+class ImageEditorGUI {
+private:
+    Mat originalImage;     // Store original image for reset
+    Mat workingImage;      // Current working image
+    string imagePath;
+    deque<string> queuedPaths;  // Further images given on the command line
+    bool cropMode = false;
+    Rect cropRect;
+    
+    // Region selection: while active, operations only touch this part of the image
+    bool regionActive = false;
+    Rect regionRect;
+    Rect operationFrame;   // Part of the image the running operation sees, in image coordinates
+    Point startPoint;
+    Mat tempImage;
+    
+    // High-bit-depth sources are kept as 16-bit integers, or as half floats when enabled
+    bool storeHalfFloat = false;
+    
+public:
+    // Parameters for adjustments
+    struct EditParams {
+        float brightness = 0.0f;      // Range -100 to 100
+        float contrast = 100.0f;      // Range 0 to 300 (100 is normal)
+        float blurSize = 0.0f;        // Range 0 to 15
+        float rotationAngle = 0.0f;   // Range 0 to 360
+        float rotationScale = 100.0f; // Range 10 to 300 (percentage), applied with the rotation
+        bool rotationExpandCanvas = false; // Grow the canvas to fit the rotated corners instead of clipping them
+        float resizeRatio = 100.0f;   // Range 1 to 300 (percentage)
+        int resizeMode = 0;           // 0: percentage, 1: longest side in pixels
+        int resizeLongestSide = 1600; // Longest side of the result in pixels
+        int resizeFilter = 1;         // 0: Area, 1: Lanczos3, 2: Mitchell
+        
+        // Advanced blur parameters
+        float gaussianBlurRadius = 5.0f;  // Range 1 to 20
+        float blurSigma = 0.0f;            // Gaussian sigma; 0 derives it from the radius
+        float directionalBlurAngle = 0.0f; // Range 0 to 360
+        bool useDirectionalBlur = false;   // Toggle between uniform and directional blur
+        
+        // Edge-preserving smoothing parameters
+        int smoothRadius = 8;              // Window radius in pixels, 1 to 100
+        float smoothEdgeThreshold = 20.0f; // On the 8-bit scale: detail well below it is smoothed, edges well above it kept
+        
+        // Morphology parameters
+        int morphOperation = 0;       // 0: Erode, 1: Dilate, 2: Open, 3: Close, 4: Top-hat, 5: Black-hat, 6: Gradient
+        int morphShape = 0;           // 0: Rectangle, 1: Line
+        int morphWidth = 5;           // Rectangle width in pixels (odd)
+        int morphHeight = 5;          // Rectangle height in pixels (odd)
+        int morphLineLength = 15;     // Line length in pixels (odd)
+        int morphLineAngle = 0;       // 0: 0 degrees, 1: 45, 2: 90, 3: 135
+        
+        // Median / rank filter parameters
+        int medianRadius = 2;         // Window radius in pixels, 1 to 100
+        float medianPercentile = 50.0f; // Rank in the window: 0 minimum, 50 median, 100 maximum
+        
+        // Histogram equalisation parameters
+        int equalizeMethod = 1;       // 0: Global, 1: CLAHE
+        int claheTiles = 8;           // Blocks along each side of the image, 2 to 32
+        float claheClipLimit = 2.0f;  // Highest bin count as a multiple of the mean, 1 to 10
+        
+        // Threshold parameters
+        int thresholdValue = 128;     // Range 0 to 255
+        int thresholdMaxValue = 255;  // Maximum value for binary threshold
+        int adaptiveBlockSize = 11;   // Block size for adaptive threshold (must be odd)
+        int adaptiveC = 2;            // Constant subtracted from mean for adaptive threshold
+        int thresholdMethod = 0;      // 0: Binary, 1: Adaptive, 2: Otsu
+        int adaptiveMethod = 0;       // 0: Gaussian, 1: Mean, 2: Sauvola, 3: Niblack
+        float sauvolaK = 0.34f;       // Sauvola sensitivity to the local deviation
+        float niblackK = -0.2f;       // Niblack weight of the local deviation
+        
+        // Edge detection parameters
+        int edgeDetectionMethod = 0;  // 0: Sobel, 1: Canny
+        int sobelKernelSize = 3;      // Kernel size for Sobel (must be odd)
+        int cannyThreshold1 = 50;     // First threshold for Canny
+        int cannyThreshold2 = 150;    // Second threshold for Canny
+        bool overlayEdges = false;    // Whether to overlay edges on original image
+        float edgeColor[3] = {0.0f, 1.0f, 0.0f}; // Green color for edges (BGR)
+        float edgeOpacity = 0.7f;     // Opacity of edge overlay (0-1)
+        
+        // Blend parameters
+        int blendMode = 0;            // 0: Normal, 1: Multiply, 2: Screen, 3: Overlay, 4: Difference
+        float blendOpacity = 1.0f;    // Range 0 to 1
+        string blendImagePath = "";    // Path to the second image for blending
+        
+        // 3D LUT parameters
+        string lutPath = "";          // .cube file to grade with
+        float lutStrength = 1.0f;     // Mix of the graded colour, 0 to 1
+        
+        // Curves and levels parameters
+        static constexpr int maxCurvePoints = 16;
+        int curvePointCount[4] = {2, 2, 2, 2};  // Control points of the master, red, green and blue curves
+        float curvePoints[4][maxCurvePoints][2] = {  // (input, output) on 0..1, sorted by input
+            {{0.0f, 0.0f}, {1.0f, 1.0f}}, {{0.0f, 0.0f}, {1.0f, 1.0f}},
+            {{0.0f, 0.0f}, {1.0f, 1.0f}}, {{0.0f, 0.0f}, {1.0f, 1.0f}}
+        };
+        float levelsBlack = 0.0f;     // Input black point, 0 to 255
+        float levelsWhite = 255.0f;   // Input white point, 0 to 255
+        float levelsGamma = 1.0f;     // Midtone gamma, 0.1 to 10 (above 1 brightens)
+        
+        // Noise parameters
+        int noiseType = 0;            // 0: Perlin, 1: Simplex, 2: Worley, 3: Value, 4: Fractal Brownian Motion
+        float noiseScale = 10.0f;     // Scale of the noise (higher = finer detail)
+        float noiseAmplitude = 1.0f;  // Amplitude of the noise (0-1)
+        int noiseOctaves = 4;         // Number of octaves for FBM (1-8)
+        float noisePersistence = 0.5f; // Persistence for FBM (0-1)
+        float noiseLacunarity = 2.0f; // Lacunarity for FBM (1-4)
+        bool noiseInvert = false;     // Invert the noise pattern
+        bool noiseColorize = false;   // Apply color to the noise
+        float noiseColor[3] = {0.0f, 0.5f, 1.0f}; // Color for noise (BGR)
+        int noiseSeed = 1;            // Seed of the Worley feature points
+
+        // Convolution parameters
+        int kernelSize = 3;           // 3x3 or 5x5
+        float kernel[25] = {0};       // Max size for 5x5 kernel
+        float kernelScale = 1.0f;     // Scale factor for kernel values
+        float kernelOffset = 0.0f;    // Offset added to result
+        int currentPreset = 0;        // 0: Custom, 1: Sharpen, 2: Emboss, 3: Edge Enhance
+        
+        // Plugin operation and its parameter values, in the order the plugin declares them
+        string pluginName;
+        float pluginValues[IE_MAX_PARAMS] = {0};
+    };
+    EditParams params;
+    
+    // Recorded operation list: every operation applied since the image was loaded, with
+    // the parameters it ran with, so the same edit can be optimised and replayed
+    enum OperationKind {
+        OP_GRAYSCALE,
+        OP_SHARPEN,
+        OP_INVERT,
+        OP_EDGE_DETECTION,
+        OP_BLUR,
+        OP_THRESHOLD,
+        OP_BLEND,
+        OP_NOISE,
+        OP_CONVOLUTION,
+        OP_CROP,
+        OP_ROTATE,
+        OP_BRIGHTNESS_CONTRAST,
+        OP_COLOR_LUT,
+        OP_CURVES_LEVELS,
+        OP_SMOOTH,
+        OP_MORPHOLOGY,
+        OP_RESIZE,
+        OP_MEDIAN,
+        OP_EQUALIZE,
+        OP_PLUGIN
+    };
+    struct RecordedOp {
+        OperationKind kind;
+        EditParams params;   // Parameters at the time the operation ran
+        Rect region;         // Selected region, or crop rectangle for OP_CROP; empty for the whole image
+    };
+
+private:
+    vector<RecordedOp> recordedOps;
+    bool batchMode = false;  // Replaying: no history, recording or texture updates
+    
+    // History of the image states. Entry i sits between state i and state i + 1 and holds
+    // the side of that step that is not on screen: the state before it while it is applied,
+    // the state after it once it has been undone. Undo and redo both swap the entry with the
+    // working image, which for whole images only exchanges Mat headers.
+    // Region operations only store the pixels they changed
+    struct HistoryEntry {
+        Mat image;
+        Rect region;                     // Empty for whole-image states
+        vector<RecordedOp> recordedOps;  // Operation list belonging to the stored side
+        const char* label;               // Operation that leads to state i + 1
+    };
+    vector<HistoryEntry> historyStack;
+    size_t currentHistoryIndex = 0;    // State on screen, 0 is the loaded image
+    const size_t maxHistorySize = 20;  // Limit history size to prevent excessive memory usage
+    
+    // Thumbnails for the history browser, one per state, created when first shown
+    struct HistoryThumbnail {
+        Mat image;
+        GLuint texture = 0;
+    };
+    vector<HistoryThumbnail> historyThumbnails;
+    bool showHistoryBrowser = false;
+    
+    // Folder browser. Thumbnails are made on background threads, which hand them over in
+    // `finished`; the main loop packs them into atlas pages, fixed grids of thumbnail cells.
+    // The threads are joined when the folder is closed
+    struct BrowserJob {
+        vector<string> paths;
+        std::atomic<int> next{0};        // Next path to take
+        std::atomic<int> done{0};
+        std::atomic<int> cacheHits{0};
+        std::atomic<bool> cancelled{false};
+        std::mutex lock;
+        vector<pair<int, Mat>> finished; // Path index and RGB thumbnail, waiting for upload
+        std::chrono::steady_clock::time_point started;
+        bool reported = false;
+    };
+    struct BrowserCell {
+        int page = -1;                   // Atlas page, -1 while pending, -2 when it could not be decoded
+        Size size;                       // Thumbnail size inside the cell
+    };
+    static constexpr int atlasPageSize = 2048;
+    static constexpr int atlasCellsPerRow = atlasPageSize / ThumbnailCache::thumbnailSize;
+    static constexpr int atlasCellsPerPage = atlasCellsPerRow * atlasCellsPerRow;
+    shared_ptr<BrowserJob> browserJob;
+    vector<std::thread> browserThreads;
+    vector<BrowserCell> browserCells;
+    vector<GLuint> atlasPages;
+    bool showFolderBrowser = false;
+    char browserFolder[1024] = "";
+    
+    // OpenGL texture for displaying the image
+    GLuint imageTexture = 0;
+    int imageWidth = 0;
+    int imageHeight = 0;
+    
+    // Image decode running in the background. For large JPEGs a reduced-size preview is
+    // decoded alongside the full image so that something is on screen as early as possible
+    struct BackgroundLoad {
+        string path;              // Asked for with the file dialog when empty
+        bool askForPath = false;
+        Mat preview;
+        Mat full;
+        std::atomic<bool> previewReady{false};
+        std::atomic<bool> fullReady{false};
+        std::atomic<bool> failed{false};
+        bool previewShown = false;
+        std::chrono::steady_clock::time_point started;
+    };
+    shared_ptr<BackgroundLoad> backgroundLoad;
+    std::thread loaderThread;  // Joined before the next load starts and before GLFW terminates
+    
+    // Startup and load timing
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    bool firstFrameShown = false;
+    bool firstPixelPending = false;    // Report time-to-first-pixel once the next frame is on screen
+    double timeToFirstPixelMs = -1.0;
+    double timeToFullImageMs = -1.0;
+    std::chrono::steady_clock::time_point loadStarted;
+    
+    // Idle rendering: frames are only drawn while something is dirty. Input callbacks set
+    // `inputArrived`; every change asks for a few frames so ImGui can settle hover states
+    inline static bool inputArrived = false;
+    int framesToRender = 3;
+    bool continuousRendering = false;
+    deque<std::chrono::steady_clock::time_point> recentFrames;  // Frames drawn in the last second
+    
+    // Histogram shown by the threshold panel, recomputed only when the displayed image changes
+    vector<vector<int>> cachedHistogram;
+    uint64_t imageVersion = 0;
+    uint64_t histogramVersion = UINT64_MAX;
+    
+    // Planes derived from one version of an image, each computed on first request. The
+    // working image's planes are shared by every operation and preview until its pixels
+    // change; holding `source` keeps its buffer from being recycled for another image meanwhile
+    class DerivedPlanes {
+    public:
+        void reset(const Mat& image = Mat()) {
+            *this = DerivedPlanes();
+            source = image;
+        }
+        
+        bool belongsTo(const Mat& image) const {
+            return !source.empty() && source.data == image.data && source.size() == image.size() &&
+                   source.type() == image.type() && source.step[0] == image.step[0];
+        }
+        
+        // Grayscale at the working depth; half floats are widened to float
+        const Mat& luma() {
+            if (lumaPlane.empty()) {
+                Mat widened = source;
+                if (source.depth() == CV_16F) {
+                    source.convertTo(widened, CV_32F);
+                }
+                if (widened.channels() == 3) {
+                    cvtColor(widened, lumaPlane, COLOR_BGR2GRAY);
+                } else {
+                    lumaPlane = widened;
+                }
+            }
+            return lumaPlane;
+        }
+        
+        // Grayscale quantised to 8 bits, for Canny, Otsu and the histogram
+        const Mat& luma8() {
+            if (luma8Plane.empty()) {
+                luma8Plane = quantizeTo8U(luma());
+            }
+            return luma8Plane;
+        }
+        
+        // The image itself quantised to 8 bits, for previews at display precision
+        const Mat& color8() {
+            if (color8Plane.empty()) {
+                color8Plane = quantizeTo8U(source);
+            }
+            return color8Plane;
+        }
+        
+        // `color8` area-averaged to `size`, for previews at display resolution.
+        // Kept for the last size asked for
+        const Mat& display8(Size size) {
+            if (display8Plane.size() != size) {
+                const Mat& full = color8();
+                if (size.width >= full.cols || size.height >= full.rows) {
+                    display8Plane = full;
+                } else {
+                    resize(full, display8Plane, size, 0, 0, INTER_AREA);
+                }
+            }
+            return display8Plane;
+        }
+        
+        // Grayscale as float on the 8-bit scale of the UI's threshold values
+        const Mat& lumaFloat() {
+            if (lumaFloatPlane.empty()) {
+                luma().convertTo(lumaFloatPlane, CV_32F, 255.0 / whiteLevel(luma().depth()));
+            }
+            return lumaFloatPlane;
+        }
+        
+        // Sobel derivatives: 16-bit signed for 8-bit images, float otherwise
+        const Mat& gradientX(int kernelSize) {
+            computeGradients(kernelSize);
+            return gradientXPlane;
+        }
+        
+        const Mat& gradientY(int kernelSize) {
+            computeGradients(kernelSize);
+            return gradientYPlane;
+        }
+        
+        // (|dx| + |dy|) / 2 saturated at white, at the depth of `luma`
+        const Mat& magnitude(int kernelSize) {
+            computeGradients(kernelSize);
+            if (magnitudePlane.empty()) {
+                const Mat& gray = luma();
+                magnitudePlane.create(gray.size(), gray.type());
+                double white = whiteLevel(gray.depth());
+                TileScheduler::instance().parallelRows(gray.rows, [&](int begin, int end) {
+                    Mat absGradX, absGradY;
+                    if (gray.depth() == CV_8U) {
+                        convertScaleAbs(gradientXPlane.rowRange(begin, end), absGradX);
+                        convertScaleAbs(gradientYPlane.rowRange(begin, end), absGradY);
+                        Mat out = magnitudePlane.rowRange(begin, end);
+                        addWeighted(absGradX, 0.5, absGradY, 0.5, 0, out);
+                    } else {
+                        // Float gradients saturated at white, like convertScaleAbs does for 8 bits
+                        absGradX = abs(gradientXPlane.rowRange(begin, end));
+                        absGradY = abs(gradientYPlane.rowRange(begin, end));
+                        absGradX = cv::min(absGradX, white);
+                        absGradY = cv::min(absGradY, white);
+                        Mat sum;
+                        addWeighted(absGradX, 0.5, absGradY, 0.5, 0, sum);
+                        sum.convertTo(magnitudePlane.rowRange(begin, end), gray.depth());
+                    }
+                });
+            }
+            return magnitudePlane;
+        }
+        
+        // Summed-area tables of `lumaFloat` and of its squares
+        const Mat& integral() {
+            if (sumPlane.empty()) {
+                integralTables(lumaFloat(), sumPlane, squareSumPlane);
+            }
+            return sumPlane;
+        }
+        
+        const Mat& squareIntegral() {
+            integral();
+            return squareSumPlane;
+        }
+    
+    private:
+        Mat source;
+        Mat lumaPlane, luma8Plane, lumaFloatPlane, color8Plane, display8Plane;
+        int gradientKernel = 0;
+        Mat gradientXPlane, gradientYPlane, magnitudePlane;
+        Mat sumPlane, squareSumPlane;
+        
+        // Gradients are kept for the last kernel size asked for
+        void computeGradients(int kernelSize) {
+            if (gradientKernel == kernelSize) return;
+            const Mat& gray = luma();
+            int gradientType = gray.depth() == CV_8U ? CV_16S : CV_32F;
+            auto sobel = [kernelSize, gradientType](int dx, int dy) {
+                return TileScheduler::TileOp{kernelSize / 2, [=](const Mat& in, Mat& out, const TileScheduler::TileContext&) {
+                    Sobel(in, out, gradientType, dx, dy, kernelSize);
+                }};
+            };
+            TileScheduler::instance().runTiles(gray, gradientXPlane, {sobel(1, 0)}, gradientType);
+            TileScheduler::instance().runTiles(gray, gradientYPlane, {sobel(0, 1)}, gradientType);
+            magnitudePlane.release();
+            gradientKernel = kernelSize;
+        }
+    };
+    // The last generated noise field, kept with the range it is normalised by. Inversion,
+    // amplitude and colour are applied while compositing, so changing only those reuses it
+    struct NoiseField {
+        vector<float> key;   // Generator parameters, image size and frame the field was made for
+        Mat field;           // Raw noise, CV_32F, covering the frame
+        float low = 0.0f;
+        float high = 1.0f;
+    };
+    NoiseField noiseField;
+    
+    // The parsed LUT, reloaded when the path or the file's modification time changes
+    shared_ptr<ColorLut3D> colorLut;
+    string colorLutPath;
+    time_t colorLutModified = 0;
+    
+    DerivedPlanes derivedPlanes;   // Planes of the working image
+    DerivedPlanes scratchPlanes;   // Planes of any other image, such as a region patch
+    
+    // Live preview of the threshold, edge detection, curves, smoothing or equalize panel, rendered from
+    // the derived planes whenever a parameter changes, without touching the working image
+    bool livePreview = false;
+    GLuint previewTexture = 0;
+    vector<float> previewKey;
+    Size displayedImageSize;   // On-screen size of the image in the last frame
+    
+    // Window dimensions
+    int windowWidth = 2400;
+    int windowHeight = 1800;
+    
+    // UI state
+    bool showDemoWindow = false;
+    bool showAboutWindow = false;
+    bool showHelpWindow = false;
+    bool showBlurOptions = false;  // For advanced blur options window
+    bool showThresholdOptions = false;  // For threshold options window
+    bool showEdgeDetectionOptions = false;  // For edge detection options window
+    bool showBlendOptions = false;  // For blend options window
+    bool showBrightnessOptions = false;  // For brightness options window
+    bool showContrastOptions = false;  // For contrast options window
+    bool showRotationOptions = false;  // For rotation options window
+    
+    // Resizable pane heights
+    float imagePaneHeight = 600.0f;
+    float propertiesPaneHeight = 600.0f;
+    float imageInfoPaneHeight = 200.0f;
+    
+    // Crop mode state
+    bool isDragging = false;
+    ImVec2 dragStart;
+    ImVec2 dragEnd;
+    
+    // Channel splitter state
+    bool showChannelSplitter = false;
+    bool showGrayscaleChannels = false;
+    vector<Mat> splitChannels;
+    vector<GLuint> channelTextures;
+    vector<Mat> grayscaleChannels;
+    vector<GLuint> grayscaleTextures;
+    
+    // Active operation for properties pane
+    enum ActiveOperation {
+        NONE,
+        BRIGHTNESS,
+        CONTRAST,
+        ROTATION,
+        BLUR,
+        THRESHOLD,
+        EDGE_DETECTION,
+        BLEND,
+        NOISE,
+        CONVOLUTION,
+        COLOR_LUT,
+        CURVES_LEVELS,
+        SMOOTH,
+        MORPHOLOGY,
+        RESIZE,
+        MEDIAN,
+        EQUALIZE,
+        PLUGIN
+    };
+    ActiveOperation activeOperation = NONE;
+    
+    // Curve editor state
+    int curveChannel = 0;         // 0: master, 1: red, 2: green, 3: blue
+    int draggedCurvePoint = -1;   // Control point following the mouse, -1 for none
+
+    // Initialize default kernels
+    void initializeDefaultKernels() {
+        // Initialize kernel with zeros
+        std::fill(params.kernel, params.kernel + 25, 0.0f);
+        
+        // Set default 3x3 identity kernel
+        if (params.kernelSize == 3) {
+            params.kernel[0] = 0.0f; params.kernel[1] = 0.0f; params.kernel[2] = 0.0f;
+            params.kernel[3] = 0.0f; params.kernel[4] = 1.0f; params.kernel[5] = 0.0f;
+            params.kernel[6] = 0.0f; params.kernel[7] = 0.0f; params.kernel[8] = 0.0f;
+        } else {
+            // 5x5 identity kernel
+            params.kernel[12] = 1.0f; // Center pixel for 5x5
+        }
+    }
+
+    void applyPresetKernel() {
+        std::fill(params.kernel, params.kernel + 25, 0.0f);
+        params.kernelScale = 1.0f;
+        params.kernelOffset = 0.0f;
+        
+        switch (params.currentPreset) {
+            case 1: // Sharpen
+                params.kernelSize = 3;
+                params.kernel[0] = 0.0f; params.kernel[1] = -1.0f; params.kernel[2] = 0.0f;
+                params.kernel[3] = -1.0f; params.kernel[4] = 5.0f; params.kernel[5] = -1.0f;
+                params.kernel[6] = 0.0f; params.kernel[7] = -1.0f; params.kernel[8] = 0.0f;
+                break;
+                
+            case 2: // Emboss
+                params.kernelSize = 3;
+                params.kernel[0] = -2.0f; params.kernel[1] = -1.0f; params.kernel[2] = 0.0f;
+                params.kernel[3] = -1.0f; params.kernel[4] = 1.0f; params.kernel[5] = 1.0f;
+                params.kernel[6] = 0.0f; params.kernel[7] = 1.0f; params.kernel[8] = 2.0f;
+                params.kernelScale = 1.0f;
+                params.kernelOffset = 128.0f;
+                break;
+                
+            case 3: // Edge Enhance
+                params.kernelSize = 3;
+                params.kernel[0] = 0.0f; params.kernel[1] = -1.0f; params.kernel[2] = 0.0f;
+                params.kernel[3] = -1.0f; params.kernel[4] = 4.0f; params.kernel[5] = -1.0f;
+                params.kernel[6] = 0.0f; params.kernel[7] = -1.0f; params.kernel[8] = 0.0f;
+                break;
+        }
+    }
+
+    void applyConvolution() {
+        if (!workingImage.data) return;
+        
+        Mat result;
+        int kSize = params.kernelSize;
+        Mat kernelMat = Mat(kSize, kSize, CV_32F);
+        
+        // Copy kernel values to Mat
+        for (int i = 0; i < kSize; i++) {
+            for (int j = 0; j < kSize; j++) {
+                kernelMat.at<float>(i, j) = params.kernel[i * kSize + j] * params.kernelScale;
+            }
+        }
+        
+        // Apply convolution tile by tile; filter2D applies the kernel to every channel independently.
+        // The offset is given on the 8-bit scale
+        float offset = params.kernelOffset;
+        runOperation(OP_CONVOLUTION, kSize / 2, [kernelMat, offset, kSize](const Mat& image, Mat& result) {
+            TileScheduler::instance().runTiles(image, result, {{kSize / 2,
+                [kernelMat, offset](const Mat& in, Mat& out, const TileScheduler::TileContext&) {
+                    filter2D(in, out, -1, kernelMat, Point(-1, -1), offset * whiteLevel(in.depth()) / 255.0);
+                }}});
+        });
+    }
+
+public:
+    // Images given here are loaded in the background once the window is up
+    ImageEditorGUI(const vector<string>& paths = {}) {
+        queuedPaths.assign(paths.begin(), paths.end());
+        
+        // Initialize default kernels
+        initializeDefaultKernels();
+    }
+    
+    ~ImageEditorGUI() {
+        // Clean up OpenGL texture
+        if (imageTexture != 0) {
+            glDeleteTextures(1, &imageTexture);
+        }
+        
+        // Clean up channel textures
+        for (auto& texture : channelTextures) {
+            if (texture != 0) {
+                glDeleteTextures(1, &texture);
+            }
+        }
+        
+        // Clean up grayscale textures
+        for (auto& texture : grayscaleTextures) {
+            if (texture != 0) {
+                glDeleteTextures(1, &texture);
+            }
+        }
+        
+        // Clean up history thumbnails
+        dropHistoryThumbnails(0);
+        
+        if (previewTexture != 0) {
+            glDeleteTextures(1, &previewTexture);
+        }
+        
+        closeFolder();
+    }
+    
+    void loadImage(const string& path) {
+        // Keep the source bit depth so 16-bit TIFF/PNG files are not truncated on load
+        Mat loaded = imread(path, IMREAD_ANYDEPTH | IMREAD_COLOR);
+        
+        if (loaded.empty()) {
+            cerr << "Error: Could not open or find the image: " << path << endl;
+            return;
+        }
+        
+        setLoadedImage(path, loaded);
+    }
+    
+    // Make a decoded image the one being edited
+    void setLoadedImage(const string& path, const Mat& loaded) {
+        imagePath = path;
+        cropMode = false;
+        originalImage = toStorageDepth(loaded);
+        workingImage = originalImage.clone();
+        regionActive = false;
+        recordedOps.clear();
+        
+        // Update image dimensions
+        imageWidth = workingImage.cols;
+        imageHeight = workingImage.rows;
+        
+        // Create or update OpenGL texture
+        updateTexture();
+        
+        // Clear history; the loaded image is the first state
+        clearHistory();
+    }
+    
+    // Convert a decoded image to its working storage: 8-bit sources stay 8-bit,
+    // deeper sources become 16-bit integers or half floats (normalised to 0..1)
+    Mat toStorageDepth(const Mat& image) const {
+        if (image.depth() == CV_8U) return image;
+        
+        Mat stored;
+        double sourceWhite = whiteLevel(image.depth());
+        if (storeHalfFloat) {
+            image.convertTo(stored, CV_16F, 1.0 / sourceWhite);
+        } else if (image.depth() == CV_16U) {
+            stored = image;
+        } else {
+            image.convertTo(stored, CV_16U, 65535.0 / sourceWhite);
+        }
+        return stored;
+    }
+    
+    // Run a full-frame operation from `image` into `result` at working precision. Half-float
+    // images are widened to float for the operation and narrowed again afterwards
+    static void applyAtWorkingPrecision(const Mat& image, Mat& result, const std::function<void(const Mat&, Mat&)>& op) {
+        if (image.depth() != CV_16F) {
+            op(image, result);
+            return;
+        }
+        
+        Mat widened, processed;
+        image.convertTo(widened, CV_32F);
+        op(widened, processed);
+        processed.convertTo(result, CV_16F);
+    }
+    
+    // The selected region clipped to the image, or an empty rect when operations
+    // apply to the whole image
+    Rect selectedRegion() const {
+        if (!regionActive || workingImage.empty()) return Rect();
+        return regionRect & Rect(Point(), workingImage.size());
+    }
+    
+    // Run an editing operation on the working image, recording history, the operation list and
+    // updating the texture (none of which happens in batch mode).
+    // With a region selected only the region plus a halo of `radius` pixels is handed to the
+    // operation, so neighbourhood filters still see the real pixels around the region border.
+    // Only the region itself is written back and recorded in history.
+    // `process` reads its input and writes a new image into its result, leaving the input alone.
+    // History and the operation list are only updated once it has returned, so an operation
+    // that throws leaves no trace
+    void runOperation(OperationKind kind, int radius, const std::function<void(const Mat&, Mat&)>& process) {
+        Rect region = selectedRegion();
+        if (region.area() == 0) {
+            operationFrame = Rect(Point(), workingImage.size());
+            Mat result;
+            process(workingImage, result);
+            if (result.data == workingImage.data) {
+                // History must not share pixels with the image edits are written into
+                result = result.clone();
+            }
+            if (!batchMode) {
+                // The working image is replaced, so its buffer moves into history
+                pushHistory({workingImage, Rect(), recordedOps, operationName(kind)});
+                recordedOps.push_back({kind, params, Rect()});
+            }
+            workingImage = result;
+            invalidateDerivedPlanes();
+            if (!batchMode) updateTexture();
+            return;
+        }
+        
+        Rect padded(region.x - radius, region.y - radius, region.width + 2 * radius, region.height + 2 * radius);
+        padded &= Rect(Point(), workingImage.size());
+        
+        Mat patch;
+        operationFrame = padded;
+        process(workingImage(padded), patch);
+        
+        if (patch.size() != padded.size() || patch.type() != workingImage.type()) {
+            cerr << "Error: this operation changes the image format and cannot be applied to a region." << endl;
+            return;
+        }
+        
+        // Record only the pixels that are about to change, then write back the region
+        if (!batchMode) {
+            addRegionToHistory(region, operationName(kind));
+            recordedOps.push_back({kind, params, region});
+        }
+        patch(region - padded.tl()).copyTo(workingImage(region));
+        invalidateDerivedPlanes();
+        if (!batchMode) updateTexture();
+    }
+    
+    // Prepare an image for writing to `path`. PNG and TIFF keep 16 bits,
+    // every other format is quantised to 8 bits
+    Mat prepareForExport(const Mat& image, const string& path) const {
+        if (image.depth() == CV_8U) return image;
+        
+        string extension;
+        size_t dotPos = path.find_last_of(".");
+        if (dotPos != string::npos) {
+            extension = path.substr(dotPos + 1);
+            transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        }
+        
+        if (extension == "png" || extension == "tif" || extension == "tiff") {
+            Mat deep;
+            image.convertTo(deep, CV_16U, 65535.0 / whiteLevel(image.depth()));
+            return deep;
+        }
+        return quantizeTo8U(image);
+    }
+    
+    // Add current image state to history before an operation changes it in place
+    void addToHistory(const Mat& image, const char* label) {
+        pushHistory({image.clone(), Rect(), recordedOps, label});
+    }
+    
+    // Add the current pixels of a region of the working image to history
+    void addRegionToHistory(const Rect& region, const char* label) {
+        pushHistory({workingImage(region).clone(), region, recordedOps, label});
+    }
+    
+    // Add the state on screen to history. Callers that replace the working image afterwards
+    // can hand its buffer over without a copy
+    void pushHistory(HistoryEntry entry) {
+        // If we're not at the end of the history, remove all states after the current one
+        if (currentHistoryIndex < historyStack.size()) {
+            historyStack.resize(currentHistoryIndex);
+        }
+        dropHistoryThumbnails(currentHistoryIndex + 1);
+        
+        // Add the new state
+        historyStack.push_back(std::move(entry));
+        currentHistoryIndex = historyStack.size();
+        
+        // Limit history size
+        if (historyStack.size() > maxHistorySize) {
+            historyStack.erase(historyStack.begin());
+            currentHistoryIndex--;
+            if (!historyThumbnails.empty()) {
+                if (historyThumbnails.front().texture != 0) {
+                    glDeleteTextures(1, &historyThumbnails.front().texture);
+                }
+                historyThumbnails.erase(historyThumbnails.begin());
+            }
+        }
+    }
+    
+    // Clear history
+    void clearHistory() {
+        historyStack.clear();
+        currentHistoryIndex = 0;
+        dropHistoryThumbnails(0);
+    }
+    
+    // Forget the thumbnails of every state from `firstState` on
+    void dropHistoryThumbnails(size_t firstState) {
+        for (size_t state = firstState; state < historyThumbnails.size(); state++) {
+            if (historyThumbnails[state].texture != 0) {
+                glDeleteTextures(1, &historyThumbnails[state].texture);
+            }
+        }
+        if (firstState < historyThumbnails.size()) {
+            historyThumbnails.resize(firstState);
+        }
+    }
+    
+    // Exchange a history entry with the working image: applies the step if it is undone,
+    // undoes it if it is applied
+    void swapHistoryEntry(HistoryEntry& entry) {
+        if (entry.region.area() > 0) {
+            Mat current = workingImage(entry.region).clone();
+            entry.image.copyTo(workingImage(entry.region));
+            entry.image = current;
+        } else {
+            std::swap(entry.image, workingImage);
+        }
+        std::swap(entry.recordedOps, recordedOps);
+    }
+    
+    // Go to any state in history. Whole-image steps in between only exchange Mat headers and
+    // the texture is uploaded once, at the end
+    void jumpToState(size_t state) {
+        if (state > historyStack.size() || state == currentHistoryIndex) return;
+        
+        while (currentHistoryIndex > state) {
+            currentHistoryIndex--;
+            swapHistoryEntry(historyStack[currentHistoryIndex]);
+        }
+        while (currentHistoryIndex < state) {
+            swapHistoryEntry(historyStack[currentHistoryIndex]);
+            currentHistoryIndex++;
+        }
+        
+        // Crops in between may have changed the size
+        imageWidth = workingImage.cols;
+        imageHeight = workingImage.rows;
+        updateTexture();
+    }
+    
+    // Undo the last operation
+    bool undo() {
+        if (!canUndo()) {
+            cout << "Nothing to undo." << endl;
+            return false;
+        }
+        
+        jumpToState(currentHistoryIndex - 1);
+        return true;
+    }
+    
+    // Redo the last undone operation
+    bool redo() {
+        if (!canRedo()) {
+            cout << "Nothing to redo." << endl;
+            return false;
+        }
+        
+        jumpToState(currentHistoryIndex + 1);
+        return true;
+    }
+    
+    // Check if undo is available
+    bool canUndo() const {
+        return currentHistoryIndex > 0;
+    }
+    
+    // Check if redo is available
+    bool canRedo() const {
+        return currentHistoryIndex < historyStack.size();
+    }
+    
+    // Thumbnail texture of a history state, created from whichever copy of the state is at hand.
+    // States only held as region patches get their thumbnail once they are visited
+    GLuint historyThumbnailTexture(size_t state) {
+        if (historyThumbnails.size() < historyStack.size() + 1) {
+            historyThumbnails.resize(historyStack.size() + 1);
+        }
+        HistoryThumbnail& thumbnail = historyThumbnails[state];
+        if (thumbnail.texture != 0) return thumbnail.texture;
+        
+        // Entries before the current state hold the state before their step, the others the state after
+        Mat source;
+        if (state == currentHistoryIndex) {
+            source = workingImage;
+        } else if (state < currentHistoryIndex && historyStack[state].region.area() == 0) {
+            source = historyStack[state].image;
+        } else if (state > currentHistoryIndex && historyStack[state - 1].region.area() == 0) {
+            source = historyStack[state - 1].image;
+        }
+        if (source.empty()) return 0;
+        
+        // Small display copy, 8 bits RGB
+        const int thumbnailWidth = 96;
+        int thumbnailHeight = std::max(1, source.rows * thumbnailWidth / std::max(1, source.cols));
+        Mat small;
+        resize(source, small, Size(thumbnailWidth, thumbnailHeight), 0, 0, INTER_AREA);
+        cvtColor(quantizeTo8U(small), thumbnail.image, COLOR_BGR2RGB);
+        
+        glGenTextures(1, &thumbnail.texture);
+        glBindTexture(GL_TEXTURE_2D, thumbnail.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, thumbnail.image.cols, thumbnail.image.rows, 0, GL_RGB, GL_UNSIGNED_BYTE, thumbnail.image.data);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return thumbnail.texture;
+    }
+    
+    // Stop generating thumbnails and free the atlas. Every thread finishes the thumbnail it
+    // is on before it sees the cancellation, so closing waits for at most one decode each
+    void closeFolder() {
+        if (browserJob) {
+            browserJob->cancelled = true;
+            browserJob.reset();
+        }
+        for (std::thread& thread : browserThreads) {
+            thread.join();
+        }
+        browserThreads.clear();
+        if (!atlasPages.empty()) {
+            glDeleteTextures(static_cast<GLsizei>(atlasPages.size()), atlasPages.data());
+            atlasPages.clear();
+        }
+        browserCells.clear();
+    }
+    
+    // List the images of `folder` and start making their thumbnails, one thread per core.
+    // Cached thumbnails only need a small JPEG decode, so revisited folders fill in at once
+    void openFolder(const string& folder) {
+        std::error_code error;
+        if (!std::filesystem::is_directory(folder, error)) {
+            cout << "Not a folder: " << folder << endl;
+            return;
+        }
+        closeFolder();
+        
+        auto job = make_shared<BrowserJob>();
+        for (const auto& entry : std::filesystem::directory_iterator(folder, error)) {
+            string extension = entry.path().extension().string();
+            transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+            if (extension == ".jpg" || extension == ".jpeg" || extension == ".png" || extension == ".bmp" ||
+                extension == ".tif" || extension == ".tiff" || extension == ".webp") {
+                job->paths.push_back(entry.path().string());
+            }
+        }
+        std::sort(job->paths.begin(), job->paths.end());
+        job->started = std::chrono::steady_clock::now();
+        browserJob = job;
+        browserCells.assign(job->paths.size(), BrowserCell());
+        
+        unsigned threads = std::max(2u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < threads; i++) {
+            browserThreads.emplace_back([job]() {
+                ThumbnailCache cache;
+                int index;
+                while (!job->cancelled && (index = job->next++) < static_cast<int>(job->paths.size())) {
+                    bool cacheHit = false;
+                    Mat thumbnail = cache.thumbnail(job->paths[index], &cacheHit);
+                    if (!thumbnail.empty()) {
+                        cvtColor(thumbnail, thumbnail, COLOR_BGR2RGB);
+                    }
+                    if (cacheHit) job->cacheHits++;
+                    
+                    bool wake;
+                    {
+                        std::lock_guard<std::mutex> guard(job->lock);
+                        wake = job->finished.empty();  // The main loop is woken once per batch
+                        job->finished.push_back({index, thumbnail});
+                    }
+                    job->done++;
+                    if (wake) glfwPostEmptyEvent();
+                }
+            });
+        }
+    }
+    
+    // Pack the thumbnails finished since the last call into the atlas, called once per loop
+    // iteration. Returns whether anything changed on screen
+    bool pollFolderBrowser() {
+        if (!browserJob) return false;
+        vector<pair<int, Mat>> finished;
+        {
+            std::lock_guard<std::mutex> guard(browserJob->lock);
+            finished.swap(browserJob->finished);
+        }
+        
+        for (auto& [index, thumbnail] : finished) {
+            BrowserCell& cell = browserCells[index];
+            if (thumbnail.empty()) {
+                cell.page = -2;
+                continue;
+            }
+            
+            // Cells are assigned by index, so a page is allocated when its first thumbnail arrives
+            cell.page = index / atlasCellsPerPage;
+            cell.size = thumbnail.size();
+            while (static_cast<int>(atlasPages.size()) <= cell.page) {
+                GLuint page;
+                glGenTextures(1, &page);
+                glBindTexture(GL_TEXTURE_2D, page);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, atlasPageSize, atlasPageSize, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+                atlasPages.push_back(page);
+            }
+            
+            int slot = index % atlasCellsPerPage;
+            Mat pixels = thumbnail.isContinuous() ? thumbnail : thumbnail.clone();
+            glBindTexture(GL_TEXTURE_2D, atlasPages[cell.page]);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % atlasCellsPerRow) * ThumbnailCache::thumbnailSize,
+                            (slot / atlasCellsPerRow) * ThumbnailCache::thumbnailSize, pixels.cols, pixels.rows,
+                            GL_RGB, GL_UNSIGNED_BYTE, pixels.data);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        
+        int total = static_cast<int>(browserJob->paths.size());
+        if (!browserJob->reported && browserJob->done == total) {
+            browserJob->reported = true;
+            double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - browserJob->started).count();
+            cout << "Thumbnails for " << total << " images in " << static_cast<int>(elapsedMs) << " ms ("
+                 << browserJob->cacheHits << " from the cache)." << endl;
+        }
+        return !finished.empty();
+    }
+    
+    // Folder browser window: a grid of thumbnails, clicking one opens the image
+    void drawFolderBrowser() {
+        ImGui::Begin("Folder Browser", &showFolderBrowser);
+        ImGui::InputText("Folder", browserFolder, sizeof(browserFolder));
+        ImGui::SameLine();
+        if (ImGui::Button("Browse...")) {
+            string folder = ::openFolderDialog();
+            if (!folder.empty()) {
+                snprintf(browserFolder, sizeof(browserFolder), "%s", folder.c_str());
+                openFolder(folder);
+            }
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Open")) {
+            openFolder(browserFolder);
+        }
+        
+        if (!browserJob) {
+            ImGui::Text("No folder open");
+            ImGui::End();
+            return;
+        }
+        int total = static_cast<int>(browserJob->paths.size());
+        ImGui::Text("%d of %d thumbnails, %d from the cache", browserJob->done.load(), total, browserJob->cacheHits.load());
+        
+        // Only the rows in view are submitted, so folders of thousands of images stay cheap to draw
+        ImGui::BeginChild("Thumbnails");
+        float cellSize = static_cast<float>(ThumbnailCache::thumbnailSize);
+        float spacing = ImGui::GetStyle().ItemSpacing.x;
+        int columns = std::max(1, static_cast<int>((ImGui::GetContentRegionAvail().x + spacing) / (cellSize + spacing)));
+        int rows = (total + columns - 1) / columns;
+        
+        ImGuiListClipper clipper;
+        clipper.Begin(rows, cellSize + ImGui::GetStyle().ItemSpacing.y);
+        while (clipper.Step()) {
+            for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+                for (int column = 0; column < columns && row * columns + column < total; column++) {
+                    int index = row * columns + column;
+                    if (column > 0) ImGui::SameLine();
+                    
+                    ImGui::PushID(index);
+                    ImGui::InvisibleButton("cell", ImVec2(cellSize, cellSize));
+                    ImVec2 cellMin = ImGui::GetItemRectMin();
+                    ImDrawList* drawList = ImGui::GetWindowDrawList();
+                    const BrowserCell& cell = browserCells[index];
+                    if (cell.page >= 0) {
+                        // Centre the thumbnail in its cell
+                        int slot = index % atlasCellsPerPage;
+                        ImVec2 uv0((slot % atlasCellsPerRow) * cellSize / atlasPageSize, (slot / atlasCellsPerRow) * cellSize / atlasPageSize);
+                        ImVec2 uv1(uv0.x + static_cast<float>(cell.size.width) / atlasPageSize, uv0.y + static_cast<float>(cell.size.height) / atlasPageSize);
+                        ImVec2 imageMin(cellMin.x + (cellSize - cell.size.width) * 0.5f, cellMin.y + (cellSize - cell.size.height) * 0.5f);
+                        drawList->AddImage(reinterpret_cast<ImTextureID>(static_cast<unsigned long long>(atlasPages[cell.page])), imageMin,
+                                           ImVec2(imageMin.x + cell.size.width, imageMin.y + cell.size.height), uv0, uv1);
+                    } else {
+                        // Pending, or not an image OpenCV can decode
+                        drawList->AddRect(cellMin, ImVec2(cellMin.x + cellSize, cellMin.y + cellSize),
+                                          cell.page == -1 ? IM_COL32(120, 120, 120, 255) : IM_COL32(160, 60, 60, 255));
+                    }
+                    
+                    const string& path = browserJob->paths[index];
+                    if (ImGui::IsItemHovered()) {
+                        ImGui::SetTooltip("%s", std::filesystem::path(path).filename().string().c_str());
+                    }
+                    if (ImGui::IsItemClicked()) {
+                        startBackgroundLoad(path);
+                    }
+                    ImGui::PopID();
+                }
+            }
+        }
+        ImGui::EndChild();
+        ImGui::End();
+    }
+    
+    // Start loading an image in the background; an empty path asks for one with the file dialog
+    void startBackgroundLoad(const string& path) {
+        if (backgroundLoad) {
+            cout << "An image is still loading." << endl;
+            return;
+        }
+        
+        // The previous load has delivered its result; at most its preview decode is still running
+        joinLoader();
+        
+        auto load = make_shared<BackgroundLoad>();
+        load->path = path;
+        load->askForPath = path.empty();
+        load->started = std::chrono::steady_clock::now();
+        backgroundLoad = load;
+        
+        // The very first image counts from program start, so the reported time covers startup
+        loadStarted = firstFrameShown ? load->started : startTime;
+        timeToFirstPixelMs = -1.0;
+        timeToFullImageMs = -1.0;
+        
+        loaderThread = std::thread([load]() {
+            if (load->askForPath) {
+                load->path = ::openFileDialog();
+                if (load->path.empty()) {
+                    load->failed = true;
+                    glfwPostEmptyEvent();
+                    return;
+                }
+            }
+            
+            // The full decode gets its own thread so the preview does not hold it up
+            std::thread fullDecode([load]() {
+                load->full = imread(load->path, IMREAD_ANYDEPTH | IMREAD_COLOR);
+                if (load->full.empty()) {
+                    load->failed = true;
+                } else {
+                    load->fullReady = true;
+                }
+                glfwPostEmptyEvent();  // Wake the idle main loop
+            });
+            
+            int previewMode = previewReadMode(load->path);
+            if (previewMode != 0) {
+                load->preview = imread(load->path, previewMode);
+                if (!load->preview.empty()) {
+                    load->previewReady = true;
+                    glfwPostEmptyEvent();
+                }
+            }
+            fullDecode.join();
+        });
+    }
+    
+    // Wait for the loader thread, which also waits for its full decode
+    void joinLoader() {
+        if (loaderThread.joinable()) {
+            loaderThread.join();
+        }
+    }
+    
+    // Pick up the results of the background load, called once per loop iteration.
+    // Returns whether anything changed on screen
+    bool pollBackgroundLoad() {
+        if (!backgroundLoad) return false;
+        shared_ptr<BackgroundLoad> load = backgroundLoad;
+        double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStarted).count();
+        
+        if (load->fullReady) {
+            setLoadedImage(load->path, load->full);
+            timeToFullImageMs = elapsedMs;
+            cout << "Loaded " << load->path << " in " << static_cast<int>(elapsedMs) << " ms." << endl;
+            if (!load->previewShown) {
+                firstPixelPending = true;
+            }
+            backgroundLoad.reset();
+        } else if (load->failed) {
+            // An empty path means the file dialog was cancelled
+            if (!load->path.empty()) {
+                cerr << "Error: Could not open or find the image: " << load->path << endl;
+            }
+            backgroundLoad.reset();
+        } else if (load->previewReady && !load->previewShown) {
+            // The previous image makes way as soon as the new one can be shown.
+            // Operations stay unavailable until the full image has arrived
+            workingImage.release();
+            originalImage.release();
+            clearHistory();
+            recordedOps.clear();
+            regionActive = false;
+            cropMode = false;
+            imagePath = load->path;
+            imageWidth = load->preview.cols;
+            imageHeight = load->preview.rows;
+            uploadTexture(load->preview);
+            load->previewShown = true;
+            firstPixelPending = true;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    
+    // Report startup and time-to-first-pixel; called after a frame has been presented
+    void reportFrameTiming() {
+        if (!firstFrameShown) {
+            firstFrameShown = true;
+            double windowMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+            cout << "Window ready after " << static_cast<int>(windowMs) << " ms." << endl;
+        }
+        if (firstPixelPending) {
+            firstPixelPending = false;
+            timeToFirstPixelMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStarted).count();
+            cout << "Time to first pixel: " << static_cast<int>(timeToFirstPixelMs) << " ms"
+                 << (workingImage.empty() ? " (reduced preview)." : ".") << endl;
+        }
+    }
+    
+    void updateTexture() {
+        if (workingImage.empty()) return;
+        uploadTexture(workingImage);
+    }
+    
+    // Derived planes of `image`: the shared ones when it is the working image
+    DerivedPlanes& planesFor(const Mat& image) {
+        DerivedPlanes& planes = image.data == workingImage.data ? derivedPlanes : scratchPlanes;
+        if (!planes.belongsTo(image)) {
+            planes.reset(image);
+        }
+        return planes;
+    }
+    
+    // Called whenever the working image's pixels change
+    void invalidateDerivedPlanes() {
+        derivedPlanes.reset();
+        scratchPlanes.reset();
+        previewKey.clear();
+    }
+    
+    // Re-render the live preview when the panel's parameters changed since the last one.
+    // Only the cheap final pass runs again; grayscale and gradients come from the planes
+    void updateLivePreview() {
+        if (!livePreview || workingImage.empty()) return;
+        
+        vector<float> key = {static_cast<float>(activeOperation)};
+        if (activeOperation == THRESHOLD) {
+            key.insert(key.end(), {static_cast<float>(params.thresholdMethod), static_cast<float>(params.thresholdValue),
+                                   static_cast<float>(params.thresholdMaxValue), static_cast<float>(params.adaptiveBlockSize),
+                                   static_cast<float>(params.adaptiveC), static_cast<float>(params.adaptiveMethod),
+                                   params.sauvolaK, params.niblackK});
+        } else if (activeOperation == CURVES_LEVELS) {
+            key.insert(key.end(), {params.levelsBlack, params.levelsWhite, params.levelsGamma});
+            for (int c = 0; c < 4; c++) {
+                key.push_back(static_cast<float>(params.curvePointCount[c]));
+                key.insert(key.end(), &params.curvePoints[c][0][0], &params.curvePoints[c][0][0] + 2 * params.curvePointCount[c]);
+            }
+        } else if (activeOperation == SMOOTH) {
+            key.insert(key.end(), {static_cast<float>(params.smoothRadius), params.smoothEdgeThreshold,
+                                   static_cast<float>(displayedImageSize.width), static_cast<float>(displayedImageSize.height)});
+        } else if (activeOperation == EQUALIZE) {
+            key.insert(key.end(), {static_cast<float>(params.equalizeMethod), static_cast<float>(params.claheTiles), params.claheClipLimit,
+                                   static_cast<float>(displayedImageSize.width), static_cast<float>(displayedImageSize.height)});
+        } else if (activeOperation == EDGE_DETECTION) {
+            key.insert(key.end(), {static_cast<float>(params.edgeDetectionMethod), static_cast<float>(params.sobelKernelSize),
+                                   static_cast<float>(params.cannyThreshold1), static_cast<float>(params.cannyThreshold2),
+                                   static_cast<float>(params.overlayEdges), params.edgeColor[0], params.edgeColor[1],
+                                   params.edgeColor[2], params.edgeOpacity});
+        } else {
+            return;
+        }
+        if (key == previewKey) return;
+        previewKey = key;
+        
+        Mat preview;
+        if (activeOperation == THRESHOLD) {
+            thresholdImage(workingImage, preview);
+        } else if (activeOperation == CURVES_LEVELS) {
+            // The display is 8-bit, so an 8-bit table on the quantised image is enough
+            const Mat& display = planesFor(workingImage).color8();
+            TileScheduler::instance().runTiles(display, preview, {toneTableOp(toneTable(params, CV_8U, display.channels()))});
+        } else if (activeOperation == SMOOTH) {
+            // Smooth only the pixels that reach the screen, with the radius scaled to match
+            Size size = displayedImageSize.area() > 0 ? displayedImageSize : workingImage.size();
+            const Mat& display = planesFor(workingImage).display8(size);
+            double scale = static_cast<double>(display.cols) / workingImage.cols;
+            int radius = std::max(1, cvRound(params.smoothRadius * scale));
+            guidedSmooth(display, preview, radius, params.smoothEdgeThreshold);
+        } else if (activeOperation == EQUALIZE) {
+            // The blocks are a fraction of the image, so the proxy at display size looks the same
+            Size size = displayedImageSize.area() > 0 ? displayedImageSize : workingImage.size();
+            equalizeImage(planesFor(workingImage).display8(size), preview, params.equalizeMethod == 1 ? params.claheTiles : 0,
+                          params.claheClipLimit);
+        } else {
+            edgeImage(workingImage, preview);
+        }
+        writeTexture(previewTexture, preview);
+        framesToRender = std::max(framesToRender, 3);
+    }
+    
+    bool isShowingLivePreview() const {
+        return livePreview && !previewKey.empty() && previewTexture != 0 &&
+               (activeOperation == THRESHOLD || activeOperation == EDGE_DETECTION || activeOperation == CURVES_LEVELS ||
+                activeOperation == SMOOTH || activeOperation == EQUALIZE);
+    }
+    
+    // Upload an image to the display texture
+    void uploadTexture(const Mat& image) {
+        imageVersion++;
+        framesToRender = std::max(framesToRender, 3);
+        invalidateDerivedPlanes();
+        writeTexture(imageTexture, image);
+    }
+    
+    // Upload a BGR image to `texture`, creating it on first use
+    void writeTexture(GLuint& texture, const Mat& image) {
+        // Headless use (the test suite) has no GL context to upload to
+        if (!glfwGetCurrentContext()) return;
+        
+        // Convert OpenCV Mat to OpenGL texture
+        if (texture == 0) {
+            glGenTextures(1, &texture);
+        }
+        
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        
+        // OpenCV uses BGR format, we need to convert to RGB for OpenGL.
+        // High-bit-depth images are quantised to 8 bits for display only
+        Mat rgbImage;
+        cvtColor(quantizeTo8U(image), rgbImage, COLOR_BGR2RGB);
+        
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, rgbImage.cols, rgbImage.rows, 0, GL_RGB, GL_UNSIGNED_BYTE, rgbImage.data);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    
+    // Affine transform that rotates and scales an image of `size` about its centre. The
+    // output keeps the image size, or grows to fit the rotated corners when expanding the canvas
+    static Mat rotationTransform(Size size, const EditParams& p, Size& outputSize) {
+        Point2f center(size.width / 2.0f, size.height / 2.0f);
+        double scale = p.rotationScale / 100.0;
+        Mat rotMat = getRotationMatrix2D(center, p.rotationAngle, scale);
+        outputSize = size;
+        
+        if (p.rotationExpandCanvas) {
+            double radians = p.rotationAngle * CV_PI / 180.0;
+            double cosine = std::abs(std::cos(radians)) * scale;
+            double sine = std::abs(std::sin(radians)) * scale;
+            outputSize = Size(cvRound(size.width * cosine + size.height * sine),
+                              cvRound(size.width * sine + size.height * cosine));
+            rotMat.at<double>(0, 2) += outputSize.width / 2.0 - center.x;
+            rotMat.at<double>(1, 2) += outputSize.height / 2.0 - center.y;
+        }
+        return rotMat;
+    }
+    
+    // Rotate and scale an image about its centre in a single resample. A non-empty `crop`,
+    // given in the rotated image's coordinates, is folded into the same warp
+    void rotateImage(const Mat& image, Mat& result, const EditParams& p, const Rect& crop = Rect()) {
+        Size outputSize;
+        Mat rotMat = rotationTransform(image.size(), p, outputSize);
+        if (crop.area() > 0) {
+            rotMat.at<double>(0, 2) -= crop.x;
+            rotMat.at<double>(1, 2) -= crop.y;
+            outputSize = crop.size();
+        }
+        
+        applyAtWorkingPrecision(image, result, [&rotMat, outputSize](const Mat& source, Mat& rotated) {
+            warpAffine(source, rotated, rotMat, outputSize, INTER_CUBIC);
+        });
+    }
+    
+    // Tile operation for brightness and contrast; brightness is given on the 8-bit scale
+    static TileScheduler::TileOp brightnessContrastOp(double alpha, double beta) {
+        return {0, [alpha, beta](const Mat& in, Mat& out, const TileScheduler::TileContext&) {
+            in.convertTo(out, -1, alpha, beta * whiteLevel(in.depth()) / 255.0);
+        }};
+    }
+    
+    // Monotone cubic through a curve's control points (Fritsch-Carlson tangents), so the
+    // curve never overshoots between points and stays monotonic where the points are.
+    // Inputs outside the first and last point hold the end values
+    class ToneCurve {
+    public:
+        ToneCurve(const float (*points)[2], int count) : xs(count), ys(count), tangents(count, 0.0f) {
+            for (int i = 0; i < count; i++) {
+                xs[i] = points[i][0];
+                ys[i] = points[i][1];
+            }
+            
+            vector<float> slopes(std::max(count - 1, 0));
+            for (int i = 0; i + 1 < count; i++) {
+                float width = xs[i + 1] - xs[i];
+                slopes[i] = width > 0.0f ? (ys[i + 1] - ys[i]) / width : 0.0f;
+            }
+            if (count < 2) return;
+            tangents[0] = slopes[0];
+            tangents[count - 1] = slopes[count - 2];
+            for (int i = 1; i + 1 < count; i++) {
+                // Flat at local extrema, weighted harmonic mean of the neighbouring slopes elsewhere
+                if (slopes[i - 1] * slopes[i] <= 0.0f) continue;
+                float left = xs[i] - xs[i - 1];
+                float right = xs[i + 1] - xs[i];
+                tangents[i] = 3.0f * (left + right) / ((2.0f * right + left) / slopes[i - 1] + (right + 2.0f * left) / slopes[i]);
+            }
+        }
+        
+        float operator()(float x) const {
+            if (xs.empty()) return x;
+            if (x <= xs.front()) return ys.front();
+            if (x >= xs.back()) return ys.back();
+            
+            size_t i = 0;
+            while (x > xs[i + 1]) i++;
+            float width = xs[i + 1] - xs[i];
+            if (width <= 0.0f) return ys[i + 1];
+            float t = (x - xs[i]) / width;
+            float t2 = t * t;
+            float t3 = t2 * t;
+            return (2 * t3 - 3 * t2 + 1) * ys[i] + (t3 - 2 * t2 + t) * width * tangents[i] +
+                   (-2 * t3 + 3 * t2) * ys[i + 1] + (t3 - t2) * width * tangents[i + 1];
+        }
+    
+    private:
+        vector<float> xs, ys, tangents;
+    };
+    
+    // Compile levels and curves into one lookup table per channel: 256 entries for 8-bit
+    // images, 65536 for 16-bit and float ones. Each entry runs levels, then the master
+    // curve, then the channel's own curve. The table has the depth and channel count of
+    // the image; single-channel images only get levels and the master curve
+    static Mat toneTable(const EditParams& p, int depth, int channels) {
+        int entries = depth == CV_8U ? 256 : 65536;
+        double white = whiteLevel(depth);
+        Mat table(1, entries, CV_MAKETYPE(depth, channels));
+        
+        vector<ToneCurve> curves;
+        for (int c = 0; c < 4; c++) {
+            curves.emplace_back(p.curvePoints[c], p.curvePointCount[c]);
+        }
+        float blackPoint = p.levelsBlack / 255.0f;
+        float range = std::max(p.levelsWhite - p.levelsBlack, 1.0f) / 255.0f;
+        float inverseGamma = 1.0f / std::max(p.levelsGamma, 0.01f);
+        
+        for (int i = 0; i < entries; i++) {
+            float value = static_cast<float>(i) / (entries - 1);
+            value = std::min(std::max((value - blackPoint) / range, 0.0f), 1.0f);
+            value = curves[0](std::pow(value, inverseGamma));
+            for (int c = 0; c < channels; c++) {
+                // BGR storage: blue uses curve 3, green 2, red 1
+                float mapped = std::min(std::max(channels == 3 ? curves[3 - c](value) : value, 0.0f), 1.0f);
+                switch (depth) {
+                    case CV_8U: table.ptr<uchar>()[i * channels + c] = saturate_cast<uchar>(mapped * white); break;
+                    case CV_16U: table.ptr<ushort>()[i * channels + c] = saturate_cast<ushort>(mapped * white); break;
+                    default: table.ptr<float>()[i * channels + c] = mapped; break;
+                }
+            }
+        }
+        return table;
+    }
+    
+    // Map every sample through a 65536-entry table; float samples are clamped to 0..1 and
+    // rounded to the nearest entry
+    template <typename T>
+    static void lookupToneTable(const Mat& in, Mat& out, const Mat& table) {
+        out.create(in.size(), in.type());
+        const T* entries = table.ptr<T>();
+        int channels = in.channels();
+        float indexScale = static_cast<float>(table.cols - 1);
+        for (int y = 0; y < in.rows; y++) {
+            const T* src = in.ptr<T>(y);
+            T* dst = out.ptr<T>(y);
+            for (int x = 0; x < in.cols; x++) {
+                for (int c = 0; c < channels; c++) {
+                    float sample = static_cast<float>(src[x * channels + c]);
+                    int index = std::is_floating_point<T>::value
+                        ? cvRound(std::min(std::max(sample, 0.0f), 1.0f) * indexScale)
+                        : static_cast<int>(sample);
+                    dst[x * channels + c] = entries[index * channels + c];
+                }
+            }
+        }
+    }
+    
+    // Tile operation applying a table from `toneTable`; 8-bit images use OpenCV's vectorised LUT
+    static TileScheduler::TileOp toneTableOp(const Mat& table) {
+        return {0, [table](const Mat& in, Mat& out, const TileScheduler::TileContext&) {
+            switch (in.depth()) {
+                case CV_8U: LUT(in, table, out); break;
+                case CV_16U: lookupToneTable<ushort>(in, out, table); break;
+                default: lookupToneTable<float>(in, out, table); break;
+            }
+        }};
+    }
+    
+    // Whether levels and every curve leave all values unchanged. Points on the diagonal are
+    // not enough: a curve is flat beyond its end points, so they must sit at 0 and 1
+    static bool isIdentityToneCurve(const EditParams& p) {
+        if (p.levelsBlack != 0.0f || p.levelsWhite != 255.0f || p.levelsGamma != 1.0f) return false;
+        for (int c = 0; c < 4; c++) {
+            int last = p.curvePointCount[c] - 1;
+            if (last < 1 || p.curvePoints[c][0][0] != 0.0f || p.curvePoints[c][last][0] != 1.0f) return false;
+            for (int i = 0; i <= last; i++) {
+                if (p.curvePoints[c][i][0] != p.curvePoints[c][i][1]) return false;
+            }
+        }
+        return true;
+    }
+    
+    // Tile operation for a Gaussian blur; a sigma of 0 derives it from the kernel size
+    static TileScheduler::TileOp gaussianBlurOp(int kernelSize, double sigma) {
+        return {kernelSize / 2, [kernelSize, sigma](const Mat& in, Mat& out, const TileScheduler::TileContext&) {
+            GaussianBlur(in, out, Size(kernelSize, kernelSize), sigma);
+        }};
+    }
+    
+    // Apply all current transformations to the image
+    void applyTransformations(Mat& image) {
+        if (image.empty()) return;  // Skip if image is empty
+        
+        // Apply brightness and contrast
+        double alpha = params.contrast / 100.0;
+        int beta = static_cast<int>(params.brightness);
+        vector<TileScheduler::TileOp> chain;
+        chain.push_back(brightnessContrastOp(alpha, beta));
+        
+        // Apply blur if greater than 0, chained on the same tiles as brightness/contrast
+        if (params.blurSize > 0.0f) {
+            int blurSize = static_cast<int>(params.blurSize) * 2 + 1;
+            chain.push_back(gaussianBlurOp(blurSize, 0));
+        }
+        
+        TileScheduler::instance().runTiles(image, image, chain);
+    }
+    
+    // Record the slider transformations. They re-render from the original image, so they
+    // replace whatever was recorded before
+    void recordTransformations() {
+        recordedOps.clear();
+        
+        RecordedOp adjust = {OP_BRIGHTNESS_CONTRAST, params, Rect()};
+        adjust.params.brightness = static_cast<int>(params.brightness);
+        recordedOps.push_back(adjust);
+        
+        if (params.blurSize > 0.0f) {
+            RecordedOp blur = {OP_BLUR, params, Rect()};
+            blur.params.useDirectionalBlur = false;
+            blur.params.gaussianBlurRadius = static_cast<int>(params.blurSize);
+            blur.params.blurSigma = 0.0f;
+            recordedOps.push_back(blur);
+        }
+    }
+    
+    // Output size of a resize of an image of `size`: a percentage, or the longest side in pixels
+    static Size resizeTarget(Size size, const EditParams& p) {
+        double scale = p.resizeMode == 0 ? p.resizeRatio / 100.0
+                                         : static_cast<double>(p.resizeLongestSide) / std::max(size.width, size.height);
+        return Size(std::max(1, cvRound(size.width * scale)), std::max(1, cvRound(size.height * scale)));
+    }
+    
+    // Resampling weights of one axis: every output position reads `taps` consecutive source
+    // positions from its `start`, so the inner loops never test for the image border
+    // (weights falling outside the image are folded onto the edge pixels)
+    struct ResampleTable {
+        int taps = 0;
+        vector<int> start;
+        vector<float> weights;  // `taps` weights per output position, summing to 1
+    };
+    
+    // Filter kernels of the resize operation, on the source grid scaled to the output
+    static double resampleKernel(int filter, double x, double scale) {
+        x = std::abs(x);
+        switch (filter) {
+            case 0: {
+                // Area: overlap of the source pixel with the output pixel's footprint
+                double overlap = std::min(x + 0.5, scale / 2.0) - std::max(x - 0.5, -scale / 2.0);
+                return std::max(overlap, 0.0);
+            }
+            case 1: {
+                // Lanczos3: windowed sinc
+                x /= scale;
+                if (x < 1e-8) return 1.0;
+                if (x >= 3.0) return 0.0;
+                double px = CV_PI * x;
+                return 3.0 * std::sin(px) * std::sin(px / 3.0) / (px * px);
+            }
+            default: {
+                // Mitchell-Netravali cubic with B = C = 1/3
+                x /= scale;
+                const double b = 1.0 / 3.0, c = 1.0 / 3.0;
+                if (x < 1.0) {
+                    return ((12 - 9 * b - 6 * c) * x * x * x + (-18 + 12 * b + 6 * c) * x * x + (6 - 2 * b)) / 6.0;
+                }
+                if (x < 2.0) {
+                    return ((-b - 6 * c) * x * x * x + (6 * b + 30 * c) * x * x + (-12 * b - 48 * c) * x + (8 * b + 24 * c)) / 6.0;
+                }
+                return 0.0;
+            }
+        }
+    }
+    
+    static ResampleTable resampleTable(int srcLength, int dstLength, int filter) {
+        double scale = static_cast<double>(srcLength) / dstLength;
+        double filterScale = std::max(scale, 1.0);  // Downscaling widens the kernel to the output pixel
+        double radius = filter == 0 ? filterScale / 2.0 + 0.5 : (filter == 1 ? 3.0 : 2.0) * filterScale;
+        int span = 2 * static_cast<int>(std::ceil(radius)) + 1;
+        
+        ResampleTable table;
+        table.taps = std::min(span, srcLength);
+        table.start.resize(dstLength);
+        table.weights.assign(static_cast<size_t>(dstLength) * table.taps, 0.0f);
+        vector<double> folded(table.taps);
+        for (int o = 0; o < dstLength; o++) {
+            double center = (o + 0.5) * scale - 0.5;
+            int first = static_cast<int>(std::floor(center - radius)) + 1;
+            int start = std::min(std::max(first, 0), srcLength - table.taps);
+            std::fill(folded.begin(), folded.end(), 0.0);
+            double total = 0.0;
+            for (int j = 0; j < span; j++) {
+                int i = first + j;
+                double w = resampleKernel(filter, i - center, filterScale);
+                if (w == 0.0) continue;
+                int clamped = std::min(std::max(i, 0), srcLength - 1);
+                folded[clamped - start] += w;
+                total += w;
+            }
+            table.start[o] = start;
+            for (int k = 0; k < table.taps; k++) {
+                table.weights[static_cast<size_t>(o) * table.taps + k] = static_cast<float>(total != 0.0 ? folded[k] / total : 0.0);
+            }
+        }
+        return table;
+    }
+    
+    // Halve an image with a 2x2 box filter; an odd last row or column is dropped
+    template <typename T>
+    static Mat halveImage(const Mat& src) {
+        Mat dst(src.rows / 2, src.cols / 2, src.type());
+        int channels = src.channels();
+        TileScheduler::instance().parallelRows(dst.rows, [&](int begin, int end) {
+            for (int y = begin; y < end; y++) {
+                const T* top = src.ptr<T>(2 * y);
+                const T* bottom = src.ptr<T>(2 * y + 1);
+                T* out = dst.ptr<T>(y);
+                for (int x = 0; x < dst.cols; x++) {
+                    for (int c = 0; c < channels; c++) {
+                        int i = 2 * x * channels + c;
+                        float sum = static_cast<float>(top[i]) + top[i + channels] + bottom[i] + bottom[i + channels];
+                        out[x * channels + c] = saturate_cast<T>(sum * 0.25f);
+                    }
+                }
+            }
+        });
+        return dst;
+    }
+    
+    // Separable resample: a horizontal pass over every source row into a float buffer, then a
+    // vertical pass accumulating whole buffer rows per output row. Both passes run on parallel
+    // row strips, and the vertical one is a plain multiply-add over contiguous floats
+    template <typename T>
+    static void resampleSeparable(const Mat& src, Mat& dst, Size size, int filter) {
+        ResampleTable columns = resampleTable(src.cols, size.width, filter);
+        ResampleTable rows = resampleTable(src.rows, size.height, filter);
+        int channels = src.channels();
+        int rowLength = size.width * channels;
+        
+        Mat horizontal(src.rows, rowLength, CV_32F);
+        TileScheduler::instance().parallelRows(src.rows, [&](int begin, int end) {
+            for (int y = begin; y < end; y++) {
+                const T* in = src.ptr<T>(y);
+                float* out = horizontal.ptr<float>(y);
+                for (int x = 0; x < size.width; x++) {
+                    const float* w = &columns.weights[static_cast<size_t>(x) * columns.taps];
+                    const T* pixel = in + columns.start[x] * channels;
+                    for (int c = 0; c < channels; c++) {
+                        float sum = 0.0f;
+                        for (int k = 0; k < columns.taps; k++) {
+                            sum += w[k] * pixel[k * channels + c];
+                        }
+                        out[x * channels + c] = sum;
+                    }
+                }
+            }
+        });
+        
+        Mat output(size, src.type());
+        TileScheduler::instance().parallelRows(size.height, [&](int begin, int end) {
+            vector<float> sum(rowLength);
+            for (int y = begin; y < end; y++) {
+                std::fill(sum.begin(), sum.end(), 0.0f);
+                const float* w = &rows.weights[static_cast<size_t>(y) * rows.taps];
+                for (int k = 0; k < rows.taps; k++) {
+                    const float* in = horizontal.ptr<float>(rows.start[y] + k);
+                    float weight = w[k];
+                    for (int i = 0; i < rowLength; i++) {
+                        sum[i] += weight * in[i];
+                    }
+                }
+                T* out = output.ptr<T>(y);
+                for (int i = 0; i < rowLength; i++) {
+                    out[i] = saturate_cast<T>(sum[i]);
+                }
+            }
+        });
+        dst = output;
+    }
+    
+    // Resize with the area (0), Lanczos3 (1) or Mitchell (2) filter. Large reductions first
+    // halve the image with a box pyramid until less than 4x remains, so the final filter's
+    // kernel, and with it the cost, stays bounded by the output size
+    static void resizeImage(const Mat& src, Mat& dst, Size size, int filter) {
+        Mat current = src;
+        while (current.cols >= 4 * size.width && current.rows >= 4 * size.height) {
+            switch (current.depth()) {
+                case CV_8U: current = halveImage<uchar>(current); break;
+                case CV_16U: current = halveImage<ushort>(current); break;
+                default: current = halveImage<float>(current); break;
+            }
+        }
+        
+        switch (current.depth()) {
+            case CV_8U: resampleSeparable<uchar>(current, dst, size, filter); break;
+            case CV_16U: resampleSeparable<ushort>(current, dst, size, filter); break;
+            default: resampleSeparable<float>(current, dst, size, filter); break;
+        }
+    }
+    
+    // Resize the whole image; a selected region is dropped since its coordinates no longer apply
+    void applyResize() {
+        if (workingImage.empty()) {
+            cout << "No image loaded yet." << endl;
+            return;
+        }
+        
+        Size size = resizeTarget(workingImage.size(), params);
+        if (size == workingImage.size()) {
+            cout << "The image already has that size." << endl;
+            return;
+        }
+        
+        int filter = params.resizeFilter;
+        Mat resized;
+        applyAtWorkingPrecision(workingImage, resized, [size, filter](const Mat& source, Mat& target) {
+            resizeImage(source, target, size, filter);
+        });
+        
+        // Recorded only once the resample has returned, as in runOperation
+        if (!batchMode) {
+            // The working image is replaced, so its buffer moves into history
+            pushHistory({workingImage, Rect(), recordedOps, "Resize"});
+            recordedOps.push_back({OP_RESIZE, params, Rect()});
+        }
+        workingImage = resized;
+        invalidateDerivedPlanes();
+        
+        if (!batchMode) {
+            regionActive = false;
+            cropMode = false;
+            imageWidth = workingImage.cols;
+            imageHeight = workingImage.rows;
+            updateTexture();
+            cout << "Resized to " << workingImage.cols << "x" << workingImage.rows << "." << endl;
+        }
+    }
+    
+    // Slider transformations as standalone operations, used when replaying recorded edits
+    void applyRotation() {
+        runOperation(OP_ROTATE, 0, [this](const Mat& image, Mat& result) {
+            rotateImage(image, result, params);
+        });
+    }
+    
+    // Whether the rotation sliders hold an angle or scale that has not been applied yet.
+    // The display shows it by transforming the image quad, without resampling the image
+    bool isPreviewingRotation() const {
+        return activeOperation == ROTATION && !workingImage.empty() &&
+               (fmod(params.rotationAngle, 360.0f) != 0.0f || params.rotationScale != 100.0f);
+    }
+    
+    void resetRotation() {
+        params.rotationAngle = 0.0f;
+        params.rotationScale = 100.0f;
+    }
+    
+    // Resample the image once for the previewed rotation, together with a pending crop
+    // drawn on the rotated preview
+    void commitRotation() {
+        if (workingImage.empty()) {
+            cout << "No image loaded yet." << endl;
+            return;
+        }
+        if (!isPreviewingRotation()) {
+            cout << "Set a rotation angle or scale first." << endl;
+            return;
+        }
+        
+        Size outputSize;
+        rotationTransform(workingImage.size(), params, outputSize);
+        Rect crop;
+        if (cropMode) {
+            crop = normalizeRect(cropRect) & Rect(Point(), outputSize);
+        }
+        
+        Mat rotated;
+        rotateImage(workingImage, rotated, params, crop);
+        
+        // Add to history once the resample has returned; the working image is replaced,
+        // so its buffer moves into history
+        pushHistory({workingImage, Rect(), recordedOps, "Rotate"});
+        recordedOps.push_back({OP_ROTATE, params, Rect()});
+        if (crop.area() > 0) {
+            recordedOps.push_back({OP_CROP, params, crop});
+        }
+        workingImage = rotated;
+        
+        // The preview is now the image; a crop or region drawn on the old one no longer applies
+        resetRotation();
+        cropMode = false;
+        isDragging = false;
+        regionActive = false;
+        imageWidth = workingImage.cols;
+        imageHeight = workingImage.rows;
+        updateTexture();
+        
+        cout << "Rotation applied (" << workingImage.cols << "x" << workingImage.rows << ")." << endl;
+    }
+    
+    void applyBrightnessContrast() {
+        double alpha = params.contrast / 100.0;
+        double beta = params.brightness;
+        runOperation(OP_BRIGHTNESS_CONTRAST, 0, [alpha, beta](const Mat& image, Mat& result) {
+            TileScheduler::instance().runTiles(image, result, {brightnessContrastOp(alpha, beta)});
+        });
+    }
+    
+    // Apply the levels and curves of the Curves/Levels panel. Only the small table is
+    // computed from the parameters; the image is read once through it
+    void applyCurvesLevels() {
+        if (workingImage.empty()) {
+            cout << "No image loaded yet." << endl;
+            return;
+        }
+        
+        EditParams p = params;
+        runOperation(OP_CURVES_LEVELS, 0, [this, &p](const Mat& image, Mat& result) {
+            applyAtWorkingPrecision(image, result, [&p](const Mat& source, Mat& target) {
+                Mat table = toneTable(p, source.depth(), source.channels());
+                TileScheduler::instance().runTiles(source, target, {toneTableOp(table)});
+            });
+        });
+    }
+    
+    // Put every curve and the levels back to the identity
+    void resetCurvesLevels() {
+        EditParams defaults;
+        std::copy(&defaults.curvePointCount[0], &defaults.curvePointCount[0] + 4, &params.curvePointCount[0]);
+        std::copy(&defaults.curvePoints[0][0][0], &defaults.curvePoints[0][0][0] + 4 * EditParams::maxCurvePoints * 2,
+                  &params.curvePoints[0][0][0]);
+        params.levelsBlack = defaults.levelsBlack;
+        params.levelsWhite = defaults.levelsWhite;
+        params.levelsGamma = defaults.levelsGamma;
+    }
+    
+    // Update the image with current parameters
+    void updateImage() {
+        if (originalImage.empty()) return;  // Skip if no image loaded
+        
+        // Start with original image
+        Mat processedImage = originalImage.clone();
+        
+        // Apply all transformations
+        applyTransformations(processedImage);
+        
+        // Add to history; the working image is replaced, so its buffer moves into history
+        pushHistory({workingImage, Rect(), recordedOps, "Adjust"});
+        
+        // Update the working image
+        workingImage = processedImage;
+        recordTransformations();
+        
+        // Update the texture
+        updateTexture();
+    }
+    
+    // Button handlers
+    // The dialog and the decode run in the background, so the window keeps rendering
+    void openImageDialog() {
+        startBackgroundLoad("");
+    }
+    
+    void openNextImage() {
+        if (queuedPaths.empty()) {
+            cout << "No more images queued." << endl;
+            return;
+        }
+        if (backgroundLoad) {
+            cout << "An image is still loading." << endl;
+            return;
+        }
+        startBackgroundLoad(queuedPaths.front());
+        queuedPaths.pop_front();
+    }
+    
+    void saveImageDialog() {
+        if (workingImage.empty()) {
+            cout << "No image to save." << endl;
+            return;
+        }
+        
+        string path = ::saveFileDialog();
+        if (!path.empty()) {
+            // Ensure the path has a valid extension
+            if (path.find('.') == string::npos) {
+                path += ".png"; // Default to PNG if no extension is provided
+            }
+            
+            bool success = imwrite(path, prepareForExport(workingImage, path));
+            if (success) {
+                cout << "Image saved successfully to " << path << endl;
+            } else {
+                cerr << "Failed to save image to " << path << endl;
+            }
+        }
+    }
+    
+    void resetImage() {
+        if (originalImage.empty()) {
+            cout << "No image loaded yet." << endl;
+            return;
+        }
+        
+        // Add to history; the working image is replaced, so its buffer moves into history
+        pushHistory({workingImage, Rect(), recordedOps, "Reset"});
+        
+        // Reset image to original
+        workingImage = originalImage.clone();
+        
+        // Reset parameters
+        params.brightness = 0.0f;
+        params.contrast = 100.0f;
+        params.blurSize = 0.0f;
+        resetRotation();
+        
+        // Exit crop mode if active
+        cropMode = false;
+        recordedOps.clear();
+        imageWidth = workingImage.cols;
+        imageHeight = workingImage.rows;
+        
+        // Update the texture
+        updateTexture();
+    }
+    
+    void applyGrayscale() {
+        if (workingImage.empty()) {
+            cout << "No image loaded yet." << endl;
+            return;
+        }
+        
+        runOperation(OP_GRAYSCALE, 0, [this](const Mat& image, Mat& result) {
+            applyAtWorkingPrecision(image, result, [](const Mat& source, Mat& target) {
+                Mat gray;
+                cvtColor(source, gray, COLOR_BGR2GRAY);
+                cvtColor(gray, target, COLOR_GRAY2BGR);  // Convert back to 3 channels
+            });
+        });
+    }
+    
+    void applySharpen() {
+        if (workingImage.empty()) {
+            cout << "No image loaded yet." << endl;
+            return;
+        }
+        
+        Mat sharpeningKernel = (Mat_<float>(3, 3) << 0, -1, 0, -1, 5, -1, 0, -1, 0);
+        runOperation(OP_SHARPEN, 1, [sharpeningKernel](const Mat& image, Mat& result) {
+            TileScheduler::instance().runTiles(image, result, {{1,
+                [sharpeningKernel](const Mat& in, Mat& out, const TileScheduler::TileContext&) {
+                    filter2D(in, out, in.depth(), sharpeningKernel);
+                }}});
+        });
+    }
+    
+    void applyInvert() {
+        if (workingImage.empty()) {
+            cout << "No image loaded yet." << endl;
+            return;
+        }
+        
+        runOperation(OP_INVERT, 0, [this](const Mat& image, Mat& result) {
+            if (image.depth() == CV_8U || image.depth() == CV_16U) {
+                bitwise_not(image, result);
+            } else {
+                // Floating point images are normalised to 0..1
+                applyAtWorkingPrecision(image, result, [](const Mat& source, Mat& target) {
+                    subtract(Scalar::all(1.0), source, target);
+                });
+            }
+        });
+    }
+    
+    void applyEdgeDetection() {
+        if (workingImage.empty()) {
+            cout << "No image loaded yet." << endl;
+            return;
+        }
+        
+        // Sobel reads its kernel neighbourhood, Canny its 3x3 gradient aperture
+        int sobelSize = params.sobelKernelSize % 2 == 0 ? params.sobelKernelSize + 1 : params.sobelKernelSize;
+        int radius = params.edgeDetectionMethod == 0 ? sobelSize / 2 : 1;
+        
+        runOperation(OP_EDGE_DETECTION, radius, [this](const Mat& image, Mat& result) {
+            edgeImage(image, result);
+        });
+    }
+    
+    // Detect edges of `image` into a BGR image of the same type. Gradients and grayscale
+    // come from the derived planes, so changing only the overlay or Canny thresholds
+    // does not recompute them
+    void edgeImage(const Mat& image, Mat& result) {
+        DerivedPlanes& planes = planesFor(image);
+        
+        // Apply edge detection based on selected method
+        vector<TileScheduler::TileOp> chain;
+        Mat edges;
+        
+        if (params.edgeDetectionMethod == 0) { // Sobel
+            // Ensure kernel size is odd
+            int kernelSize = params.sobelKernelSize;
+            if (kernelSize % 2 == 0) kernelSize++;
+            edges = planes.magnitude(kernelSize);
+        } else if (params.edgeDetectionMethod == 1) { // Canny
+            // Canny's hysteresis follows edges across the whole frame, so it runs full-frame.
+            // It only accepts 8-bit input; its binary result is scaled back to the working depth
+            Canny(planes.luma8(), edges, params.cannyThreshold1, params.cannyThreshold2);
+            
+            int tileDepth = image.depth() == CV_16F ? CV_32F : image.depth();
+            if (tileDepth != CV_8U) {
+                edges.convertTo(edges, tileDepth, whiteLevel(tileDepth) / 255.0);
+            }
+        }
+        
+        chain.push_back({0, [&edges](const Mat&, Mat& out, const TileScheduler::TileContext& context) {
+            out = edges(context.region);
+        }});
+        
+        // If overlay is enabled, blend the edges with the original image
+        if (params.overlayEdges) {
+            Vec3f edgeColor(params.edgeColor[0], params.edgeColor[1], params.edgeColor[2]);  // BGR
+            float opacity = params.edgeOpacity;
+            
+            chain.push_back({0, [edgeColor, opacity](const Mat& edges, Mat& out, const TileScheduler::TileContext& context) {
+                // Blend the colored edges with the original pixels of this tile
+                overlayEdges(context.source, edges, out, edgeColor, opacity);
+            }});
+        } else {
+            // Just use the edges as the result
+            chain.push_back({0, [](const Mat& edges, Mat& out, const TileScheduler::TileContext&) {
+                cvtColor(edges, out, COLOR_GRAY2BGR);
+            }});
+        }
+        
+        TileScheduler::instance().runTiles(image, result, chain);
+    }
+    
+    // Blend `edges` (one channel) in `color` over `source` of the same depth:
+    // source * (1 - opacity), plus color * opacity where the edge is set. 8-bit colours are
+    // truncated to whole levels, as the colour picker shows them. A grayscale source is
+    // inked with the colour's luma, and an alpha channel is kept
+    static void overlayEdges(const Mat& source, const Mat& edges, Mat& out, Vec3f color, float opacity) {
+        opacity = std::clamp(opacity, 0.0f, 1.0f);
+        float white = static_cast<float>(whiteLevel(source.depth()));
+        float level[3];
+        for (int c = 0; c < 3; c++) {
+            float value = source.channels() == 1 ? 0.114f * color[0] + 0.587f * color[1] + 0.299f * color[2] : color[c];
+            level[c] = std::clamp(value, 0.0f, 1.0f) * white;
+        }
+        
+        if (source.depth() == CV_8U) {
+            int ink[3] = {static_cast<int>(level[0]), static_cast<int>(level[1]), static_cast<int>(level[2])};
+            overlayEdges8U(source, edges, out, ink, cvRound(opacity * 256.0f));
+            return;
+        }
+        
+        PixelKernels::dispatchDepth(source.depth(), [&](auto zero) {
+            PixelKernels::dispatchChannels(source.channels(), [&](auto channels) {
+                using T = decltype(zero);
+                constexpr int CN = decltype(channels)::value;
+                float keep = 1.0f - opacity;
+                float ink[3] = {level[0] * opacity, level[1] * opacity, level[2] * opacity};
+                PixelKernels::combine<T, T, T>(source, edges, out, source.type(), [&](const T* src, const T* edge, T* dst, int pixels) {
+                    for (int i = 0; i < pixels; i++) {
+                        bool on = edge[i] > 0;
+                        dst[CN * i] = PixelKernels::saturate<T>(src[CN * i] * keep + (on ? ink[0] : 0.0f));
+                        if constexpr (CN > 1) {
+                            dst[CN * i + 1] = PixelKernels::saturate<T>(src[CN * i + 1] * keep + (on ? ink[1] : 0.0f));
+                            dst[CN * i + 2] = PixelKernels::saturate<T>(src[CN * i + 2] * keep + (on ? ink[2] : 0.0f));
+                        }
+                        if constexpr (CN == 4) {
+                            dst[CN * i + 3] = src[CN * i + 3];
+                        }
+                    }
+                });
+            });
+        });
+    }
+    
+    // overlayEdges for 8-bit images in integer arithmetic, with `ink` in levels and the
+    // opacity `weight` in 1/256 steps as in blendPixels8U. Three-channel runs are split into
+    // planes with v_load_deinterleave where OpenCV has SIMD
+    static void overlayEdges8U(const Mat& source, const Mat& edges, Mat& out, const int ink[3], int weight) {
+        PixelKernels::dispatchChannels(source.channels(), [&](auto channels) {
+            constexpr int CN = decltype(channels)::value;
+            PixelKernels::combine<uchar, uchar, uchar>(source, edges, out, source.type(), [&](const uchar* src, const uchar* edge, uchar* dst, int pixels) {
+                int i = 0;
+#if CV_SIMD
+                if constexpr (CN == 3) {
+                    v_uint8 zero = vx_setzero_u8(), one = vx_setall_u8(1);
+                    v_uint8 inks[3] = {vx_setall_u8(static_cast<uchar>(ink[0])), vx_setall_u8(static_cast<uchar>(ink[1])),
+                                       vx_setall_u8(static_cast<uchar>(ink[2]))};
+                    v_uint16 keep = vx_setall_u16(static_cast<ushort>(256 - weight));
+                    v_uint16 gain = vx_setall_u16(static_cast<ushort>(weight));
+                    for (; i + CV_SIMD_WIDTH <= pixels; i += CV_SIMD_WIDTH) {
+                        v_uint8 onEdge = v_sub_wrap(zero, v_min(vx_load(edge + i), one));  // All ones on edges
+                        v_uint8 planes[3];
+                        v_load_deinterleave(src + 3 * i, planes[0], planes[1], planes[2]);
+                        for (int c = 0; c < 3; c++) {
+                            v_uint16 levelLow, levelHigh, inkLow, inkHigh;
+                            v_expand(planes[c], levelLow, levelHigh);
+                            v_expand(v_select(onEdge, inks[c], zero), inkLow, inkHigh);
+                            planes[c] = v_pack(mixLevels(levelLow, inkLow, keep, gain), mixLevels(levelHigh, inkHigh, keep, gain));
+                        }
+                        v_store_interleave(dst + 3 * i, planes[0], planes[1], planes[2]);
+                    }
+                    vx_cleanup();
+                }
+#endif
+                for (; i < pixels; i++) {
+                    int on = edge[i] > 0;
+                    for (int c = 0; c < std::min(CN, 3); c++) {
+                        dst[CN * i + c] = static_cast<uchar>(mixLevels(src[CN * i + c], on * ink[c], weight));
+                    }
+                    if constexpr (CN == 4) {
+                        dst[CN * i + 3] = src[CN * i + 3];
+                    }
+                }
+            });
+        });
+    }
+    
+    // Edge-preserving smoothing with the guided filter (He et al.), each channel guiding
+    // itself: over every window of `radius`, a = var / (var + eps) and b = (1 - a) * mean,
+    // and the output is mean(a) * I + mean(b). Flat areas (variance below eps) are averaged,
+    // edges (variance above it) pass through. All window sums are box filters, so the cost
+    // does not grow with the radius.
+    // The coefficients vary slowly, so for large radii they are computed on a copy reduced by
+    // radius / 4 and interpolated back (the "fast guided filter"); only the final
+    // a * I + b pass runs at full resolution
+    static void guidedSmooth(const Mat& image, Mat& result, int radius, float edgeThreshold) {
+        int channels = image.channels();
+        int step = std::max(1, std::min(radius / 4, 16));
+        int coarseRadius = std::max(1, radius / step);
+        // At eps = 0 a flat window would give a = 0 / 0; the slider's lowest value is the floor
+        float threshold = std::max(edgeThreshold, 1.0f);
+        float epsilon = (threshold / 255.0f) * (threshold / 255.0f);
+        double white = whiteLevel(image.depth());
+        
+        // Normalised float copy at the coefficient resolution
+        Mat coarse;
+        if (step > 1) {
+            Size coarseSize(std::max(1, image.cols / step), std::max(1, image.rows / step));
+            resize(image, coarse, coarseSize, 0, 0, INTER_AREA);
+            coarse.convertTo(coarse, CV_32F, 1.0 / white);
+        } else {
+            image.convertTo(coarse, CV_32F, 1.0 / white);
+        }
+        
+        // Per-window coefficients, then their window means; channels hold a for every
+        // image channel followed by b for every image channel
+        Size window(2 * coarseRadius + 1, 2 * coarseRadius + 1);
+        TileScheduler::TileOp coefficients = {coarseRadius, [window, epsilon](const Mat& in, Mat& out, const TileScheduler::TileContext&) {
+            Mat mean, meanSquare;
+            boxFilter(in, mean, CV_32F, window);
+            boxFilter(in.mul(in), meanSquare, CV_32F, window);
+            Mat variance = meanSquare - mean.mul(mean);
+            Mat a = variance / (variance + epsilon);
+            Mat b = mean - a.mul(mean);
+            Mat planes[] = {a, b};
+            merge(planes, 2, out);
+        }};
+        TileScheduler::TileOp windowMean = {coarseRadius, [window](const Mat& in, Mat& out, const TileScheduler::TileContext&) {
+            boxFilter(in, out, CV_32F, window);
+        }};
+        Mat meanCoefficients;
+        TileScheduler::instance().runTiles(coarse, meanCoefficients, {coefficients, windowMean}, CV_MAKETYPE(CV_32F, 2 * channels));
+        
+        Mat output(image.size(), image.type());
+        switch (image.depth()) {
+            case CV_8U: guidedCombine<uchar>(image, meanCoefficients, output); break;
+            case CV_16U: guidedCombine<ushort>(image, meanCoefficients, output); break;
+            default: guidedCombine<float>(image, meanCoefficients, output); break;
+        }
+        result = output;
+    }
+    
+    // Final pass of `guidedSmooth`: output = a * I + b, with a and b interpolated bilinearly
+    // from the coefficient grid
+    template <typename T>
+    static void guidedCombine(const Mat& image, const Mat& grid, Mat& output) {
+        int channels = image.channels();
+        int gridChannels = grid.channels();
+        float white = static_cast<float>(whiteLevel(image.depth()));
+        
+        // Horizontal sample positions are the same for every row
+        float scaleX = static_cast<float>(grid.cols) / image.cols;
+        float scaleY = static_cast<float>(grid.rows) / image.rows;
+        vector<int> left(image.cols), right(image.cols);
+        vector<float> weight(image.cols);
+        for (int x = 0; x < image.cols; x++) {
+            float gx = std::min(std::max((x + 0.5f) * scaleX - 0.5f, 0.0f), static_cast<float>(grid.cols - 1));
+            left[x] = static_cast<int>(gx);
+            right[x] = std::min(left[x] + 1, grid.cols - 1);
+            weight[x] = gx - left[x];
+        }
+        
+        TileScheduler::instance().parallelRows(image.rows, [&](int begin, int end) {
+            vector<float> row(grid.cols * gridChannels);
+            for (int y = begin; y < end; y++) {
+                // Blend the two neighbouring grid rows once, then interpolate along the row
+                float gy = std::min(std::max((y + 0.5f) * scaleY - 0.5f, 0.0f), static_cast<float>(grid.rows - 1));
+                int top = static_cast<int>(gy);
+                int bottom = std::min(top + 1, grid.rows - 1);
+                float wy = gy - top;
+                const float* topRow = grid.ptr<float>(top);
+                const float* bottomRow = grid.ptr<float>(bottom);
+                for (size_t i = 0; i < row.size(); i++) {
+                    row[i] = topRow[i] + (bottomRow[i] - topRow[i]) * wy;
+                }
+                
+                const T* in = image.ptr<T>(y);
+                T* out = output.ptr<T>(y);
+                for (int x = 0; x < image.cols; x++) {
+                    const float* l = &row[left[x] * gridChannels];
+                    const float* r = &row[right[x] * gridChannels];
+                    float wx = weight[x];
+                    for (int c = 0; c < channels; c++) {
+                        float a = l[c] + (r[c] - l[c]) * wx;
+                        float b = l[channels + c] + (r[channels + c] - l[channels + c]) * wx;
+                        out[x * channels + c] = saturate_cast<T>((a * (in[x * channels + c] / white) + b) * white);
+                    }
+                }
+            }
+        });
+    }
+    
+    // Apply edge-preserving smoothing to the image
+    void applySmooth() {
+        if (workingImage.empty()) {
+            cout << "No image loaded yet." << endl;
+            return;
+        }
+        
+        int radius = params.smoothRadius;
+        float edgeThreshold = params.smoothEdgeThreshold;
+        runOperation(OP_SMOOTH, 2 * radius, [this, radius, edgeThreshold](const Mat& image, Mat& result) {
+            applyAtWorkingPrecision(image, result, [radius, edgeThreshold](const Mat& source, Mat& target) {
+                guidedSmooth(source, target, radius, edgeThreshold);
+            });
+        });
+    }
+    
+    // Running maximum (dilate) or minimum (erode) over lines of 2 * radius + 1 pixels that step
+    // one row down and `shift` columns across per pixel: 0 for vertical lines, 1 and -1 for the
+    // diagonals. Uses the van Herk/Gil-Werman algorithm: the lines are cut into blocks of the
+    // window length, g holds the running extreme from the start of each block and h the one
+    // towards its end, and any window covers the end of one block and the start of the next,
+    // so its extreme is combine(h[start], g[end]). Three comparisons per pixel at any length.
+    // The image is padded with the neutral value, so pixels outside it never win. Every row is
+    // combined with the row above or below as a whole, in OpenCV's vectorised min/max;
+    // blocks run in parallel
+    static void vanHerkGilWerman(const Mat& src, Mat& dst, int radius, int shift, bool dilate) {
+        if (radius <= 0) {
+            dst = src.clone();
+            return;
+        }
+        
+        int window = 2 * radius + 1;
+        int padX = radius * std::abs(shift);
+        double neutral = dilate ? -std::numeric_limits<double>::max() : std::numeric_limits<double>::max();
+        Mat padded;
+        copyMakeBorder(src, padded, radius, radius, padX, padX, BORDER_CONSTANT, Scalar::all(neutral));
+        
+        auto combine = [dilate](const Mat& a, const Mat& b, Mat out) {
+            if (dilate) {
+                cv::max(a, b, out);
+            } else {
+                cv::min(a, b, out);
+            }
+        };
+        
+        // Row `y` of `target` from the row `step` rows away (-1 above, 1 below), followed along
+        // the line. The column the line enters from outside the image keeps its own value
+        int width = padded.cols;
+        auto extend = [&](Mat& target, int y, int step) {
+            int offset = shift * step;  // Column of the neighbouring line pixel, relative to x
+            int begin = std::max(0, -offset);
+            int end = width - std::max(0, offset);
+            padded.row(y).copyTo(target.row(y));
+            combine(target.row(y + step).colRange(begin + offset, end + offset), padded.row(y).colRange(begin, end),
+                    target.row(y).colRange(begin, end));
+        };
+        
+        Mat g(padded.size(), padded.type());
+        Mat h(padded.size(), padded.type());
+        int blocks = (padded.rows + window - 1) / window;
+        TileScheduler::instance().parallelFor(blocks, [&](int block) {
+            int first = block * window;
+            int last = std::min(first + window, padded.rows) - 1;
+            padded.row(first).copyTo(g.row(first));
+            for (int y = first + 1; y <= last; y++) {
+                extend(g, y, -1);
+            }
+            padded.row(last).copyTo(h.row(last));
+            for (int y = last - 1; y >= first; y--) {
+                extend(h, y, 1);
+            }
+        });
+        
+        // The window around (y, x) starts at padded (y, x + padX - radius * shift)
+        // and ends at padded (y + 2 * radius, x + padX + radius * shift)
+        Mat output(src.size(), src.type());
+        TileScheduler::instance().parallelRows(src.rows, [&](int begin, int end) {
+            for (int y = begin; y < end; y++) {
+                int startX = padX - radius * shift;
+                int endX = padX + radius * shift;
+                combine(h.row(y).colRange(startX, startX + src.cols), g.row(y + 2 * radius).colRange(endX, endX + src.cols),
+                        output.row(y));
+            }
+        });
+        dst = output;
+    }
+    
+    // Erode or dilate with a rectangle (`line` false) or a line of `EditParams`; rectangles are
+    // a horizontal and a vertical line pass. Horizontal passes run on the transposed image so
+    // they are row-wise too
+    static void morphologyPass(const Mat& src, Mat& dst, const EditParams& p, bool dilate) {
+        auto horizontal = [dilate](const Mat& in, Mat& out, int radius) {
+            Mat transposed;
+            transpose(in, transposed);
+            vanHerkGilWerman(transposed, transposed, radius, 0, dilate);
+            transpose(transposed, out);
+        };
+        
+        if (p.morphShape == 0) {
+            Mat rows;
+            horizontal(src, rows, p.morphWidth / 2);
+            vanHerkGilWerman(rows, dst, p.morphHeight / 2, 0, dilate);
+            return;
+        }
+        
+        // Image rows run downwards: a 45 degree line rises to the right, so it steps one
+        // column left per row down
+        int radius = p.morphLineLength / 2;
+        switch (p.morphLineAngle) {
+            case 0: horizontal(src, dst, radius); break;
+            case 1: vanHerkGilWerman(src, dst, radius, -1, dilate); break;
+            case 2: vanHerkGilWerman(src, dst, radius, 0, dilate); break;
+            default: vanHerkGilWerman(src, dst, radius, 1, dilate); break;
+        }
+    }
+    
+    // Erosion, dilation and the operations built from them
+    static void morphologyImage(const Mat& src, Mat& dst, const EditParams& p) {
+        Mat result;
+        switch (p.morphOperation) {
+            case 0: morphologyPass(src, result, p, false); break;
+            case 1: morphologyPass(src, result, p, true); break;
+            case 2: // Open: erode then dilate, removes specks smaller than the element
+            case 4: // Top-hat: what opening removed
+                morphologyPass(src, result, p, false);
+                morphologyPass(result, result, p, true);
+                if (p.morphOperation == 4) subtract(src, result, result);
+                break;
+            case 3: // Close: dilate then erode, fills holes smaller than the element
+            case 5: // Black-hat: what closing filled
+                morphologyPass(src, result, p, true);
+                morphologyPass(result, result, p, false);
+                if (p.morphOperation == 5) subtract(result, src, result);
+                break;
+            default: { // Gradient: dilation minus erosion, the outline of shapes
+                Mat eroded;
+                morphologyPass(src, result, p, true);
+                morphologyPass(src, eroded, p, false);
+                subtract(result, eroded, result);
+                break;
+            }
+        }
+        dst = result;
+    }
+    
+    // Largest distance a morphology operation reads from each pixel
+    static int morphologyRadius(const EditParams& p) {
+        int radius = p.morphShape == 0 ? std::max(p.morphWidth, p.morphHeight) / 2 : p.morphLineLength / 2;
+        bool twoPasses = p.morphOperation >= 2 && p.morphOperation <= 5;
+        return twoPasses ? 2 * radius : radius;
+    }
+    
+    // Rank filter of one plane of levels below 2^(2 * levelBits) with the Perreault-Hebert
+    // algorithm. Every column keeps a histogram of the 2 * radius + 1 pixels above and below
+    // the current row, updated with one removal and one addition per row; the window
+    // histogram is the sum of 2 * radius + 1 column histograms and slides right by adding
+    // one column and removing another. Histograms are two-level, a coarse one over the high
+    // bits and fine ones per coarse bin: the coarse window histogram is kept up to date for
+    // every pixel, a fine one only when the rank falls into its bin, caught up with the
+    // columns it missed. None of this depends on the radius.
+    // The image is cut into vertical strips, one per worker, each with its own column histograms
+    template <typename T>
+    static void rankFilterPlane(const Mat& src, Mat& dst, int radius, double percentile, int levelBits) {
+        const int bins = 1 << levelBits;      // Coarse bins, and fine bins per coarse bin
+        const int window = 2 * radius + 1;
+        const int rank = std::min(std::max(cvRound(percentile / 100.0 * (window * window - 1)), 0), window * window - 1);
+        
+        Mat padded;
+        copyMakeBorder(src, padded, radius, radius, radius, radius, BORDER_REPLICATE);
+        Mat output(src.size(), src.type());
+        
+        int workers = static_cast<int>(TileScheduler::instance().threadCount());
+        int stripWidth = std::max((src.cols + workers - 1) / workers, std::min(src.cols, 4 * radius));
+        int strips = (src.cols + stripWidth - 1) / stripWidth;
+        TileScheduler::instance().parallelFor(strips, [&](int strip) {
+            int x0 = strip * stripWidth;
+            int x1 = std::min(x0 + stripWidth, src.cols);
+            int columns = x1 - x0 + 2 * radius;  // Padded columns read by the strip
+            
+            vector<uint16_t> columnCoarse(static_cast<size_t>(columns) * bins, 0);
+            vector<uint16_t> columnFine(static_cast<size_t>(columns) * bins * bins, 0);
+            auto count = [&](int y, int delta) {
+                const T* row = padded.ptr<T>(y) + x0;
+                for (int i = 0; i < columns; i++) {
+                    int coarse = row[i] >> levelBits;
+                    columnCoarse[i * bins + coarse] += delta;
+                    columnFine[(static_cast<size_t>(i) * bins + coarse) * bins + (row[i] & (bins - 1))] += delta;
+                }
+            };
+            for (int y = 0; y < window; y++) {
+                count(y, 1);
+            }
+            
+            // A column counts 2 * radius + 1 pixels, the window (2 * radius + 1)^2, which
+            // passes 16 bits from a radius of 128
+            vector<uint32_t> kernelCoarse(bins);
+            vector<uint32_t> kernelFine(static_cast<size_t>(bins) * bins);
+            vector<int> fineColumn(bins);  // Window position each fine histogram is valid for
+            for (int y = 0; y < src.rows; y++) {
+                if (y > 0) {
+                    count(y - 1, -1);
+                    count(y + 2 * radius, 1);
+                }
+                
+                // First window of the row; fine histograms are rebuilt on first use
+                std::fill(kernelCoarse.begin(), kernelCoarse.end(), 0);
+                for (int i = 0; i < window; i++) {
+                    for (int b = 0; b < bins; b++) {
+                        kernelCoarse[b] += columnCoarse[i * bins + b];
+                    }
+                }
+                std::fill(fineColumn.begin(), fineColumn.end(), -window);
+                
+                T* out = output.ptr<T>(y);
+                for (int i = 0; i < x1 - x0; i++) {
+                    if (i > 0) {
+                        const uint16_t* entering = &columnCoarse[(i + 2 * radius) * bins];
+                        const uint16_t* leaving = &columnCoarse[(i - 1) * bins];
+                        for (int b = 0; b < bins; b++) {
+                            kernelCoarse[b] += entering[b] - leaving[b];
+                        }
+                    }
+                    
+                    // Coarse bin holding the rank
+                    int seen = 0;
+                    int coarse = 0;
+                    while (seen + static_cast<int>(kernelCoarse[coarse]) <= rank) {
+                        seen += kernelCoarse[coarse++];
+                    }
+                    
+                    // Bring that bin's fine histogram to this window
+                    uint32_t* fine = &kernelFine[static_cast<size_t>(coarse) * bins];
+                    auto columnBin = [&](int column) {
+                        return &columnFine[(static_cast<size_t>(column) * bins + coarse) * bins];
+                    };
+                    if (i - fineColumn[coarse] >= window) {
+                        std::fill(fine, fine + bins, 0);
+                        for (int c = i; c < i + window; c++) {
+                            const uint16_t* add = columnBin(c);
+                            for (int f = 0; f < bins; f++) {
+                                fine[f] += add[f];
+                            }
+                        }
+                    } else {
+                        for (int c = fineColumn[coarse] + 1; c <= i; c++) {
+                            const uint16_t* add = columnBin(c + 2 * radius);
+                            const uint16_t* remove = columnBin(c - 1);
+                            for (int f = 0; f < bins; f++) {
+                                fine[f] += add[f] - remove[f];
+                            }
+                        }
+                    }
+                    fineColumn[coarse] = i;
+                    
+                    int level = 0;
+                    while (seen + static_cast<int>(fine[level]) <= rank) {
+                        seen += fine[level++];
+                    }
+                    out[x0 + i] = static_cast<T>((coarse << levelBits) | level);
+                }
+            }
+        });
+        dst = output;
+    }
+    
+    // Median (percentile 50) or another percentile of every (2 * radius + 1)^2 window, per
+    // channel. 8-bit images are ranked exactly; deeper ones at 12-bit precision, which keeps
+    // the column histograms at 8 KB per column
+    static void rankFilter(const Mat& image, Mat& result, int radius, double percentile) {
+        vector<Mat> planes;
+        split(image, planes);
+        for (Mat& plane : planes) {
+            if (plane.depth() == CV_8U) {
+                rankFilterPlane<uchar>(plane, plane, radius, percentile, 4);
+                continue;
+            }
+            double white = whiteLevel(plane.depth());
+            Mat levels;
+            plane.convertTo(levels, CV_16U, 4095.0 / white);
+            rankFilterPlane<ushort>(levels, levels, radius, percentile, 6);
+            levels.convertTo(plane, plane.depth(), white / 4095.0);
+        }
+        merge(planes, result);
+    }
+    
+    // Apply the median / rank filter of the Median panel
+    void applyMedian() {
+        if (workingImage.empty()) {
+            cout << "No image loaded yet." << endl;
+            return;
+        }
+        
+        int radius = params.medianRadius;
+        double percentile = params.medianPercentile;
+        runOperation(OP_MEDIAN, radius, [this, radius, percentile](const Mat& image, Mat& result) {
+            applyAtWorkingPrecision(image, result, [radius, percentile](const Mat& source, Mat& target) {
+                rankFilter(source, target, radius, percentile);
+            });
+        });
+    }
+    
+    // Show the panel of a plugin operation, starting from its defaults when it was not the last one shown
+    void selectPlugin(const IEOperation* op) {
+        activeOperation = PLUGIN;
+        if (params.pluginName == op->name) return;
+        params.pluginName = op->name;
+        std::fill(params.pluginValues, params.pluginValues + IE_MAX_PARAMS, 0.0f);
+        for (int i = 0; i < op->param_count; i++) {
+            params.pluginValues[i] = op->params[i].default_value;
+        }
+    }
+    
+    // Pixel format a plugin processes an image of `depth` in: the image's own when the plugin
+    // accepts it, otherwise the most precise one it does
+    static int pluginDepth(const IEOperation* op, int depth) {
+        if (depth == CV_8U && (op->formats & IE_FORMAT_8U)) return CV_8U;
+        if (depth == CV_16U && (op->formats & IE_FORMAT_16U)) return CV_16U;
+        if (op->formats & IE_FORMAT_32F) return CV_32F;
+        if (op->formats & IE_FORMAT_16U) return CV_16U;
+        return CV_8U;
+    }
+    
+    // View of a tile as a plugin image
+    static IEImage pluginImage(Mat& tile) {
+        IEFormat format = tile.depth() == CV_8U ? IE_FORMAT_8U : (tile.depth() == CV_16U ? IE_FORMAT_16U : IE_FORMAT_32F);
+        return {tile.data, tile.cols, tile.rows, tile.step[0], tile.channels(), format};
+    }
+    
+    // Largest halo a plugin may ask for, so a bad radius cannot make every tile read the
+    // whole image
+    static constexpr int maxPluginRadius = 256;
+    
+    // Apply the plugin operation named in the parameters. It is scheduled over tiles like the
+    // built-in operations; tiles are converted when the plugin does not accept the image format.
+    // A tile the plugin fails on leaves the image unchanged and nothing is recorded; in batch
+    // mode the failure is thrown, so the pipeline fails with it
+    void applyPlugin() {
+        if (workingImage.empty()) {
+            cout << "No image loaded yet." << endl;
+            return;
+        }
+        
+        const IEOperation* op = PluginRegistry::instance().find(params.pluginName);
+        if (!op) {
+            cout << "Plugin operation not loaded: " << params.pluginName << endl;
+            return;
+        }
+        
+        vector<float> values(params.pluginValues, params.pluginValues + IE_MAX_PARAMS);
+        int radius = op->radius ? std::clamp(op->radius(values.data()), 0, maxPluginRadius) : 0;
+        Size imageSize = workingImage.size();
+        
+        auto process = [this, op, values, radius, imageSize](const Mat& image, Mat& result) {
+            // Tiles carry image coordinates, so a region lines up with the whole-image result
+            Point frameOrigin = operationFrame.tl();
+            std::atomic<bool> failed(false);
+            
+            auto processTile = [&](const Mat& in, Mat& out, const TileScheduler::TileContext& context) {
+                int depth = pluginDepth(op, in.depth());
+                Mat source = in;
+                if (depth != in.depth()) {
+                    in.convertTo(source, depth, whiteLevel(depth) / whiteLevel(in.depth()));
+                }
+                Mat target(source.size(), source.type());
+                
+                IEImage input = pluginImage(source);
+                IEImage output = pluginImage(target);
+                IETile tile{frameOrigin.x + context.region.x, frameOrigin.y + context.region.y, imageSize.width, imageSize.height};
+                if (op->process(&input, &output, &tile, values.data()) != 0) {
+                    failed = true;
+                }
+                
+                if (depth != in.depth()) {
+                    target.convertTo(out, in.depth(), whiteLevel(in.depth()) / whiteLevel(depth));
+                } else {
+                    out = target;
+                }
+            };
+            
+            TileScheduler::instance().runTiles(image, result, {{radius, processTile}});
+            if (failed) {
+                CV_Error(Error::StsError, string(op->name) + " failed on a tile");
+            }
+        };
+        
+        try {
+            runOperation(OP_PLUGIN, radius, process);
+        } catch (const cv::Exception&) {
+            if (batchMode) throw;
+            cout << op->name << " failed; the image was left unchanged." << endl;
+        }
+    }
+    
+    // Equalisation table of one histogram, scaled to [0, 1]. Without a clip limit it is the
+    // table of cv::equalizeHist, (cdf - cdf_min) / (N - cdf_min) with cdf_min the count of the
+    // lowest level present, so that level maps to black. A clip limit above 0 gives the
+    // table of cv::createCLAHE instead: every bin is capped at that multiple of the mean
+    // count, the excess is shared out over all bins (what does not divide evenly goes one
+    // count per bin from the bottom, as OpenCV does), and the table is cdf / N. Capping
+    // bounds the contrast gain
+    static void equalizationTable(const vector<int>& histogram, double clipLimit, float* table) {
+        int counts[256];
+        int total = 0;
+        for (int i = 0; i < 256; i++) {
+            counts[i] = histogram[i];
+            total += counts[i];
+        }
+        int lowest = 0;
+        while (lowest < 256 && counts[lowest] == 0) lowest++;
+        if (total <= 0 || (clipLimit <= 0.0 && counts[lowest] == total)) {
+            // Nothing to spread: a single level stays where it is
+            for (int i = 0; i < 256; i++) table[i] = i / 255.0f;
+            return;
+        }
+        
+        if (clipLimit > 0.0) {
+            int limit = std::max(1, static_cast<int>(clipLimit * total / 256.0));
+            int excess = 0;
+            for (int& count : counts) {
+                if (count > limit) {
+                    excess += count - limit;
+                    count = limit;
+                }
+            }
+            int share = excess / 256;
+            int remainder = excess - share * 256;
+            for (int& count : counts) {
+                count += share;
+            }
+            int step = remainder > 0 ? std::max(256 / remainder, 1) : 256;
+            for (int i = 0; i < 256 && remainder > 0; i += step, remainder--) {
+                counts[i]++;
+            }
+            
+            int sum = 0;
+            for (int i = 0; i < 256; i++) {
+                sum += counts[i];
+                table[i] = static_cast<float>(sum) / total;
+            }
+            return;
+        }
+        
+        int lowestCount = counts[lowest];
+        int sum = 0;
+        for (int i = 0; i < 256; i++) {
+            sum += counts[i];
+            table[i] = static_cast<float>(std::max(sum - lowestCount, 0)) / (total - lowestCount);
+        }
+    }
+    
+    // Centre-to-centre interpolation along one axis of `blocks` equal blocks over `size`
+    // pixels: every pixel blends the block whose centre lies before it (`lower`) with the
+    // next one by `weight`. Pixels outside the outermost centres use the outer block alone
+    static void blockWeights(int size, int blocks, vector<int>& lower, vector<int>& upper, vector<float>& weight) {
+        lower.resize(size);
+        upper.resize(size);
+        weight.resize(size);
+        for (int p = 0; p < size; p++) {
+            float position = (p + 0.5f) * blocks / size - 0.5f;
+            int block = static_cast<int>(std::floor(position));
+            float w = position - block;
+            if (block < 0) {
+                block = 0;
+                w = 0.0f;
+            } else if (block >= blocks - 1) {
+                block = blocks - 1;
+                w = 0.0f;
+            }
+            lower[p] = block;
+            upper[p] = std::min(block + 1, blocks - 1);
+            weight[p] = w;
+        }
+    }
+    
+    // Histogram equalisation of the luminance (Y of YCrCb, or the image itself when it is
+    // grayscale), so colours keep their hue. With tiles > 0 this is CLAHE: the image is cut
+    // into tiles x tiles blocks, each with its own clipped table, and every pixel blends the
+    // tables of the four nearest block centres bilinearly, so no block edges show. Tables
+    // come from channelHistograms of the 8-bit luma, one block per task; deeper images look
+    // up between table entries, so they keep their precision
+    static void equalizeImage(const Mat& image, Mat& result, int tiles, double clipLimit) {
+        CV_Assert(image.channels() == 1 || image.channels() == 3);
+        Mat ycrcb, luma;
+        if (image.channels() == 3) {
+            cvtColor(image, ycrcb, COLOR_BGR2YCrCb);
+            extractChannel(ycrcb, luma, 0);
+        } else {
+            luma = image;
+        }
+        
+        Mat luma8 = quantizeTo8U(luma);
+        int tilesX = std::max(1, std::min(tiles, luma.cols));
+        int tilesY = std::max(1, std::min(tiles, luma.rows));
+        vector<float> tables(static_cast<size_t>(tilesX) * tilesY * 256);
+        TileScheduler::instance().parallelFor(tilesX * tilesY, [&](int t) {
+            int tx = t % tilesX;
+            int ty = t / tilesX;
+            Rect block(Point(luma.cols * tx / tilesX, luma.rows * ty / tilesY),
+                       Point(luma.cols * (tx + 1) / tilesX, luma.rows * (ty + 1) / tilesY));
+            vector<vector<int>> histogram = channelHistograms(luma8(block));
+            equalizationTable(histogram[0], tiles > 0 ? clipLimit : 0.0, &tables[static_cast<size_t>(t) * 256]);
+        });
+        
+        vector<int> columnLower, columnUpper, rowLower, rowUpper;
+        vector<float> columnWeight, rowWeight;
+        blockWeights(luma.cols, tilesX, columnLower, columnUpper, columnWeight);
+        blockWeights(luma.rows, tilesY, rowLower, rowUpper, rowWeight);
+        for (int x = 0; x < luma.cols; x++) {
+            columnLower[x] *= 256;
+            columnUpper[x] *= 256;
+        }
+        
+        // One pass over the pixels
+        Mat mapped(luma.size(), luma.type());
+        float white = static_cast<float>(whiteLevel(luma.depth()));
+        PixelKernels::dispatchDepth(luma.depth(), [&](auto zero) {
+            using T = decltype(zero);
+            PixelKernels::forEachStrip(luma.size(), false, [&](const Range& rows, const Range& cols) {
+                for (int y = rows.start; y < rows.end; y++) {
+                    const float* top = &tables[static_cast<size_t>(rowLower[y]) * tilesX * 256];
+                    const float* bottom = &tables[static_cast<size_t>(rowUpper[y]) * tilesX * 256];
+                    float wy = rowWeight[y];
+                    const T* in = luma.ptr<T>(y);
+                    T* out = mapped.ptr<T>(y);
+                    for (int x = cols.start; x < cols.end; x++) {
+                        // 8-bit values land exactly on a table entry
+                        float position = std::min(std::max(in[x] * (255.0f / white), 0.0f), 255.0f);
+                        int i = std::min(static_cast<int>(position), 254);
+                        float f = position - i;
+                        auto lookup = [i, f](const float* table) { return table[i] + f * (table[i + 1] - table[i]); };
+                        float topLeft = lookup(top + columnLower[x]);
+                        float topRight = lookup(top + columnUpper[x]);
+                        float bottomLeft = lookup(bottom + columnLower[x]);
+                        float bottomRight = lookup(bottom + columnUpper[x]);
+                        float upperRow = topLeft + columnWeight[x] * (topRight - topLeft);
+                        float lowerRow = bottomLeft + columnWeight[x] * (bottomRight - bottomLeft);
+                        out[x] = saturate_cast<T>((upperRow + wy * (lowerRow - upperRow)) * white);
+                    }
+                }
+            });
+        });
+        
+        if (image.channels() == 3) {
+            insertChannel(mapped, ycrcb, 0);
+            cvtColor(ycrcb, result, COLOR_YCrCb2BGR);
+        } else {
+            result = mapped;
+        }
+    }
+    
+    // Apply the global equalisation or CLAHE of the Equalize panel
+    void applyEqualize() {
+        if (workingImage.empty()) {
+            cout << "No image loaded yet." << endl;
+            return;
+        }
+        
+        // The tables depend on the whole image, so a region is equalised on its own pixels
+        int tiles = params.equalizeMethod == 1 ? params.claheTiles : 0;
+        double clipLimit = params.claheClipLimit;
+        runOperation(OP_EQUALIZE, 0, [this, tiles, clipLimit](const Mat& image, Mat& result) {
+            applyAtWorkingPrecision(image, result, [tiles, clipLimit](const Mat& source, Mat& target) {
+                equalizeImage(source, target, tiles, clipLimit);
+            });
+        });
+    }
+    
+    // Apply the morphology operation of the Morphology panel
+    void applyMorphology() {
+        if (workingImage.empty()) {
+            cout << "No image loaded yet." << endl;
+            return;
+        }
+        
+        EditParams p = params;
+        runOperation(OP_MORPHOLOGY, morphologyRadius(p), [this, &p](const Mat& image, Mat& result) {
+            applyAtWorkingPrecision(image, result, [&p](const Mat& source, Mat& target) {
+                morphologyImage(source, target, p);
+            });
+        });
+    }
+    
+    void applyBlur() {
+        if (workingImage.empty()) {
+            cout << "No image loaded yet." << endl;
+            return;
+        }
+        
+        // Calculate kernel size based on radius (must be odd)
+        int kernelSize = static_cast<int>(params.gaussianBlurRadius) * 2 + 1;
+        
+        // Apply blur based on selected options
+        TileScheduler::TileOp blur;
+        if (params.useDirectionalBlur) {
+            // Directional blur (motion blur)
             // Convert angle to radians
             float angleRad = params.directionalBlurAngle * CV_PI / 180.0f;
             
-            // Calculate kernel size based on radius (must be odd)
-            int kernelSize = static_cast<int>(params.gaussianBlurRadius) * 2 + 1;
-            
             // Create a motion blur kernel
             Mat kernel = getMotionBlurKernel(kernelSize, angleRad);
             
             // Apply the kernel
-            filter2D(workingImage, workingImage, -1, kernel);
+            blur = {kernelSize / 2, [kernel](const Mat& in, Mat& out, const TileScheduler::TileContext&) {
+                filter2D(in, out, -1, kernel);
+            }};
         } else {
             // Gaussian blur
-            // Calculate kernel size based on radius (must be odd)
-            int kernelSize = static_cast<int>(params.gaussianBlurRadius) * 2 + 1;
-            
-            // Apply Gaussian blur
-            GaussianBlur(workingImage, workingImage, Size(kernelSize, kernelSize), 0);
+            blur = gaussianBlurOp(kernelSize, params.blurSigma);
         }
         
-        // Update the texture
-        updateTexture();
+        runOperation(OP_BLUR, blur.radius, [blur](const Mat& image, Mat& result) {
+            TileScheduler::instance().runTiles(image, result, {blur});
+        });
     }
     
     // Helper function to create a motion blur kernel
@@ -783,8 +4260,11 @@ public:
             return;
         }
         
-        // Add current state to history before applying changes
-        addToHistory(workingImage);
+        // The crop was drawn on the rotation preview, so rotate and crop in one resample
+        if (isPreviewingRotation()) {
+            commitRotation();
+            return;
+        }
         
         // Ensure the crop rectangle is within image bounds
         cropRect.x = std::max(0, std::min(cropRect.x, workingImage.cols - 1));
@@ -794,25 +4274,39 @@ public:
         
         // Check if rectangle is valid
         if (cropRect.width > 0 && cropRect.height > 0) {
-            // Create a deep copy of the cropped region
-            Mat cropped = workingImage(cropRect).clone();
-            
-            // Update working image with the cropped region
-            workingImage = cropped.clone();
+            cropTo(cropRect);
             
+            // Exit crop mode; a selected region no longer matches the cropped image
+            cropMode = false;
+            isDragging = false;
+            regionActive = false;
+            cout << "Image cropped successfully." << endl;
+        } else {
+            cout << "Invalid crop region. Please try again." << endl;
+        }
+    }
+    
+    // Crop the working image to `rect`, which must lie inside it
+    void cropTo(const Rect& rect) {
+        // Create a deep copy of the cropped region
+        Mat cropped = workingImage(rect).clone();
+        
+        // Recorded only once the copy exists, as in runOperation
+        if (!batchMode) {
+            // Add current state to history; the working image is replaced, so its buffer moves into history
+            pushHistory({workingImage, Rect(), recordedOps, "Crop"});
+            recordedOps.push_back({OP_CROP, params, rect});
+        }
+        workingImage = cropped;
+        invalidateDerivedPlanes();
+        
+        if (!batchMode) {
             // Update image dimensions
             imageWidth = workingImage.cols;
             imageHeight = workingImage.rows;
             
-            // Exit crop mode
-            cropMode = false;
-            isDragging = false;
-            
             // Update the texture
             updateTexture();
-            cout << "Image cropped successfully." << endl;
-        } else {
-            cout << "Invalid crop region. Please try again." << endl;
         }
     }
     
@@ -828,6 +4322,37 @@ public:
         }
     }
     
+    // Use the crop rectangle as the region that subsequent operations apply to
+    void useCropAsRegion() {
+        if (!cropMode || workingImage.empty()) {
+            cout << "Please enter crop mode first and select a region." << endl;
+            return;
+        }
+        if (isPreviewingRotation()) {
+            cout << "Apply or cancel the rotation first." << endl;
+            return;
+        }
+        
+        Rect region = normalizeRect(cropRect) & Rect(Point(), workingImage.size());
+        if (region.area() == 0) {
+            cout << "Invalid region. Please try again." << endl;
+            return;
+        }
+        
+        regionRect = region;
+        regionActive = true;
+        cropMode = false;
+        isDragging = false;
+        cout << "Operations now apply to the selected region (" << region.width << "x" << region.height << ")." << endl;
+    }
+    
+    void clearRegion() {
+        if (regionActive) {
+            regionActive = false;
+            cout << "Operations now apply to the whole image." << endl;
+        }
+    }
+    
     // Helper function to normalize rectangle (ensure positive width/height)
     Rect normalizeRect(const Rect& rect) {
         Rect result;
@@ -849,8 +4374,8 @@ public:
         splitChannels.clear();
         grayscaleChannels.clear();
         
-        // Split the image into BGR channels
-        split(workingImage, splitChannels);
+        // Split the image into BGR channels; the channels are only displayed, so 8 bits suffice
+        split(quantizeTo8U(workingImage), splitChannels);
         
         // Create colored versions of each channel
         for (int i = 0; i < splitChannels.size(); i++) {
@@ -929,84 +4454,385 @@ public:
     // Apply threshold to the image
     void applyThreshold() {
         if (workingImage.empty()) {
-            cout << "No image loaded yet." << endl;
-            return;
+            cout << "No image loaded yet." << endl;
+            return;
+        }
+        
+        // Adaptive thresholding compares each pixel with its block neighbourhood
+        int radius = params.thresholdMethod == 1 ? params.adaptiveBlockSize / 2 + 1 : 0;
+        
+        runOperation(OP_THRESHOLD, radius, [this](const Mat& image, Mat& result) {
+            thresholdImage(image, result);
+        });
+    }
+    
+    // Threshold `image` into a BGR image of the same type. The grayscale conversion comes
+    // from the derived planes, so repeated thresholds of one image convert it only once
+    void thresholdImage(const Mat& image, Mat& result) {
+        DerivedPlanes& planes = planesFor(image);
+        const Mat& grayImage = planes.luma();
+        
+        // Apply threshold based on selected method
+        Mat thresholdedImage;
+        
+        // Ensure block size is odd (for adaptive threshold)
+        int blockSize = params.adaptiveBlockSize;
+        if (blockSize % 2 == 0) blockSize++;
+        
+        if (grayImage.depth() != CV_8U) {
+            applyThresholdHighPrecision(planes, thresholdedImage, blockSize);
+        } else {
+            switch (params.thresholdMethod) {
+                case 0: // Binary threshold
+                    threshold(grayImage, thresholdedImage, params.thresholdValue, params.thresholdMaxValue, THRESH_BINARY);
+                    break;
+                
+                case 1: // Adaptive threshold
+                    if (params.adaptiveMethod == 0) {
+                        adaptiveThreshold(grayImage, thresholdedImage, params.thresholdMaxValue, 
+                                         ADAPTIVE_THRESH_GAUSSIAN_C, THRESH_BINARY, blockSize, params.adaptiveC);
+                    } else {
+                        thresholdedImage = Mat::zeros(grayImage.size(), CV_8U);
+                        thresholdedImage.setTo(params.thresholdMaxValue, integralThresholdMask(planes, params, blockSize));
+                    }
+                    break;
+                
+                case 2: // Otsu threshold
+                    threshold(grayImage, thresholdedImage, 0, params.thresholdMaxValue, THRESH_BINARY | THRESH_OTSU);
+                    break;
+            }
+        }
+        
+        // Convert back to BGR for display; half floats were thresholded as float
+        cvtColor(thresholdedImage, result, COLOR_GRAY2BGR);
+        if (result.depth() != image.depth()) {
+            result.convertTo(result, image.depth());
+        }
+    }
+    
+    // Threshold a 16-bit or float grayscale image without quantising it first.
+    // Threshold values stay on the 8-bit scale of the UI; the comparison runs in float
+    void applyThresholdHighPrecision(DerivedPlanes& planes, Mat& thresholdedImage, int blockSize) {
+        const Mat& grayImage = planes.luma();
+        double toByteScale = 255.0 / whiteLevel(grayImage.depth());
+        const Mat& grayFloat = planes.lumaFloat();
+        
+        Mat mask;
+        switch (params.thresholdMethod) {
+            case 0: // Binary threshold
+                mask = grayFloat > params.thresholdValue;
+                break;
+                
+            case 1: { // Adaptive threshold, same Gaussian-weighted window as adaptiveThreshold
+                if (params.adaptiveMethod != 0) {
+                    mask = integralThresholdMask(planes, params, blockSize);
+                    break;
+                }
+                Mat localMean;
+                GaussianBlur(grayFloat, localMean, Size(blockSize, blockSize), 0, 0, BORDER_REPLICATE | BORDER_ISOLATED);
+                Mat limit = localMean - params.adaptiveC;
+                mask = grayFloat > limit;
+                break;
+            }
+                
+            case 2: { // Otsu threshold, level found on the 8-bit histogram
+                Mat binary;
+                double level = threshold(planes.luma8(), binary, 0, 255, THRESH_BINARY | THRESH_OTSU);
+                mask = grayFloat > level;
+                break;
+            }
+        }
+        
+        thresholdedImage = Mat::zeros(grayImage.size(), grayImage.type());
+        thresholdedImage.setTo(params.thresholdMaxValue / toByteScale, mask);
+    }
+    
+    // Summed-area tables of a single-channel float image and of its squares, with a zero
+    // first row and column like cv::integral. Rows are summed in parallel strips, then each
+    // strip adds the column totals of the strips above it
+    static void integralTables(const Mat& image, Mat& sum, Mat& squareSum) {
+        sum.create(image.rows + 1, image.cols + 1, CV_64F);
+        squareSum.create(image.rows + 1, image.cols + 1, CV_64F);
+        sum.row(0).setTo(0);
+        squareSum.row(0).setTo(0);
+        
+        TileScheduler& scheduler = TileScheduler::instance();
+        int strips = std::max(1, std::min(image.rows, static_cast<int>(scheduler.threadCount()) * 4));
+        auto stripBegin = [&](int strip) {
+            return static_cast<int>(static_cast<long long>(image.rows) * strip / strips);
+        };
+        
+        // Tables of each strip on its own, as if the image started at the strip
+        scheduler.parallelFor(strips, [&](int strip) {
+            int begin = stripBegin(strip);
+            int end = stripBegin(strip + 1);
+            for (int y = begin; y < end; y++) {
+                const float* in = image.ptr<float>(y);
+                const double* above = y > begin ? sum.ptr<double>(y) : nullptr;
+                const double* squareAbove = y > begin ? squareSum.ptr<double>(y) : nullptr;
+                double* out = sum.ptr<double>(y + 1);
+                double* squareOut = squareSum.ptr<double>(y + 1);
+                
+                double rowSum = 0.0;
+                double rowSquareSum = 0.0;
+                out[0] = 0.0;
+                squareOut[0] = 0.0;
+                for (int x = 0; x < image.cols; x++) {
+                    double value = in[x];
+                    rowSum += value;
+                    rowSquareSum += value * value;
+                    out[x + 1] = rowSum + (above ? above[x + 1] : 0.0);
+                    squareOut[x + 1] = rowSquareSum + (squareAbove ? squareAbove[x + 1] : 0.0);
+                }
+            }
+        });
+        
+        // Running column totals above every strip; O(strips * width)
+        vector<Mat> carry(strips), squareCarry(strips);
+        carry[0] = Mat::zeros(1, image.cols + 1, CV_64F);
+        squareCarry[0] = Mat::zeros(1, image.cols + 1, CV_64F);
+        for (int strip = 1; strip < strips; strip++) {
+            int last = stripBegin(strip);
+            carry[strip] = carry[strip - 1] + sum.row(last);
+            squareCarry[strip] = squareCarry[strip - 1] + squareSum.row(last);
+        }
+        
+        scheduler.parallelFor(strips - 1, [&](int index) {
+            int strip = index + 1;
+            for (int y = stripBegin(strip); y < stripBegin(strip + 1); y++) {
+                sum.row(y + 1) += carry[strip];
+                squareSum.row(y + 1) += squareCarry[strip];
+            }
+        });
+    }
+    
+    // Adaptive threshold mask computed from summed-area tables, so every pixel costs the same
+    // whatever the block size. Windows are clipped at the image border. Mean compares with the
+    // local mean minus C; Niblack with m + k * s; Sauvola with m * (1 + k * (s / 128 - 1)),
+    // where s is the local standard deviation, all on the 8-bit scale
+    static Mat integralThresholdMask(DerivedPlanes& planes, const EditParams& p, int blockSize) {
+        const Mat& grayFloat = planes.lumaFloat();
+        const Mat& sum = planes.integral();
+        const Mat& squareSum = planes.squareIntegral();
+        
+        Mat mask(grayFloat.size(), CV_8U);
+        int radius = blockSize / 2;
+        int width = grayFloat.cols;
+        int height = grayFloat.rows;
+        
+        TileScheduler::instance().parallelRows(height, [&](int begin, int end) {
+            for (int y = begin; y < end; y++) {
+                int top = std::max(0, y - radius);
+                int bottom = std::min(height, y + radius + 1);
+                const double* sumTop = sum.ptr<double>(top);
+                const double* sumBottom = sum.ptr<double>(bottom);
+                const double* squareTop = squareSum.ptr<double>(top);
+                const double* squareBottom = squareSum.ptr<double>(bottom);
+                const float* in = grayFloat.ptr<float>(y);
+                uchar* out = mask.ptr<uchar>(y);
+                
+                for (int x = 0; x < width; x++) {
+                    int left = std::max(0, x - radius);
+                    int right = std::min(width, x + radius + 1);
+                    double count = static_cast<double>((bottom - top) * (right - left));
+                    double windowSum = sumBottom[right] - sumBottom[left] - sumTop[right] + sumTop[left];
+                    double mean = windowSum / count;
+                    
+                    double level;
+                    if (p.adaptiveMethod == 1) {
+                        level = mean - p.adaptiveC;
+                    } else {
+                        double windowSquareSum = squareBottom[right] - squareBottom[left] - squareTop[right] + squareTop[left];
+                        double deviation = std::sqrt(std::max(0.0, windowSquareSum / count - mean * mean));
+                        if (p.adaptiveMethod == 2) {
+                            level = mean * (1.0 + p.sauvolaK * (deviation / 128.0 - 1.0));
+                        } else {
+                            level = mean + p.niblackK * deviation;
+                        }
+                    }
+                    out[x] = in[x] > level ? 255 : 0;
+                }
+            }
+        });
+        return mask;
+    }
+    
+    // Histograms of the B, G and R channels of an 8-bit image; a grayscale image only fills
+    // the first. Every strip counts into its own histogram, merged at the end
+    static vector<vector<int>> channelHistograms(const Mat& image) {
+        vector<vector<int>> histogram(3, vector<int>(256, 0));
+        PixelKernels::dispatchChannels(image.channels(), [&](auto channels) {
+            constexpr int CN = decltype(channels)::value;
+            using Counts = std::array<std::array<int, 256>, CN>;
+            Counts zero{};
+            Counts total = PixelKernels::reduce<uchar>(image, zero, [](Counts& counts, const uchar* src, int pixels) {
+                for (int i = 0; i < pixels; i++) {
+                    for (int c = 0; c < CN; c++) {
+                        counts[c][src[CN * i + c]]++;
+                    }
+                }
+            }, [](Counts& sum, const Counts& part) {
+                for (int c = 0; c < CN; c++) {
+                    for (int i = 0; i < 256; i++) {
+                        sum[c][i] += part[c][i];
+                    }
+                }
+            });
+            
+            // An alpha channel has no histogram of its own
+            for (int c = 0; c < std::min(CN, 3); c++) {
+                std::copy(total[c].begin(), total[c].end(), histogram[c].begin());
+            }
+        });
+        return histogram;
+    }
+    
+    // Calculate histogram for the current image
+    vector<vector<int>> calculateHistogram() {
+        vector<vector<int>> histogram(4, vector<int>(256, 0)); // For BGR channels and luma
+        
+        if (workingImage.empty()) {
+            return histogram;
         }
         
-        // Add current state to history before applying changes
-        addToHistory(workingImage);
-        
-        // Convert to grayscale if not already
-        Mat grayImage;
-        if (workingImage.channels() == 3) {
-            cvtColor(workingImage, grayImage, COLOR_BGR2GRAY);
-        } else {
-            grayImage = workingImage.clone();
+        // The histogram is a display, so high-bit-depth images are binned at 8 bits
+        vector<vector<int>> channels = channelHistograms(quantizeTo8U(workingImage));
+        std::copy(channels.begin(), channels.end(), histogram.begin());
+        
+        // Luma from the shared planes, the same grayscale the threshold compares
+        Mat lumaHistogram;
+        int bins = 256;
+        float range[] = {0, 256};
+        const float* ranges[] = {range};
+        calcHist(&planesFor(workingImage).luma8(), 1, nullptr, Mat(), lumaHistogram, 1, &bins, ranges);
+        for (int i = 0; i < 256; i++) {
+            histogram[3][i] = cvRound(lumaHistogram.at<float>(i));
         }
         
-        // Apply threshold based on selected method
-        Mat thresholdedImage;
-        
-        // Ensure block size is odd (for adaptive threshold)
-        int blockSize = params.adaptiveBlockSize;
-        if (blockSize % 2 == 0) blockSize++;
-        
-        switch (params.thresholdMethod) {
-            case 0: // Binary threshold
-                threshold(grayImage, thresholdedImage, params.thresholdValue, params.thresholdMaxValue, THRESH_BINARY);
-                break;
-                
-            case 1: // Adaptive threshold
-                adaptiveThreshold(grayImage, thresholdedImage, params.thresholdMaxValue, 
-                                 ADAPTIVE_THRESH_GAUSSIAN_C, THRESH_BINARY, blockSize, params.adaptiveC);
-                break;
-                
-            case 2: // Otsu threshold
-                threshold(grayImage, thresholdedImage, 0, params.thresholdMaxValue, THRESH_BINARY | THRESH_OTSU);
-                break;
+        return histogram;
+    }
+    
+    // Draw histogram bars from `calculateHistogram` into a rectangle of the current window:
+    // one channel in grey (0: blue, 1: green, 2: red, 3: luma), or -1 for the colour
+    // channels stacked. Bars are scaled by the largest count of any channel
+    static void drawHistogramBars(ImDrawList* drawList, ImVec2 pos, ImVec2 size, const vector<vector<int>>& histogram, int channel) {
+        int maxCount = 1;
+        for (const auto& counts : histogram) {
+            for (int count : counts) {
+                maxCount = max(maxCount, count);
+            }
         }
         
-        // Convert back to BGR for display
-        if (thresholdedImage.channels() == 1) {
-            cvtColor(thresholdedImage, workingImage, COLOR_GRAY2BGR);
-        } else {
-            workingImage = thresholdedImage.clone();
+        float barWidth = size.x / 256.0f;
+        float bottom = pos.y + size.y;
+        if (channel >= 0) {
+            for (int i = 0; i < 256; i++) {
+                float barHeight = (histogram[channel][i] / (float)maxCount) * size.y;
+                drawList->AddRectFilled(ImVec2(pos.x + i * barWidth, bottom - barHeight),
+                                        ImVec2(pos.x + (i + 1) * barWidth, bottom),
+                                        IM_COL32(200, 200, 200, 255));
+            }
+            return;
         }
         
-        // Update the texture
-        updateTexture();
+        // Blue at the bottom, then green, then red, each on a third of the height
+        const ImU32 colors[3] = {IM_COL32(0, 0, 255, 255), IM_COL32(0, 255, 0, 255), IM_COL32(255, 0, 0, 255)};
+        for (int i = 0; i < 256; i++) {
+            float base = bottom;
+            for (int c = 0; c < 3; c++) {
+                float barHeight = (histogram[c][i] / (float)maxCount) * size.y / 3.0f;
+                drawList->AddRectFilled(ImVec2(pos.x + i * barWidth, base - barHeight),
+                                        ImVec2(pos.x + (i + 1) * barWidth, base),
+                                        colors[c]);
+                base -= barHeight;
+            }
+        }
     }
     
-    // Calculate histogram for the current image
-    vector<vector<int>> calculateHistogram() {
-        vector<vector<int>> histogram(3, vector<int>(256, 0)); // For BGR channels
-        
-        if (workingImage.empty()) {
-            return histogram;
+    // Curve editor for the Curves/Levels panel, drawn over the histogram of the channel
+    // being edited. Click to add or drag a point, right-click to remove one
+    void drawCurveEditor(const vector<vector<int>>& histogram) {
+        int& count = params.curvePointCount[curveChannel];
+        float (*points)[2] = params.curvePoints[curveChannel];
+        
+        float side = std::min(ImGui::GetContentRegionAvail().x, 320.0f);
+        ImVec2 pos = ImGui::GetCursorScreenPos();
+        ImVec2 size(side, side);
+        ImDrawList* drawList = ImGui::GetWindowDrawList();
+        auto toScreen = [&](float x, float y) {
+            return ImVec2(pos.x + x * size.x, pos.y + (1.0f - y) * size.y);
+        };
+        
+        drawList->AddRectFilled(pos, ImVec2(pos.x + size.x, pos.y + size.y), IM_COL32(30, 30, 30, 255));
+        
+        // Master shows the luma histogram; red, green and blue their own channel
+        const int histogramChannels[4] = {3, 2, 1, 0};
+        if (!histogram.empty()) {
+            drawHistogramBars(drawList, pos, size, histogram, histogramChannels[curveChannel]);
+        }
+        drawList->AddLine(toScreen(0.0f, 0.0f), toScreen(1.0f, 1.0f), IM_COL32(90, 90, 90, 255));
+        
+        // The curve as it will be compiled into the table
+        const ImU32 curveColors[4] = {IM_COL32(255, 255, 255, 255), IM_COL32(255, 80, 80, 255),
+                                      IM_COL32(80, 255, 80, 255), IM_COL32(80, 140, 255, 255)};
+        ToneCurve curve(points, count);
+        vector<ImVec2> samples;
+        for (int i = 0; i <= 128; i++) {
+            float x = i / 128.0f;
+            samples.push_back(toScreen(x, std::min(std::max(curve(x), 0.0f), 1.0f)));
+        }
+        drawList->AddPolyline(samples.data(), static_cast<int>(samples.size()), curveColors[curveChannel], 0, 2.0f);
+        for (int i = 0; i < count; i++) {
+            drawList->AddCircleFilled(toScreen(points[i][0], points[i][1]), 5.0f, curveColors[curveChannel]);
         }
         
-        // For grayscale images, use only the first channel
-        if (workingImage.channels() == 1) {
-            for (int y = 0; y < workingImage.rows; y++) {
-                for (int x = 0; x < workingImage.cols; x++) {
-                    int value = workingImage.at<uchar>(y, x);
-                    histogram[0][value]++;
-                }
+        ImGui::InvisibleButton("##CurveCanvas", size);
+        ImVec2 mouse = ImGui::GetIO().MousePos;
+        float mouseX = std::min(std::max((mouse.x - pos.x) / size.x, 0.0f), 1.0f);
+        float mouseY = std::min(std::max(1.0f - (mouse.y - pos.y) / size.y, 0.0f), 1.0f);
+        
+        // Control point under the mouse, within a few pixels
+        int hovered = -1;
+        for (int i = 0; i < count; i++) {
+            ImVec2 point = toScreen(points[i][0], points[i][1]);
+            if (fabs(point.x - mouse.x) <= 6.0f && fabs(point.y - mouse.y) <= 6.0f) {
+                hovered = i;
             }
-            return histogram;
         }
         
-        // For color images, calculate histogram for each channel
-        for (int y = 0; y < workingImage.rows; y++) {
-            for (int x = 0; x < workingImage.cols; x++) {
-                Vec3b pixel = workingImage.at<Vec3b>(y, x);
-                histogram[0][pixel[0]]++; // B
-                histogram[1][pixel[1]]++; // G
-                histogram[2][pixel[2]]++; // R
+        if (ImGui::IsItemClicked(0)) {
+            draggedCurvePoint = hovered;
+            if (hovered < 0 && count < EditParams::maxCurvePoints) {
+                // Insert a point where the mouse is, keeping the points sorted by input
+                int index = 0;
+                while (index < count && points[index][0] < mouseX) index++;
+                for (int i = count; i > index; i--) {
+                    points[i][0] = points[i - 1][0];
+                    points[i][1] = points[i - 1][1];
+                }
+                points[index][0] = mouseX;
+                points[index][1] = mouseY;
+                count++;
+                draggedCurvePoint = index;
+            }
+        } else if (ImGui::IsItemClicked(1) && hovered > 0 && hovered < count - 1) {
+            // End points stay; interior points can be removed
+            for (int i = hovered; i + 1 < count; i++) {
+                points[i][0] = points[i + 1][0];
+                points[i][1] = points[i + 1][1];
             }
+            count--;
         }
         
-        return histogram;
+        if (ImGui::IsItemActive() && draggedCurvePoint >= 0 && draggedCurvePoint < count) {
+            // A point cannot pass its neighbours
+            float low = draggedCurvePoint > 0 ? points[draggedCurvePoint - 1][0] + 0.01f : 0.0f;
+            float high = draggedCurvePoint < count - 1 ? points[draggedCurvePoint + 1][0] - 0.01f : 1.0f;
+            points[draggedCurvePoint][0] = std::min(std::max(mouseX, low), high);
+            points[draggedCurvePoint][1] = mouseY;
+        } else {
+            draggedCurvePoint = -1;
+        }
     }
     
     // Apply blend operation to the image
@@ -1021,299 +4847,1245 @@ public:
             return;
         }
         
-        // Load the second image
-        Mat blendImage = imread(params.blendImagePath);
+        // Load the second image at its own bit depth
+        Mat blendImage = imread(params.blendImagePath, IMREAD_ANYDEPTH | IMREAD_COLOR);
         if (blendImage.empty()) {
             cout << "Failed to load the blend image: " << params.blendImagePath << endl;
             return;
         }
+        if (workingImage.depth() == CV_8U) {
+            blendImage = quantizeTo8U(blendImage);
+        }
         
-        // Add current state to history before applying changes
-        addToHistory(workingImage);
+        // Apply the selected blend mode. Blending is a point operation, so every
+        // tile is processed independently on the scheduler
+        int blendMode = params.blendMode;
+        double blendOpacity = params.blendOpacity;
+        
+        auto blendTile = [this, &blendImage, blendMode, blendOpacity](const Mat& tile, Mat& result, const TileScheduler::TileContext& context) {
+            Mat blend = blendImage(context.region);
+            
+            if (tile.depth() != CV_8U) {
+                blendHighPrecision(tile, blend, result, blendMode, blendOpacity);
+                return;
+            }
+            
+            blendPixels8U(tile, blend, result, blendMode, blendOpacity);
+        };
         
-        // Resize blend image to match the working image size if needed
+        // The blend image is stretched over the whole image, so a region blends with
+        // the part of it that covers the region, as it would on the whole image
         if (blendImage.size() != workingImage.size()) {
             resize(blendImage, blendImage, workingImage.size(), 0, 0, INTER_LINEAR);
         }
         
-        // Apply the selected blend mode
-        Mat result;
+        runOperation(OP_BLEND, 0, [this, &blendImage, &blendTile](const Mat& image, Mat& result) {
+            blendImage = blendImage(operationFrame);
+            TileScheduler::instance().runTiles(image, result, {{0, blendTile}});
+        });
+    }
+    
+    // Exact a / 255, rounded down, for 0 <= a <= 255 * 255, in shifts and adds only
+    static int div255(int a) {
+        return (a + 1 + (a >> 8)) >> 8;
+    }
+    
+    // (a * (256 - weight) + c * weight) / 256, rounded: level `a` mixed with `c` by a weight
+    // in 1/256 steps. Every term fits 16 bits
+    static int mixLevels(int a, int c, int weight) {
+        return (a * (256 - weight) + c * weight + 128) >> 8;
+    }
+    
+    // Result of an 8-bit blend mode for one level of the tile `a` and the blend image `b`
+    static int blendLevel(int blendMode, int a, int b) {
+        switch (blendMode) {
+            case 1: return div255(a * b); // Multiply
+            case 2: return 255 - div255((255 - a) * (255 - b)); // Screen
+            case 3: return a < 128 ? div255(2 * a * b) : 255 - div255(2 * (255 - a) * (255 - b)); // Overlay
+            default: return std::abs(a - b); // Difference
+        }
+    }
+    
+#if CV_SIMD
+    // The same on every 16-bit lane. Products that wrap past 16 bits only occur in the
+    // Overlay branch a lane does not select
+    static v_uint16 div255(const v_uint16& a) {
+        return v_shr<8>(v_add_wrap(v_add_wrap(a, vx_setall_u16(1)), v_shr<8>(a)));
+    }
+    
+    static v_uint16 mixLevels(const v_uint16& a, const v_uint16& c, const v_uint16& keep, const v_uint16& gain) {
+        return v_shr<8>(v_add_wrap(v_add_wrap(v_mul_wrap(a, keep), v_mul_wrap(c, gain)), vx_setall_u16(128)));
+    }
+    
+    static v_uint16 blendLevel(int blendMode, const v_uint16& a, const v_uint16& b) {
+        v_uint16 white = vx_setall_u16(255);
+        switch (blendMode) {
+            case 1: return div255(v_mul_wrap(a, b));
+            case 2: return v_sub_wrap(white, div255(v_mul_wrap(v_sub_wrap(white, a), v_sub_wrap(white, b))));
+            case 3: {
+                v_uint16 multiplied = div255(v_shl<1>(v_mul_wrap(a, b)));
+                v_uint16 screened = v_sub_wrap(white, div255(v_shl<1>(v_mul_wrap(v_sub_wrap(white, a), v_sub_wrap(white, b)))));
+                v_uint16 upperHalf = v_sub_wrap(vx_setzero_u16(), v_shr<7>(a));  // All ones where a >= 128
+                return v_select(upperHalf, screened, multiplied);
+            }
+            default: return v_absdiff(a, b);
+        }
+    }
+#endif
+    
+    // Blend modes for 8-bit tiles in integer arithmetic: Multiply a * b / 255, Screen
+    // 255 - (255 - a) * (255 - b) / 255, Overlay multiply below mid-grey and screen above
+    // it, Difference |a - b|; the mode's result is then mixed with the tile by the opacity.
+    // Every intermediate fits 16 bits, so where OpenCV has SIMD the levels are widened to
+    // 16-bit lanes (8 per SSE2/NEON register, 16 per AVX2) and packed back; the tail of each
+    // run takes the scalar path, which gives the same result
+    static void blendPixels8U(const Mat& tile, const Mat& blend, Mat& result, int blendMode, double blendOpacity) {
+        if (blendMode == 0) { // Normal
+            // Simple alpha blending
+            addWeighted(tile, 1.0 - blendOpacity, blend, blendOpacity, 0, result);
+            return;
+        }
         
-        switch (params.blendMode) {
+        // Opacity in 1/256 steps, so the mix is a shift rather than a division
+        int weight = cvRound(std::clamp(blendOpacity, 0.0, 1.0) * 256.0);
+        int channels = tile.channels();
+        
+        PixelKernels::combine<uchar, uchar, uchar>(tile, blend, result, tile.type(), [&](const uchar* a, const uchar* b, uchar* out, int pixels) {
+            int count = pixels * channels;
+            int i = 0;
+#if CV_SIMD
+            v_uint16 keep = vx_setall_u16(static_cast<ushort>(256 - weight));
+            v_uint16 gain = vx_setall_u16(static_cast<ushort>(weight));
+            for (; i + CV_SIMD_WIDTH <= count; i += CV_SIMD_WIDTH) {
+                v_uint16 aLow, aHigh, bLow, bHigh;
+                v_expand(vx_load(a + i), aLow, aHigh);
+                v_expand(vx_load(b + i), bLow, bHigh);
+                v_store(out + i, v_pack(mixLevels(aLow, blendLevel(blendMode, aLow, bLow), keep, gain),
+                                        mixLevels(aHigh, blendLevel(blendMode, aHigh, bHigh), keep, gain)));
+            }
+            vx_cleanup();
+#endif
+            for (; i < count; i++) {
+                out[i] = static_cast<uchar>(mixLevels(a[i], blendLevel(blendMode, a[i], b[i]), weight));
+            }
+        });
+    }
+    
+    // Blend modes for 16-bit and float tiles, evaluated in float on normalised 0..1 values
+    void blendHighPrecision(const Mat& tile, const Mat& blend, Mat& result, int blendMode, double blendOpacity) {
+        double white = whiteLevel(tile.depth());
+        Mat a, b, c;
+        tile.convertTo(a, CV_32F, 1.0 / white);
+        blend.convertTo(b, CV_32F, 1.0 / whiteLevel(blend.depth()));
+        
+        switch (blendMode) {
             case 0: // Normal
-                // Simple alpha blending
-                addWeighted(workingImage, 1.0 - params.blendOpacity, blendImage, params.blendOpacity, 0, result);
+                c = b;
                 break;
-                
+            
             case 1: // Multiply
-                // Multiply blend mode: result = a * b / 255
-                result = Mat::zeros(workingImage.size(), workingImage.type());
-                for (int y = 0; y < workingImage.rows; y++) {
-                    for (int x = 0; x < workingImage.cols; x++) {
-                        Vec3b a = workingImage.at<Vec3b>(y, x);
-                        Vec3b b = blendImage.at<Vec3b>(y, x);
-                        
-                        // Apply multiply blend mode
-                        Vec3b c;
-                        c[0] = (a[0] * b[0]) / 255;
-                        c[1] = (a[1] * b[1]) / 255;
-                        c[2] = (a[2] * b[2]) / 255;
-                        
-                        // Apply opacity
-                        result.at<Vec3b>(y, x) = a * (1.0 - params.blendOpacity) + c * params.blendOpacity;
-                    }
-                }
+                multiply(a, b, c);
                 break;
-                
+            
             case 2: // Screen
-                // Screen blend mode: result = 255 - (255 - a) * (255 - b) / 255
-                result = Mat::zeros(workingImage.size(), workingImage.type());
-                for (int y = 0; y < workingImage.rows; y++) {
-                    for (int x = 0; x < workingImage.cols; x++) {
-                        Vec3b a = workingImage.at<Vec3b>(y, x);
-                        Vec3b b = blendImage.at<Vec3b>(y, x);
-                        
-                        // Apply screen blend mode
-                        Vec3b c;
-                        c[0] = 255 - ((255 - a[0]) * (255 - b[0])) / 255;
-                        c[1] = 255 - ((255 - a[1]) * (255 - b[1])) / 255;
-                        c[2] = 255 - ((255 - a[2]) * (255 - b[2])) / 255;
-                        
-                        // Apply opacity
-                        result.at<Vec3b>(y, x) = a * (1.0 - params.blendOpacity) + c * params.blendOpacity;
-                    }
-                }
+                c = 1.0 - (1.0 - a).mul(1.0 - b);
+                break;
+            
+            case 3: { // Overlay
+                Mat dark = 2.0 * a.mul(b);
+                c = 1.0 - 2.0 * (1.0 - a).mul(1.0 - b);
+                dark.copyTo(c, a < 0.5);
+                break;
+            }
+            
+            case 4: // Difference
+                absdiff(a, b, c);
                 break;
+        }
+        
+        // Apply opacity
+        Mat mixed;
+        addWeighted(a, 1.0 - blendOpacity, c, blendOpacity, 0, mixed);
+        mixed.convertTo(result, tile.depth(), white);
+    }
+    
+    // The parsed LUT for `path`; parsing happens once per file version, and the 8-bit
+    // lookup table built on first use stays with it
+    shared_ptr<ColorLut3D> colorLutFor(const string& path) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            cout << "Failed to open the LUT file: " << path << endl;
+            return nullptr;
+        }
+        if (colorLut && colorLutPath == path && colorLutModified == st.st_mtime) {
+            return colorLut;
+        }
+        
+        string error;
+        shared_ptr<ColorLut3D> lut = ColorLut3D::load(path, error);
+        if (!lut) {
+            cout << "Failed to load the LUT file: " << error << endl;
+            return nullptr;
+        }
+        colorLut = lut;
+        colorLutPath = path;
+        colorLutModified = st.st_mtime;
+        return colorLut;
+    }
+    
+    // Grade the image through a 3D LUT
+    void applyColorLut() {
+        if (workingImage.empty()) {
+            cout << "No image loaded yet." << endl;
+            return;
+        }
+        
+        if (params.lutPath.empty()) {
+            cout << "No LUT file selected." << endl;
+            return;
+        }
+        
+        if (workingImage.channels() != 3) {
+            cout << "3D LUTs need a colour image." << endl;
+            return;
+        }
+        
+        shared_ptr<ColorLut3D> lut = colorLutFor(params.lutPath);
+        if (!lut) return;
+        
+        float strength = params.lutStrength;
+        runOperation(OP_COLOR_LUT, 0, [this, lut, strength](const Mat& image, Mat& result) {
+            applyAtWorkingPrecision(image, result, [lut, strength](const Mat& source, Mat& target) {
+                lut->apply(source, target, strength);
+            });
+        });
+    }
+    
+    // Apply noise to the image
+    void applyNoise() {
+        if (workingImage.empty()) {
+            cout << "No image loaded yet." << endl;
+            return;
+        }
+        
+        runOperation(OP_NOISE, 0, [this](const Mat& image, Mat& result) {
+            applyNoiseTo(image, result);
+        });
+    }
+    
+    // The raw noise field for `image`, which covers `operationFrame` of the working image.
+    // Generated only when the generator parameters, the image size or the frame changed
+    const NoiseField& noiseFieldFor(const Mat& image) {
+        Size imageSize = workingImage.size();
+        vector<float> key = {static_cast<float>(params.noiseType), params.noiseScale,
+                             static_cast<float>(imageSize.width), static_cast<float>(imageSize.height),
+                             static_cast<float>(operationFrame.x), static_cast<float>(operationFrame.y),
+                             static_cast<float>(operationFrame.width), static_cast<float>(operationFrame.height)};
+        if (params.noiseType == 2) {
+            key.push_back(static_cast<float>(params.noiseSeed));
+        } else if (params.noiseType == 4) {
+            key.insert(key.end(), {static_cast<float>(params.noiseOctaves), params.noisePersistence, params.noiseLacunarity});
+        }
+        if (key == noiseField.key && !noiseField.field.empty()) {
+            return noiseField;
+        }
+        
+        // Worley feature points are shared by every tile, so draw them up front
+        vector<Point2f> worleyPoints;
+        if (params.noiseType == 2) {
+            worleyPoints = generateWorleyPoints(imageSize, params.noiseScale, params.noiseSeed);
+        }
+        
+        // Every tile generates its own part from image coordinates, so a pattern
+        // applied to a region lines up with the same pattern on the whole image
+        Mat noisePattern;
+        Point frameOrigin = operationFrame.tl();
+        auto generateTile = [this, &worleyPoints, imageSize, frameOrigin](const Mat& in, Mat& noise, const TileScheduler::TileContext& context) {
+            noise = Mat::zeros(in.size(), CV_32F);
+            Point origin = frameOrigin + context.region.tl();
+            
+            // Generate noise based on selected type
+            switch (params.noiseType) {
+                case 0: // Perlin noise
+                    generatePerlinNoise(noise, params.noiseScale, origin);
+                    break;
+                case 1: // Simplex noise
+                    generateSimplexNoise(noise, params.noiseScale, origin);
+                    break;
+                case 2: // Worley noise
+                    generateWorleyNoise(noise, worleyPoints, imageSize, origin);
+                    break;
+                case 3: // Value noise
+                    generateValueNoise(noise, params.noiseScale, origin);
+                    break;
+                case 4: // Fractal Brownian Motion
+                    generateFBMNoise(noise, params.noiseScale, params.noiseOctaves, 
+                                    params.noisePersistence, params.noiseLacunarity, origin);
+                    break;
+            }
+        };
+        TileScheduler::instance().runTiles(image, noisePattern, {{0, generateTile}}, CV_32F);
+        
+        // Every generator but Worley is built to span 0..1. Worley distances depend on where
+        // the points fell, so its range comes from the points over the whole image: a region
+        // is then normalised exactly like the same pattern on the whole image
+        noiseField.key = key;
+        noiseField.field = noisePattern;
+        noiseField.low = 0.0f;
+        noiseField.high = params.noiseType == 2 ? worleyMaxDistance(worleyPoints, imageSize) : 1.0f;
+        return noiseField;
+    }
+    
+    // Normalisation, inversion, amplitude and colour of the noise folded into a few
+    // constants: raw noise n becomes value = (n - offset) * scale + base, and channel c
+    // of the pixel becomes pixel * keep + value * gain[c], saturated to the image depth
+    struct NoiseComposite {
+        float offset;      // Subtracted from the raw noise before scaling
+        float scale;       // Maps the raw range to 0..1, negated when inverting
+        float base;        // Added after scaling: 1 when inverting, else 0
+        float keep;        // Weight of the original pixel
+        float gain[3];     // Amplitude, colour and white level per channel
+    };
+    
+    // Blend a tile with its noise in one pass; `in` and `out` are 3-channel images of type T
+    template <typename T>
+    static void compositeNoise(const Mat& in, const Mat& noise, Mat& out, const NoiseComposite& c) {
+        PixelKernels::combine<T, float, T>(in, noise, out, in.type(), [c](const T* src, const float* n, T* dst, int pixels) {
+            for (int i = 0; i < pixels; i++) {
+                float value = (n[i] - c.offset) * c.scale + c.base;
+                dst[3 * i] = PixelKernels::saturate<T>(src[3 * i] * c.keep + value * c.gain[0]);
+                dst[3 * i + 1] = PixelKernels::saturate<T>(src[3 * i + 1] * c.keep + value * c.gain[1]);
+                dst[3 * i + 2] = PixelKernels::saturate<T>(src[3 * i + 2] * c.keep + value * c.gain[2]);
+            }
+        });
+    }
+    
+    // Blend the noise pattern into `image`, which covers `operationFrame` of the working image,
+    // writing `result`. Normalising, inverting, colourising and blending happen in a single
+    // pass per tile
+    void applyNoiseTo(const Mat& image, Mat& result) {
+        const NoiseField& field = noiseFieldFor(image);
+        
+        // The noise is weighted by the amplitude once as a pattern and once as a blend weight
+        float amplitude = params.noiseAmplitude;
+        float range = field.high - field.low;
+        NoiseComposite composite;
+        composite.offset = field.low;
+        composite.scale = range > 0.0f ? 1.0f / range : 0.0f;
+        composite.base = 0.0f;
+        if (params.noiseInvert) {
+            composite.scale = -composite.scale;
+            composite.base = 1.0f;
+        }
+        composite.keep = 1.0f - amplitude;
+        float white = static_cast<float>(whiteLevel(image.depth()));
+        for (int c = 0; c < 3; c++) {
+            float color = params.noiseColorize ? params.noiseColor[c] : 1.0f;
+            composite.gain[c] = amplitude * amplitude * color * white;
+        }
+        
+        auto compositeTile = [&field, composite](const Mat& in, Mat& out, const TileScheduler::TileContext& context) {
+            Mat noise = field.field(context.region);
+            PixelKernels::dispatchDepth(in.depth(), [&](auto zero) {
+                compositeNoise<decltype(zero)>(in, noise, out, composite);
+            });
+        };
+        TileScheduler::instance().runTiles(image, result, {{0, compositeTile}});
+    }
+    
+    // Generate Perlin noise; `origin` is the image position of the noise block's top-left pixel.
+    // The generators write their rows through PixelKernels::generate, with the terms that
+    // only depend on the row hoisted out of the pixel loop
+    static void generatePerlinNoise(Mat& noise, float scale, Point origin = Point()) {
+        // Simple implementation of Perlin noise
+        PixelKernels::generate<float>(noise, [scale, origin](float* row, int x0, int y, int pixels) {
+            float ny = (origin.y + y) / scale;
+            float cosY = cos(ny);
+            for (int i = 0; i < pixels; i++) {
+                float nx = (origin.x + x0 + i) / scale;
                 
-            case 3: // Overlay
-                // Overlay blend mode: if a < 128 then 2*a*b/255 else 255-2*(255-a)*(255-b)/255
-                result = Mat::zeros(workingImage.size(), workingImage.type());
-                for (int y = 0; y < workingImage.rows; y++) {
-                    for (int x = 0; x < workingImage.cols; x++) {
-                        Vec3b a = workingImage.at<Vec3b>(y, x);
-                        Vec3b b = blendImage.at<Vec3b>(y, x);
-                        
-                        // Apply overlay blend mode
-                        Vec3b c;
-                        for (int i = 0; i < 3; i++) {
-                            if (a[i] < 128) {
-                                c[i] = 2 * a[i] * b[i] / 255;
-                            } else {
-                                c[i] = 255 - 2 * (255 - a[i]) * (255 - b[i]) / 255;
-                            }
-                        }
-                        
-                        // Apply opacity
-                        result.at<Vec3b>(y, x) = a * (1.0 - params.blendOpacity) + c * params.blendOpacity;
-                    }
+                // Simple 2D Perlin noise approximation
+                row[i] = 0.5f * (1.0f + sin(nx) * cosY);
+            }
+        });
+    }
+    
+    // Generate Simplex noise
+    static void generateSimplexNoise(Mat& noise, float scale, Point origin = Point()) {
+        // Simple implementation of Simplex noise
+        PixelKernels::generate<float>(noise, [scale, origin](float* row, int x0, int y, int pixels) {
+            float ny = (origin.y + y) / scale;
+            for (int i = 0; i < pixels; i++) {
+                float nx = (origin.x + x0 + i) / scale;
+                
+                // Simple 2D Simplex noise approximation
+                row[i] = 0.5f * (1.0f + sin(nx + ny) * cos(nx - ny));
+            }
+        });
+    }
+    
+    // Generate the random feature points of Worley noise for an image
+    static vector<Point2f> generateWorleyPoints(Size imageSize, float scale, int seed) {
+        vector<Point2f> points;
+        int numPoints = static_cast<int>(imageSize.height * imageSize.width / (scale * scale));
+        
+        // Generate random points; a fixed seed gives the same pattern on every apply
+        RNG rng(static_cast<uint64_t>(seed));
+        for (int i = 0; i < numPoints; i++) {
+            float x = rng.uniform(0.0f, static_cast<float>(imageSize.width));
+            float y = rng.uniform(0.0f, static_cast<float>(imageSize.height));
+            points.push_back(Point2f(x, y));
+        }
+        return points;
+    }
+    
+    // The largest value generateWorleyNoise gives anywhere in an image of `imageSize`: the
+    // distance from the farthest pixel to its nearest point. Within each point's Voronoi cell
+    // that distance is largest at a corner of the cell clipped to the image, so only the
+    // corners are measured. The smallest value is taken as 0
+    static float worleyMaxDistance(const vector<Point2f>& points, Size imageSize) {
+        if (points.empty()) return 1.0f;
+        
+        Subdiv2D subdivision(Rect(0, 0, imageSize.width, imageSize.height));
+        subdivision.insert(points);
+        vector<vector<Point2f>> cells;
+        vector<Point2f> centers;
+        subdivision.getVoronoiFacetList(vector<int>(), cells, centers);
+        
+        float right = static_cast<float>(imageSize.width - 1);
+        float bottom = static_cast<float>(imageSize.height - 1);
+        vector<Point2f> frame = {{0.0f, 0.0f}, {right, 0.0f}, {right, bottom}, {0.0f, bottom}};
+        float farthest = 0.0f;
+        for (size_t i = 0; i < cells.size(); i++) {
+            vector<Point2f> clipped;
+            intersectConvexConvex(cells[i], frame, clipped, true);
+            for (const Point2f& corner : clipped) {
+                Point2f offset = corner - centers[i];
+                farthest = std::max(farthest, std::sqrt(offset.x * offset.x + offset.y * offset.y));
+            }
+        }
+        return farthest > 0.0f ? farthest / (imageSize.height * 0.5f) : 1.0f;
+    }
+    
+    // Generate Worley noise
+    static void generateWorleyNoise(Mat& noise, const vector<Point2f>& points, Size imageSize, Point origin = Point()) {
+        // Calculate distance to nearest point. The square root is monotonic, so it is taken
+        // once of the smallest squared distance
+        float halfHeight = imageSize.height * 0.5f;
+        PixelKernels::generate<float>(noise, [&points, halfHeight, origin](float* row, int x0, int y, int pixels) {
+            for (int i = 0; i < pixels; i++) {
+                float minSquare = FLT_MAX;
+                for (const auto& p : points) {
+                    float dx = origin.x + x0 + i - p.x;
+                    float dy = origin.y + y - p.y;
+                    minSquare = min(minSquare, dx*dx + dy*dy);
+                }
+                
+                // Normalize distance
+                row[i] = sqrt(minSquare) / halfHeight;
+            }
+        });
+    }
+    
+    // Generate Value noise
+    static void generateValueNoise(Mat& noise, float scale, Point origin = Point()) {
+        // Simple implementation of Value noise
+        PixelKernels::generate<float>(noise, [scale, origin](float* row, int x0, int y, int pixels) {
+            float ny = (origin.y + y) / scale;
+            for (int i = 0; i < pixels; i++) {
+                float nx = (origin.x + x0 + i) / scale;
+                
+                // Simple 2D Value noise approximation
+                row[i] = 0.5f * (1.0f + sin(nx * ny));
+            }
+        });
+    }
+    
+    // Generate Fractal Brownian Motion noise
+    static void generateFBMNoise(Mat& noise, float scale, int octaves, float persistence, float lacunarity, Point origin = Point()) {
+        Mat tempNoise = Mat::zeros(noise.size(), CV_32F);
+        float amplitude = 1.0f;
+        float frequency = 1.0f / scale;
+        float maxValue = 0.0f;
+        
+        // Generate base noise
+        generatePerlinNoise(tempNoise, scale, origin);
+        
+        // Initialize result
+        noise = tempNoise.clone() * amplitude;
+        maxValue = amplitude;
+        
+        // Add octaves
+        for (int i = 1; i < octaves; i++) {
+            amplitude *= persistence;
+            frequency *= lacunarity;
+            
+            // Generate noise at this octave
+            generatePerlinNoise(tempNoise, scale / frequency, origin);
+            
+            // Add to result
+            noise += tempNoise * amplitude;
+            maxValue += amplitude;
+        }
+        
+        // Normalize
+        noise /= maxValue;
+    }
+    
+    // Human readable name of a recorded operation
+    static const char* operationName(OperationKind kind) {
+        switch (kind) {
+            case OP_GRAYSCALE: return "Grayscale";
+            case OP_SHARPEN: return "Sharpen";
+            case OP_INVERT: return "Invert";
+            case OP_EDGE_DETECTION: return "Edge Detection";
+            case OP_BLUR: return "Blur";
+            case OP_THRESHOLD: return "Threshold";
+            case OP_BLEND: return "Blend";
+            case OP_NOISE: return "Noise";
+            case OP_CONVOLUTION: return "Convolution";
+            case OP_CROP: return "Crop";
+            case OP_ROTATE: return "Rotate";
+            case OP_BRIGHTNESS_CONTRAST: return "Brightness/Contrast";
+            case OP_COLOR_LUT: return "3D LUT";
+            case OP_CURVES_LEVELS: return "Curves/Levels";
+            case OP_SMOOTH: return "Smooth";
+            case OP_MORPHOLOGY: return "Morphology";
+            case OP_RESIZE: return "Resize";
+            case OP_MEDIAN: return "Median";
+            case OP_EQUALIZE: return "Equalize";
+            case OP_PLUGIN: return "Plugin";
+        }
+        return "Unknown";
+    }
+    
+    // Setter of one parameter of a pipeline description, from its text value
+    using ParamSetter = std::function<bool(EditParams&, const string&)>;
+    
+    // Numbers of a comma separated list
+    static bool parseNumbers(const string& text, vector<float>& numbers) {
+        numbers.clear();
+        stringstream stream(text);
+        string item;
+        while (getline(stream, item, ',')) {
+            char* end = nullptr;
+            float value = strtof(item.c_str(), &end);
+            if (item.empty() || *end != '\0') return false;
+            numbers.push_back(value);
+        }
+        return !numbers.empty();
+    }
+    
+    // Whether every number lies in low..high; NaN never does
+    static bool inRange(const vector<float>& numbers, float low, float high) {
+        for (float number : numbers) {
+            if (!(number >= low && number <= high)) return false;
+        }
+        return true;
+    }
+    
+    // A single number in low..high, the range of the parameter's widget. Pipelines come from
+    // other tools, so nothing outside what the UI can set reaches an operation
+    template <typename T>
+    static ParamSetter scalarSetter(T EditParams::* field, float low, float high) {
+        return [field, low, high](EditParams& p, const string& value) {
+            vector<float> numbers;
+            if (value == "true" || value == "false") {
+                numbers = {value == "true" ? 1.0f : 0.0f};
+            } else if (!parseNumbers(value, numbers) || numbers.size() != 1) {
+                return false;
+            }
+            if (!inRange(numbers, low, high)) return false;
+            p.*field = static_cast<T>(numbers[0]);
+            return true;
+        };
+    }
+    
+    static ParamSetter stringSetter(string EditParams::* field) {
+        return [field](EditParams& p, const string& value) {
+            p.*field = value;
+            return true;
+        };
+    }
+    
+    // A list of up to N numbers in low..high (exactly N when `exact`); entries not given are zeroed
+    template <size_t N>
+    static ParamSetter arraySetter(float (EditParams::* field)[N], bool exact, float low, float high) {
+        return [field, exact, low, high](EditParams& p, const string& value) {
+            vector<float> numbers;
+            if (!parseNumbers(value, numbers) || numbers.size() > N || (exact && numbers.size() != N)) return false;
+            if (!inRange(numbers, low, high)) return false;
+            std::fill(p.*field, p.*field + N, 0.0f);
+            std::copy(numbers.begin(), numbers.end(), p.*field);
+            return true;
+        };
+    }
+    
+    // Control points of curve `channel` as x,y pairs on 0..1
+    static ParamSetter curveSetter(int channel) {
+        return [channel](EditParams& p, const string& value) {
+            vector<float> numbers;
+            if (!parseNumbers(value, numbers) || numbers.size() % 2 != 0 || numbers.size() < 4 ||
+                numbers.size() > 2 * EditParams::maxCurvePoints || !inRange(numbers, 0.0f, 1.0f)) return false;
+            std::copy(numbers.begin(), numbers.end(), &p.curvePoints[channel][0][0]);
+            p.curvePointCount[channel] = static_cast<int>(numbers.size() / 2);
+            return true;
+        };
+    }
+    
+    // Parameters a pipeline description may set, by the name of their EditParams field, with
+    // the ranges of their widgets. Kernel entries and plugin values only need to be finite;
+    // plugin values are checked against the plugin's own ranges once the line is parsed
+    static const map<string, ParamSetter>& paramSetters() {
+        static const map<string, ParamSetter> setters = {
+            {"brightness", scalarSetter(&EditParams::brightness, -100.0f, 100.0f)},
+            {"contrast", scalarSetter(&EditParams::contrast, 1.0f, 300.0f)},
+            {"rotationAngle", scalarSetter(&EditParams::rotationAngle, 0.0f, 360.0f)},
+            {"rotationScale", scalarSetter(&EditParams::rotationScale, 10.0f, 300.0f)},
+            {"rotationExpandCanvas", scalarSetter(&EditParams::rotationExpandCanvas, 0, 1)},
+            {"resizeRatio", scalarSetter(&EditParams::resizeRatio, 1.0f, 300.0f)},
+            {"resizeMode", scalarSetter(&EditParams::resizeMode, 0, 1)},
+            {"resizeLongestSide", scalarSetter(&EditParams::resizeLongestSide, 1, 32767)},
+            {"resizeFilter", scalarSetter(&EditParams::resizeFilter, 0, 2)},
+            {"gaussianBlurRadius", scalarSetter(&EditParams::gaussianBlurRadius, 1.0f, 20.0f)},
+            {"blurSigma", scalarSetter(&EditParams::blurSigma, 0.0f, 100.0f)},
+            {"directionalBlurAngle", scalarSetter(&EditParams::directionalBlurAngle, 0.0f, 360.0f)},
+            {"useDirectionalBlur", scalarSetter(&EditParams::useDirectionalBlur, 0, 1)},
+            {"smoothRadius", scalarSetter(&EditParams::smoothRadius, 1, 100)},
+            {"smoothEdgeThreshold", scalarSetter(&EditParams::smoothEdgeThreshold, 1.0f, 100.0f)},
+            {"morphOperation", scalarSetter(&EditParams::morphOperation, 0, 6)},
+            {"morphShape", scalarSetter(&EditParams::morphShape, 0, 1)},
+            {"morphWidth", scalarSetter(&EditParams::morphWidth, 1, 401)},
+            {"morphHeight", scalarSetter(&EditParams::morphHeight, 1, 401)},
+            {"morphLineLength", scalarSetter(&EditParams::morphLineLength, 1, 401)},
+            {"morphLineAngle", scalarSetter(&EditParams::morphLineAngle, 0, 3)},
+            {"medianRadius", scalarSetter(&EditParams::medianRadius, 1, 100)},
+            {"medianPercentile", scalarSetter(&EditParams::medianPercentile, 0.0f, 100.0f)},
+            {"equalizeMethod", scalarSetter(&EditParams::equalizeMethod, 0, 1)},
+            {"claheTiles", scalarSetter(&EditParams::claheTiles, 2, 32)},
+            {"claheClipLimit", scalarSetter(&EditParams::claheClipLimit, 1.0f, 10.0f)},
+            {"thresholdValue", scalarSetter(&EditParams::thresholdValue, 0, 255)},
+            {"thresholdMaxValue", scalarSetter(&EditParams::thresholdMaxValue, 0, 255)},
+            {"adaptiveBlockSize", scalarSetter(&EditParams::adaptiveBlockSize, 3, 501)},
+            {"adaptiveC", scalarSetter(&EditParams::adaptiveC, -10, 10)},
+            {"thresholdMethod", scalarSetter(&EditParams::thresholdMethod, 0, 2)},
+            {"adaptiveMethod", scalarSetter(&EditParams::adaptiveMethod, 0, 3)},
+            {"sauvolaK", scalarSetter(&EditParams::sauvolaK, 0.0f, 1.0f)},
+            {"niblackK", scalarSetter(&EditParams::niblackK, -1.0f, 1.0f)},
+            {"edgeDetectionMethod", scalarSetter(&EditParams::edgeDetectionMethod, 0, 1)},
+            {"sobelKernelSize", scalarSetter(&EditParams::sobelKernelSize, 3, 15)},
+            {"cannyThreshold1", scalarSetter(&EditParams::cannyThreshold1, 1, 255)},
+            {"cannyThreshold2", scalarSetter(&EditParams::cannyThreshold2, 1, 255)},
+            {"overlayEdges", scalarSetter(&EditParams::overlayEdges, 0, 1)},
+            {"edgeColor", arraySetter(&EditParams::edgeColor, true, 0.0f, 1.0f)},
+            {"edgeOpacity", scalarSetter(&EditParams::edgeOpacity, 0.0f, 1.0f)},
+            {"blendMode", scalarSetter(&EditParams::blendMode, 0, 4)},
+            {"blendOpacity", scalarSetter(&EditParams::blendOpacity, 0.0f, 1.0f)},
+            {"blendImagePath", stringSetter(&EditParams::blendImagePath)},
+            {"lutPath", stringSetter(&EditParams::lutPath)},
+            {"lutStrength", scalarSetter(&EditParams::lutStrength, 0.0f, 1.0f)},
+            {"curveMaster", curveSetter(0)},
+            {"curveRed", curveSetter(1)},
+            {"curveGreen", curveSetter(2)},
+            {"curveBlue", curveSetter(3)},
+            {"levelsBlack", scalarSetter(&EditParams::levelsBlack, 0.0f, 254.0f)},
+            {"levelsWhite", scalarSetter(&EditParams::levelsWhite, 1.0f, 255.0f)},
+            {"levelsGamma", scalarSetter(&EditParams::levelsGamma, 0.1f, 10.0f)},
+            {"noiseType", scalarSetter(&EditParams::noiseType, 0, 4)},
+            {"noiseScale", scalarSetter(&EditParams::noiseScale, 1.0f, 50.0f)},
+            {"noiseAmplitude", scalarSetter(&EditParams::noiseAmplitude, 0.0f, 1.0f)},
+            {"noiseOctaves", scalarSetter(&EditParams::noiseOctaves, 1, 8)},
+            {"noisePersistence", scalarSetter(&EditParams::noisePersistence, 0.0f, 1.0f)},
+            {"noiseLacunarity", scalarSetter(&EditParams::noiseLacunarity, 1.0f, 4.0f)},
+            {"noiseInvert", scalarSetter(&EditParams::noiseInvert, 0, 1)},
+            {"noiseColorize", scalarSetter(&EditParams::noiseColorize, 0, 1)},
+            {"noiseColor", arraySetter(&EditParams::noiseColor, true, 0.0f, 1.0f)},
+            {"noiseSeed", scalarSetter(&EditParams::noiseSeed, -1e9f, 1e9f)},
+            {"kernelSize", scalarSetter(&EditParams::kernelSize, 3, 5)},
+            {"kernel", arraySetter(&EditParams::kernel, false, -FLT_MAX, FLT_MAX)},
+            {"kernelScale", scalarSetter(&EditParams::kernelScale, 0.1f, 5.0f)},
+            {"kernelOffset", scalarSetter(&EditParams::kernelOffset, -255.0f, 255.0f)},
+            {"pluginValues", arraySetter(&EditParams::pluginValues, false, -FLT_MAX, FLT_MAX)},
+        };
+        return setters;
+    }
+    
+    // Whether `value` is one the widget of a plugin parameter can produce
+    static bool pluginValueValid(const IEParam& param, float value) {
+        switch (param.type) {
+            case IE_PARAM_FLOAT:
+            case IE_PARAM_INT:
+                return value >= param.min_value && value <= param.max_value;
+            case IE_PARAM_BOOL:
+                return value == 0.0f || value == 1.0f;
+            case IE_PARAM_CHOICE: {
+                // The labels end with an empty one
+                int choices = 0;
+                for (const char* label = param.choices; label && *label; label += strlen(label) + 1) {
+                    choices++;
+                }
+                return value >= 0.0f && value < choices && value == floor(value);
+            }
+        }
+        return false;
+    }
+    
+    // Lower case letters and digits of a name, so "Edge Detection", "edge_detection" and
+    // "EdgeDetection" compare equal
+    static string normalizedName(const string& name) {
+        string normalized;
+        for (char c : name) {
+            if (isalnum(static_cast<unsigned char>(c))) {
+                normalized += static_cast<char>(tolower(static_cast<unsigned char>(c)));
+            }
+        }
+        return normalized;
+    }
+    
+    // Split a line at whitespace; double quotes group words, e.g. lutPath="my grade.cube"
+    static vector<string> splitWords(const string& line) {
+        vector<string> words;
+        string word;
+        bool quoted = false, inWord = false;
+        for (char c : line) {
+            if (c == '"') {
+                quoted = !quoted;
+                inWord = true;
+            } else if (!quoted && isspace(static_cast<unsigned char>(c))) {
+                if (inWord) words.push_back(word);
+                word.clear();
+                inWord = false;
+            } else {
+                word += c;
+                inWord = true;
+            }
+        }
+        if (inWord) words.push_back(word);
+        return words;
+    }
+    
+    // Parse a pipeline description into operations. Every line is one operation: its name as
+    // shown in the history (case, spaces and punctuation ignored, e.g. "brightness contrast")
+    // or the name of a plugin operation, followed by key=value parameters. Keys are the
+    // EditParams field names, or the parameter names of a plugin. Lists are comma separated
+    // (edgeColor=0,0,1, curveMaster=0,0,0.5,0.6,1,1), and region=x,y,width,height restricts
+    // an operation to a region or gives the rectangle of a crop. Blank lines and lines
+    // starting with '#' are skipped. Returns false with `error` set on the first bad line
+    static bool parsePipeline(const string& text, vector<RecordedOp>& ops, string& error) {
+        ops.clear();
+        stringstream stream(text);
+        string line;
+        int lineNumber = 0;
+        
+        while (getline(stream, line)) {
+            lineNumber++;
+            vector<string> words = splitWords(line);
+            if (words.empty() || words[0][0] == '#') continue;
+            string where = "line " + to_string(lineNumber) + ": ";
+            
+            // Built-in operations first, then plugins
+            RecordedOp op{OP_GRAYSCALE, EditParams(), Rect()};
+            bool known = false;
+            for (int kind = OP_GRAYSCALE; kind < OP_PLUGIN; kind++) {
+                if (normalizedName(operationName(static_cast<OperationKind>(kind))) == normalizedName(words[0])) {
+                    op.kind = static_cast<OperationKind>(kind);
+                    known = true;
+                    break;
+                }
+            }
+            const IEOperation* plugin = nullptr;
+            if (!known) {
+                for (const IEOperation* candidate : PluginRegistry::instance().operations()) {
+                    if (normalizedName(candidate->name) == normalizedName(words[0])) plugin = candidate;
+                }
+                if (!plugin) {
+                    error = where + "unknown operation " + words[0];
+                    return false;
+                }
+                op.kind = OP_PLUGIN;
+                op.params.pluginName = plugin->name;
+                for (int i = 0; i < plugin->param_count; i++) {
+                    op.params.pluginValues[i] = plugin->params[i].default_value;
+                }
+            }
+            
+            for (size_t i = 1; i < words.size(); i++) {
+                size_t equals = words[i].find('=');
+                if (equals == string::npos) {
+                    error = where + "expected key=value, got " + words[i];
+                    return false;
+                }
+                string key = words[i].substr(0, equals);
+                string value = words[i].substr(equals + 1);
+                int pluginParam = -1;
+                for (int p = 0; plugin && p < plugin->param_count; p++) {
+                    if (normalizedName(plugin->params[p].name) == normalizedName(key)) pluginParam = p;
                 }
-                break;
                 
-            case 4: // Difference
-                // Difference blend mode: result = |a - b|
-                result = Mat::zeros(workingImage.size(), workingImage.type());
-                for (int y = 0; y < workingImage.rows; y++) {
-                    for (int x = 0; x < workingImage.cols; x++) {
-                        Vec3b a = workingImage.at<Vec3b>(y, x);
-                        Vec3b b = blendImage.at<Vec3b>(y, x);
-                        
-                        // Apply difference blend mode
-                        Vec3b c;
-                        c[0] = abs(a[0] - b[0]);
-                        c[1] = abs(a[1] - b[1]);
-                        c[2] = abs(a[2] - b[2]);
-                        
-                        // Apply opacity
-                        result.at<Vec3b>(y, x) = a * (1.0 - params.blendOpacity) + c * params.blendOpacity;
+                bool valid = false;
+                if (key == "region") {
+                    vector<float> numbers;
+                    valid = parseNumbers(value, numbers) && numbers.size() == 4 && inRange(numbers, 0.0f, 1e9f) &&
+                            numbers[2] >= 1.0f && numbers[3] >= 1.0f;
+                    if (valid) {
+                        op.region = Rect(cvRound(numbers[0]), cvRound(numbers[1]), cvRound(numbers[2]), cvRound(numbers[3]));
                     }
+                } else if (paramSetters().count(key)) {
+                    valid = paramSetters().at(key)(op.params, value);
+                } else if (pluginParam >= 0) {
+                    vector<float> numbers;
+                    valid = parseNumbers(value, numbers) && numbers.size() == 1 && pluginValueValid(plugin->params[pluginParam], numbers[0]);
+                    if (valid) op.params.pluginValues[pluginParam] = numbers[0];
+                } else {
+                    error = where + "unknown parameter " + key;
+                    return false;
                 }
-                break;
+                if (!valid) {
+                    error = where + "invalid value for " + key + ": " + value;
+                    return false;
+                }
+            }
+            
+            if (op.kind == OP_CROP && op.region.area() <= 0) {
+                error = where + "a crop needs region=x,y,width,height";
+                return false;
+            }
+            for (int p = 0; plugin && p < plugin->param_count; p++) {
+                // Also covers values given as a pluginValues list
+                if (!pluginValueValid(plugin->params[p], op.params.pluginValues[p])) {
+                    error = where + "invalid value for " + plugin->params[p].name + ": " + to_string(op.params.pluginValues[p]);
+                    return false;
+                }
+            }
+            ops.push_back(op);
         }
-        
-        // Update the working image
-        workingImage = result.clone();
-        
-        // Update the texture
-        updateTexture();
+        return true;
     }
     
-    // Apply noise to the image
-    void applyNoise() {
-        if (workingImage.empty()) {
-            cout << "No image loaded yet." << endl;
-            return;
-        }
-        
-        // Add current state to history before applying changes
-        addToHistory(workingImage);
-        
-        // Create a noise pattern
-        Mat noisePattern = Mat::zeros(workingImage.size(), CV_32F);
-        
-        // Generate noise based on selected type
-        switch (params.noiseType) {
-            case 0: // Perlin noise
-                generatePerlinNoise(noisePattern, params.noiseScale);
-                break;
-            case 1: // Simplex noise
-                generateSimplexNoise(noisePattern, params.noiseScale);
-                break;
-            case 2: // Worley noise
-                generateWorleyNoise(noisePattern, params.noiseScale);
-                break;
-            case 3: // Value noise
-                generateValueNoise(noisePattern, params.noiseScale);
-                break;
-            case 4: // Fractal Brownian Motion
-                generateFBMNoise(noisePattern, params.noiseScale, params.noiseOctaves, 
-                                params.noisePersistence, params.noiseLacunarity);
+    // Run one recorded operation on the working image with the parameters and region it was recorded with
+    void executeOperation(const RecordedOp& op) {
+        EditParams savedParams = params;
+        bool savedRegionActive = regionActive;
+        Rect savedRegionRect = regionRect;
+        
+        params = op.params;
+        regionActive = op.kind != OP_CROP && op.region.area() > 0;
+        regionRect = op.region;
+        
+        switch (op.kind) {
+            case OP_GRAYSCALE: applyGrayscale(); break;
+            case OP_SHARPEN: applySharpen(); break;
+            case OP_INVERT: applyInvert(); break;
+            case OP_EDGE_DETECTION: applyEdgeDetection(); break;
+            case OP_BLUR: applyBlur(); break;
+            case OP_THRESHOLD: applyThreshold(); break;
+            case OP_BLEND: applyBlend(); break;
+            case OP_NOISE: applyNoise(); break;
+            case OP_CONVOLUTION: applyConvolution(); break;
+            case OP_ROTATE: applyRotation(); break;
+            case OP_BRIGHTNESS_CONTRAST: applyBrightnessContrast(); break;
+            case OP_COLOR_LUT: applyColorLut(); break;
+            case OP_CURVES_LEVELS: applyCurvesLevels(); break;
+            case OP_SMOOTH: applySmooth(); break;
+            case OP_MORPHOLOGY: applyMorphology(); break;
+            case OP_RESIZE: applyResize(); break;
+            case OP_MEDIAN: applyMedian(); break;
+            case OP_EQUALIZE: applyEqualize(); break;
+            case OP_PLUGIN: applyPlugin(); break;
+            case OP_CROP: {
+                // Recorded crops are clipped to images of another size
+                Rect rect = op.region & Rect(Point(), workingImage.size());
+                if (rect.area() > 0) {
+                    cropTo(rect);
+                }
                 break;
+            }
         }
         
-        // Normalize noise to 0-1 range
-        normalize(noisePattern, noisePattern, 0, 1, NORM_MINMAX);
-        
-        // Invert if needed
-        if (params.noiseInvert) {
-            noisePattern = 1.0 - noisePattern;
-        }
-        
-        // Apply amplitude
-        noisePattern *= params.noiseAmplitude;
-        
-        // Convert noise to BGR if colorize is enabled
-        Mat noiseBGR;
-        if (params.noiseColorize) {
-            noiseBGR = Mat::zeros(workingImage.size(), CV_8UC3);
-            for (int y = 0; y < noisePattern.rows; y++) {
-                for (int x = 0; x < noisePattern.cols; x++) {
-                    float value = noisePattern.at<float>(y, x);
-                    noiseBGR.at<Vec3b>(y, x)[0] = static_cast<uchar>(params.noiseColor[0] * value * 255); // B
-                    noiseBGR.at<Vec3b>(y, x)[1] = static_cast<uchar>(params.noiseColor[1] * value * 255); // G
-                    noiseBGR.at<Vec3b>(y, x)[2] = static_cast<uchar>(params.noiseColor[2] * value * 255); // R
-                }
+        params = savedParams;
+        regionActive = savedRegionActive;
+        regionRect = savedRegionRect;
+    }
+    
+    // Replay recorded operations on `source` in batch mode and return the result.
+    // The editor's own image, parameters, history and region are left untouched, also when
+    // an operation throws
+    Mat runPipeline(const Mat& source, const vector<RecordedOp>& ops) {
+        Mat savedWorkingImage = workingImage;
+        EditParams savedParams = params;
+        bool savedRegionActive = regionActive;
+        Rect savedRegionRect = regionRect;
+        workingImage = source.clone();
+        invalidateDerivedPlanes();
+        batchMode = true;
+        
+        try {
+            for (const RecordedOp& op : ops) {
+                executeOperation(op);
             }
-        } else {
-            // Convert to grayscale
-            noisePattern.convertTo(noiseBGR, CV_8UC1, 255.0);
-            cvtColor(noiseBGR, noiseBGR, COLOR_GRAY2BGR);
+        } catch (...) {
+            workingImage = savedWorkingImage;
+            params = savedParams;
+            regionActive = savedRegionActive;
+            regionRect = savedRegionRect;
+            invalidateDerivedPlanes();
+            batchMode = false;
+            throw;
         }
         
-        // Blend with original image
-        Mat result;
-        addWeighted(workingImage, 1.0 - params.noiseAmplitude, noiseBGR, params.noiseAmplitude, 0, result);
-        
-        // Update the working image
-        workingImage = result.clone();
-        
-        // Update the texture
-        updateTexture();
+        Mat result = workingImage;
+        workingImage = savedWorkingImage;
+        invalidateDerivedPlanes();
+        batchMode = false;
+        return result;
     }
     
-    // Generate Perlin noise
-    void generatePerlinNoise(Mat& noise, float scale) {
-        // Simple implementation of Perlin noise
-        for (int y = 0; y < noise.rows; y++) {
-            for (int x = 0; x < noise.cols; x++) {
-                float nx = x / scale;
-                float ny = y / scale;
-                
-                // Simple 2D Perlin noise approximation
-                float value = 0.5f * (1.0f + sin(nx) * cos(ny));
-                noise.at<float>(y, x) = value;
+    // Convolution kernel of a recorded operation with its scale folded in
+    static Mat recordedKernel(const EditParams& p) {
+        Mat kernel(p.kernelSize, p.kernelSize, CV_32F);
+        for (int i = 0; i < p.kernelSize; i++) {
+            for (int j = 0; j < p.kernelSize; j++) {
+                kernel.at<float>(i, j) = p.kernel[i * p.kernelSize + j] * p.kernelScale;
             }
         }
+        return kernel;
     }
     
-    // Generate Simplex noise
-    void generateSimplexNoise(Mat& noise, float scale) {
-        // Simple implementation of Simplex noise
-        for (int y = 0; y < noise.rows; y++) {
-            for (int x = 0; x < noise.cols; x++) {
-                float nx = x / scale;
-                float ny = y / scale;
-                
-                // Simple 2D Simplex noise approximation
-                float value = 0.5f * (1.0f + sin(nx + ny) * cos(nx - ny));
-                noise.at<float>(y, x) = value;
+    // Gaussian sigma of a recorded blur, using OpenCV's rule when it derives sigma from the kernel size
+    static double recordedSigma(const EditParams& p) {
+        if (p.blurSigma > 0.0f) return p.blurSigma;
+        int kernelSize = static_cast<int>(p.gaussianBlurRadius) * 2 + 1;
+        return 0.3 * ((kernelSize - 1) * 0.5 - 1) + 0.8;
+    }
+    
+    // Whether a recorded operation leaves an image of size `frame` unchanged
+    static bool isIdentityOperation(const RecordedOp& op, Size frame) {
+        const EditParams& p = op.params;
+        switch (op.kind) {
+            case OP_ROTATE:
+                return fmod(p.rotationAngle, 360.0f) == 0.0f && p.rotationScale == 100.0f;
+            case OP_BRIGHTNESS_CONTRAST:
+                return p.brightness == 0.0f && p.contrast == 100.0f;
+            case OP_COLOR_LUT:
+                return p.lutStrength == 0.0f;
+            case OP_CURVES_LEVELS:
+                return isIdentityToneCurve(p);
+            case OP_RESIZE:
+                return resizeTarget(frame, p) == frame;
+            case OP_BLUR:
+                // A 1x1 kernel, Gaussian or directional, copies the image
+                return static_cast<int>(p.gaussianBlurRadius) < 1;
+            case OP_CONVOLUTION: {
+                if (p.kernelOffset != 0.0f) return false;
+                Mat kernel = recordedKernel(p);
+                int center = p.kernelSize / 2;
+                for (int i = 0; i < p.kernelSize; i++) {
+                    for (int j = 0; j < p.kernelSize; j++) {
+                        float expected = (i == center && j == center) ? 1.0f : 0.0f;
+                        if (kernel.at<float>(i, j) != expected) return false;
+                    }
+                }
+                return true;
             }
+            case OP_CROP:
+                return op.region == Rect(Point(), frame);
+            default:
+                return false;
         }
     }
     
-    // Generate Worley noise
-    void generateWorleyNoise(Mat& noise, float scale) {
-        // Simple implementation of Worley noise
-        vector<Point2f> points;
-        int numPoints = static_cast<int>(noise.rows * noise.cols / (scale * scale));
-        
-        // Generate random points
-        for (int i = 0; i < numPoints; i++) {
-            float x = static_cast<float>(rand()) / RAND_MAX * noise.cols;
-            float y = static_cast<float>(rand()) / RAND_MAX * noise.rows;
-            points.push_back(Point2f(x, y));
+    // Operations that only look at one pixel at a time, so a later crop can run before them
+    static bool isWholeImagePointOperation(const RecordedOp& op) {
+        if (op.region.area() > 0) return false;
+        switch (op.kind) {
+            case OP_GRAYSCALE:
+            case OP_INVERT:
+            case OP_BRIGHTNESS_CONTRAST:
+            case OP_COLOR_LUT:
+            case OP_CURVES_LEVELS:
+                return true;
+            case OP_THRESHOLD:
+                return op.params.thresholdMethod == 0;  // Binary only; adaptive and Otsu look around
+            default:
+                return false;
         }
-        
-        // Calculate distance to nearest point
-        for (int y = 0; y < noise.rows; y++) {
-            for (int x = 0; x < noise.cols; x++) {
-                float minDist = FLT_MAX;
-                for (const auto& p : points) {
-                    float dx = x - p.x;
-                    float dy = y - p.y;
-                    float dist = sqrt(dx*dx + dy*dy);
-                    minDist = min(minDist, dist);
+    }
+    
+    // Whether a downscale with `resize` may run before the whole-image operation `op` and give
+    // the same result up to rounding. Resampling is a weighted average, so it commutes with
+    // affine maps, but clipping does not: both orders only agree when neither step clips.
+    // Inversion maps the range onto itself end to end, so it commutes with the clipping of
+    // any filter. Grayscale and brightness/contrast need the Area filter, whose weights are
+    // all positive and cannot overshoot, and brightness/contrast must also map [0, white]
+    // into range
+    static bool commutesWithDownscale(const RecordedOp& op, const RecordedOp& resize) {
+        if (op.region.area() > 0 || resize.region.area() > 0) return false;
+        if (op.kind == OP_INVERT) return true;
+        if (resize.params.resizeFilter != 0) return false;
+        if (op.kind == OP_GRAYSCALE) return true;
+        if (op.kind != OP_BRIGHTNESS_CONTRAST) return false;
+        
+        // On the 8-bit scale of the parameters, as brightnessContrastOp applies them
+        double alpha = op.params.contrast / 100.0;
+        double beta = op.params.brightness;
+        double black = beta;
+        double white = alpha * 255.0 + beta;
+        return std::min(black, white) >= 0.0 && std::max(black, white) <= 255.0;
+    }
+    
+    // Size of the image after `op` ran on an image of `frame`
+    static Size frameAfter(const RecordedOp& op, Size frame) {
+        if (op.kind == OP_CROP) {
+            return (op.region & Rect(Point(), frame)).size();
+        }
+        if (op.kind == OP_ROTATE && op.region.area() == 0) {
+            rotationTransform(frame, op.params, frame);
+        } else if (op.kind == OP_RESIZE) {
+            frame = resizeTarget(frame, op.params);
+        }
+        return frame;
+    }
+    
+    // Fold `op` into the operation before it when both can be expressed as one.
+    // Merges are exact up to the rounding and clipping the intermediate image would have had
+    static bool mergeOperations(RecordedOp& previous, const RecordedOp& op) {
+        if (previous.kind != op.kind || previous.region != op.region) return false;
+        EditParams& merged = previous.params;
+        const EditParams& p = op.params;
+        
+        switch (op.kind) {
+            case OP_ROTATE:
+                // Both rotate and scale about the centre of an image that keeps its size
+                if (merged.rotationExpandCanvas || p.rotationExpandCanvas) return false;
+                merged.rotationAngle = fmod(merged.rotationAngle + p.rotationAngle, 360.0f);
+                merged.rotationScale = merged.rotationScale * p.rotationScale / 100.0f;
+                return true;
+            
+            case OP_BRIGHTNESS_CONTRAST: {
+                // a2 * (a1 * x + b1) + b2
+                float alpha = merged.contrast / 100.0f;
+                float nextAlpha = p.contrast / 100.0f;
+                merged.contrast = alpha * nextAlpha * 100.0f;
+                merged.brightness = nextAlpha * merged.brightness + p.brightness;
+                return true;
+            }
+            
+            case OP_BLUR: {
+                // Gaussians compose into a Gaussian with the variances added
+                if (merged.useDirectionalBlur || p.useDirectionalBlur) return false;
+                double sigma = sqrt(pow(recordedSigma(merged), 2) + pow(recordedSigma(p), 2));
+                merged.blurSigma = static_cast<float>(sigma);
+                merged.gaussianBlurRadius = static_cast<float>(ceil(3.0 * sigma));
+                return true;
+            }
+            
+            case OP_CONVOLUTION: {
+                // Two correlations are one correlation with the full convolution of the kernels,
+                // as long as the combined kernel still fits the 5x5 kernel storage
+                int combinedSize = merged.kernelSize + p.kernelSize - 1;
+                if (combinedSize > 5) return false;
+                
+                Mat first = recordedKernel(merged);
+                Mat second = recordedKernel(p);
+                Mat combined = Mat::zeros(combinedSize, combinedSize, CV_32F);
+                for (int i = 0; i < first.rows; i++) {
+                    for (int j = 0; j < first.cols; j++) {
+                        for (int k = 0; k < second.rows; k++) {
+                            for (int l = 0; l < second.cols; l++) {
+                                combined.at<float>(i + k, j + l) += first.at<float>(i, j) * second.at<float>(k, l);
+                            }
+                        }
+                    }
                 }
                 
-                // Normalize distance
-                noise.at<float>(y, x) = minDist / (noise.rows * 0.5f);
+                // The first offset passes through the second kernel
+                merged.kernelOffset = merged.kernelOffset * static_cast<float>(cv::sum(second)[0]) + p.kernelOffset;
+                merged.kernelSize = combinedSize;
+                merged.kernelScale = 1.0f;
+                merged.currentPreset = 0;
+                std::fill(merged.kernel, merged.kernel + 25, 0.0f);
+                for (int i = 0; i < combinedSize; i++) {
+                    for (int j = 0; j < combinedSize; j++) {
+                        merged.kernel[i * combinedSize + j] = combined.at<float>(i, j);
+                    }
+                }
+                return true;
             }
+            
+            default:
+                return false;
         }
     }
     
-    // Generate Value noise
-    void generateValueNoise(Mat& noise, float scale) {
-        // Simple implementation of Value noise
-        for (int y = 0; y < noise.rows; y++) {
-            for (int x = 0; x < noise.cols; x++) {
-                float nx = x / scale;
-                float ny = y / scale;
+    // Simplify a recorded operation list for a source image of `sourceSize`: drop operations that
+    // change nothing, cancel or merge neighbouring operations and move crops ahead of point
+    // operations so those run on fewer pixels. Repeats until nothing changes
+    vector<RecordedOp> optimizePipeline(const vector<RecordedOp>& ops, Size sourceSize) {
+        vector<RecordedOp> optimized = ops;
+        bool changed = true;
+        
+        while (changed) {
+            changed = false;
+            Size frame = sourceSize;
+            vector<RecordedOp> next;
+            
+            for (const RecordedOp& op : optimized) {
+                if (isIdentityOperation(op, frame)) {
+                    changed = true;
+                    continue;
+                }
                 
-                // Simple 2D Value noise approximation
-                float value = 0.5f * (1.0f + sin(nx * ny));
-                noise.at<float>(y, x) = value;
+                if (!next.empty() && next.back().region == op.region) {
+                    // A second invert cancels the first, a second grayscale changes nothing
+                    if (op.kind == OP_INVERT && next.back().kind == OP_INVERT) {
+                        next.pop_back();
+                        changed = true;
+                        continue;
+                    }
+                    if (op.kind == OP_GRAYSCALE && next.back().kind == OP_GRAYSCALE) {
+                        changed = true;
+                        continue;
+                    }
+                    if (mergeOperations(next.back(), op)) {
+                        changed = true;
+                        continue;
+                    }
+                }
+                
+                frame = frameAfter(op, frame);
+                next.push_back(op);
+            }
+            
+            // Crop before point operations; the crop rectangle does not depend on them.
+            // Downscale before the point operations it commutes with, which then run on fewer pixels
+            frame = sourceSize;
+            for (size_t i = 0; i < next.size(); i++) {
+                bool hoist = false;
+                if (i > 0 && next[i].kind == OP_CROP) {
+                    hoist = isWholeImagePointOperation(next[i - 1]);
+                } else if (i > 0 && next[i].kind == OP_RESIZE) {
+                    hoist = commutesWithDownscale(next[i - 1], next[i]) && resizeTarget(frame, next[i].params).area() < frame.area();
+                }
+                if (hoist) {
+                    std::swap(next[i - 1], next[i]);
+                    frame = frameAfter(next[i - 1], frame);  // The point operation now at i keeps the size
+                    changed = true;
+                } else {
+                    frame = frameAfter(next[i], frame);
+                }
             }
+            
+            optimized = next;
         }
+        
+        return optimized;
     }
     
-    // Generate Fractal Brownian Motion noise
-    void generateFBMNoise(Mat& noise, float scale, int octaves, float persistence, float lacunarity) {
-        Mat tempNoise = Mat::zeros(noise.size(), CV_32F);
-        float amplitude = 1.0f;
-        float frequency = 1.0f / scale;
-        float maxValue = 0.0f;
-        
-        // Generate base noise
-        generatePerlinNoise(tempNoise, scale);
-        
-        // Initialize result
-        noise = tempNoise.clone() * amplitude;
-        maxValue = amplitude;
+    // Rough cost of an operation per processed pixel, in multiply-adds
+    static double operationCostPerPixel(const RecordedOp& op, Size frame) {
+        const EditParams& p = op.params;
+        int blurKernel = static_cast<int>(p.gaussianBlurRadius) * 2 + 1;
+        int sobelKernel = p.sobelKernelSize | 1;
+        
+        switch (op.kind) {
+            case OP_GRAYSCALE: return 2;
+            case OP_INVERT: return 1;
+            case OP_BRIGHTNESS_CONTRAST: return 1;
+            case OP_CURVES_LEVELS: return 1;
+            case OP_MORPHOLOGY: {
+                // Three comparisons per line pass at any element size; rectangles are two passes
+                int passes = (p.morphShape == 0 ? 2 : 1) * (p.morphOperation >= 2 ? 2 : 1);
+                return 4 * passes;
+            }
+            case OP_RESIZE: return p.resizeFilter == 1 ? 24 : 16;  // Separable taps per output pixel, bounded by the pyramid
+            case OP_MEDIAN: return 40;  // Coarse histogram update and scans per channel, at any radius
+            case OP_EQUALIZE: return 12;  // Colour conversion both ways and four table lookups, at any tile count
+            case OP_PLUGIN: return 8;  // Unknown; a plugin does not declare its cost
+            case OP_SMOOTH: return 24;  // Two box passes on the coefficient grid plus the interpolation, at any radius
+            case OP_COLOR_LUT: return 16;  // Tetrahedral interpolation; large 8-bit frames use a direct lookup
+            case OP_CROP: return 1;
+            case OP_ROTATE: return 8;
+            case OP_SHARPEN: return 9;
+            case OP_CONVOLUTION: return p.kernelSize * p.kernelSize;
+            case OP_BLUR: return p.useDirectionalBlur ? blurKernel * blurKernel : 2 * blurKernel;  // Gaussian is separable
+            case OP_THRESHOLD:
+                if (p.thresholdMethod != 1) return 2;
+                return p.adaptiveMethod == 0 ? 2 * (p.adaptiveBlockSize | 1) + 2 : 16;  // Summed-area tables cost the same at any size
+            case OP_EDGE_DETECTION: return (p.edgeDetectionMethod == 0 ? 2 * sobelKernel * sobelKernel : 20) + (p.overlayEdges ? 4 : 1);
+            case OP_BLEND: return 3;
+            case OP_NOISE:
+                switch (p.noiseType) {
+                    case 2: return frame.area() / (p.noiseScale * p.noiseScale) + 4;  // Worley visits every feature point
+                    case 4: return 4 * p.noiseOctaves + 4;
+                    default: return 8;
+                }
+        }
+        return 1;
+    }
+    
+    // Estimated cost of running `ops` on an image of `sourceSize`, in multiply-adds
+    static double estimatePipelineCost(const vector<RecordedOp>& ops, Size sourceSize) {
+        double cost = 0.0;
+        Size frame = sourceSize;
+        for (const RecordedOp& op : ops) {
+            if (op.kind == OP_CROP) {
+                frame = frameAfter(op, frame);
+                cost += frame.area();
+                continue;
+            }
+            if (op.kind == OP_RESIZE) {
+                cost += frame.area();  // Reading the source, including any pyramid levels
+            }
+            frame = frameAfter(op, frame);
+            double pixels = op.region.area() > 0 ? (op.region & Rect(Point(), frame)).area() : frame.area();
+            cost += pixels * operationCostPerPixel(op, frame);
+        }
+        return cost;
+    }
+    
+    // Replay the recorded operations on other images, saving each result next to its source
+    // as <name>_edited.<ext>. The operation list is optimised for every image before it runs
+    void applyPipelineToImagesDialog() {
+        if (recordedOps.empty()) {
+            cout << "No operations recorded yet." << endl;
+            return;
+        }
         
-        // Add octaves
-        for (int i = 1; i < octaves; i++) {
-            amplitude *= persistence;
-            frequency *= lacunarity;
+        vector<string> paths = ::openFilesDialog();
+        for (const string& path : paths) {
+            Mat loaded = imread(path, IMREAD_ANYDEPTH | IMREAD_COLOR);
+            if (loaded.empty()) {
+                cerr << "Error: Could not open or find the image: " << path << endl;
+                continue;
+            }
+            Mat source = toStorageDepth(loaded);
             
-            // Generate noise at this octave
-            generatePerlinNoise(tempNoise, scale / frequency);
+            vector<RecordedOp> optimized = optimizePipeline(recordedOps, source.size());
+            cout << path << ": " << recordedOps.size() << " steps (~"
+                 << estimatePipelineCost(recordedOps, source.size()) / 1e6 << " M ops) optimized to "
+                 << optimized.size() << " steps (~" << estimatePipelineCost(optimized, source.size()) / 1e6 << " M ops)" << endl;
             
-            // Add to result
-            noise += tempNoise * amplitude;
-            maxValue += amplitude;
+            Mat result;
+            try {
+                result = runPipeline(source, optimized);
+            } catch (const cv::Exception& exception) {
+                cerr << "Failed to process " << path << ": " << exception.what() << endl;
+                continue;
+            }
+            
+            string outputPath = path + "_edited.png";
+            size_t dotPos = path.find_last_of(".");
+            size_t slashPos = path.find_last_of("/\\");
+            if (dotPos != string::npos && (slashPos == string::npos || dotPos > slashPos)) {
+                outputPath = path.substr(0, dotPos) + "_edited" + path.substr(dotPos);
+            }
+            
+            if (imwrite(outputPath, prepareForExport(result, outputPath))) {
+                cout << "Image saved successfully to " << outputPath << endl;
+            } else {
+                cerr << "Failed to save image to " << outputPath << endl;
+            }
         }
-        
-        // Normalize
-        noise /= maxValue;
     }
     
     // Render the ImGui interface
@@ -1328,9 +6100,27 @@ public:
                 if (ImGui::MenuItem("Open Image", "Ctrl+O")) {
                     openImageDialog();
                 }
+                if (ImGui::MenuItem("Open Next Image", nullptr, false, !queuedPaths.empty() && !backgroundLoad)) {
+                    openNextImage();
+                }
+                ImGui::MenuItem("Folder Browser", nullptr, &showFolderBrowser);
                 if (ImGui::MenuItem("Save Image", "Ctrl+S")) {
                     saveImageDialog();
                 }
+                if (ImGui::MenuItem("Apply Pipeline to Images...", nullptr, false, !recordedOps.empty())) {
+                    applyPipelineToImagesDialog();
+                }
+                ImGui::Separator();
+                if (ImGui::BeginMenu("High Bit Depth Storage")) {
+                    // Takes effect for the next 16-bit or float image that is opened
+                    if (ImGui::MenuItem("16-bit Integer", nullptr, !storeHalfFloat)) {
+                        storeHalfFloat = false;
+                    }
+                    if (ImGui::MenuItem("Half Float (FP16)", nullptr, storeHalfFloat)) {
+                        storeHalfFloat = true;
+                    }
+                    ImGui::EndMenu();
+                }
                 ImGui::Separator();
                 if (ImGui::MenuItem("Exit", "Esc")) {
                     // Exit application
@@ -1343,6 +6133,9 @@ public:
                 if (ImGui::MenuItem("Undo", "Ctrl+Z", false, canUndo())) {
                     undo();
                 }
+                if (ImGui::MenuItem("Redo", "Ctrl+Y", false, canRedo())) {
+                    redo();
+                }
                 ImGui::Separator();
                 if (ImGui::MenuItem("Reset", "Ctrl+R")) {
                     resetImage();
@@ -1353,6 +6146,16 @@ public:
             if (ImGui::BeginMenu("View")) {
                 ImGui::MenuItem("Demo Window", nullptr, &showDemoWindow);
                 ImGui::MenuItem("Channel Splitter", nullptr, &showChannelSplitter);
+                ImGui::MenuItem("History", nullptr, &showHistoryBrowser);
+                ImGui::MenuItem("Continuous Rendering", nullptr, &continuousRendering);
+                ImGui::Separator();
+                BufferPool::Settings poolSettings = BufferPool::instance().settings();
+                if (ImGui::MenuItem("Trim Buffer Pool on Low Memory", nullptr, &poolSettings.trimOnMemoryPressure)) {
+                    BufferPool::instance().setSettings(poolSettings);
+                }
+                if (ImGui::MenuItem("Trim Buffer Pool Now")) {
+                    BufferPool::instance().trim();
+                }
                 ImGui::EndMenu();
             }
             
@@ -1366,6 +6169,11 @@ public:
                 ImGui::EndMenu();
             }
             
+            // Render rate indicator: frames drawn during the last second
+            ImGui::SameLine(ImGui::GetWindowWidth() - 320.0f);
+            ImGui::TextDisabled("Render: %d fps%s", static_cast<int>(recentFrames.size()),
+                                isAnimating() ? " (continuous)" : "");
+            
             ImGui::EndMenuBar();
         }
         
@@ -1378,8 +6186,17 @@ public:
         
         // Display the image
         if (imageTexture != 0) {
+            // While previewing a rotation the canvas is the rotated frame, and the image quad
+            // is transformed into it instead of resampling the image on every slider tick
+            bool previewRotation = isPreviewingRotation();
+            Size frame(imageWidth, imageHeight);
+            Mat rotMat;
+            if (previewRotation) {
+                rotMat = rotationTransform(workingImage.size(), params, frame);
+            }
+            
             // Calculate aspect ratio
-            float aspectRatio = static_cast<float>(imageWidth) / static_cast<float>(imageHeight);
+            float aspectRatio = static_cast<float>(frame.width) / static_cast<float>(frame.height);
             
             // Calculate display size while maintaining aspect ratio
             float displayWidth = ImGui::GetContentRegionAvail().x;
@@ -1398,9 +6215,37 @@ public:
             // Store image position and size for crop calculations
             ImVec2 imagePos = ImGui::GetCursorScreenPos();
             ImVec2 imageSize = ImVec2(displayWidth, displayHeight);
+            displayedImageSize = Size(std::max(1, cvRound(displayWidth)), std::max(1, cvRound(displayHeight)));
             
             // Display the image
-            ImGui::Image(reinterpret_cast<ImTextureID>(static_cast<unsigned long long>(imageTexture)), imageSize);
+            GLuint displayTexture = isShowingLivePreview() ? previewTexture : imageTexture;
+            ImTextureID textureId = reinterpret_cast<ImTextureID>(static_cast<unsigned long long>(displayTexture));
+            if (previewRotation) {
+                ImGui::Dummy(imageSize);
+                
+                // Map image corners through the rotation, then from frame to screen coordinates
+                auto toScreen = [&](float x, float y) {
+                    double u = rotMat.at<double>(0, 0) * x + rotMat.at<double>(0, 1) * y + rotMat.at<double>(0, 2);
+                    double v = rotMat.at<double>(1, 0) * x + rotMat.at<double>(1, 1) * y + rotMat.at<double>(1, 2);
+                    return ImVec2(imagePos.x + static_cast<float>(u / frame.width) * imageSize.x,
+                                  imagePos.y + static_cast<float>(v / frame.height) * imageSize.y);
+                };
+                float w = static_cast<float>(imageWidth);
+                float h = static_cast<float>(imageHeight);
+                
+                ImDrawList* draw_list = ImGui::GetWindowDrawList();
+                draw_list->PushClipRect(imagePos, ImVec2(imagePos.x + imageSize.x, imagePos.y + imageSize.y), true);
+                draw_list->AddImageQuad(textureId, toScreen(0, 0), toScreen(w, 0), toScreen(w, h), toScreen(0, h),
+                                        ImVec2(0, 0), ImVec2(1, 0), ImVec2(1, 1), ImVec2(0, 1));
+                draw_list->PopClipRect();
+                draw_list->AddRect(imagePos, ImVec2(imagePos.x + imageSize.x, imagePos.y + imageSize.y),
+                                   IM_COL32(128, 128, 128, 255));
+            } else {
+                ImGui::Image(textureId, imageSize);
+            }
+            if (workingImage.empty() && backgroundLoad) {
+                ImGui::TextColored(ImVec4(1.0f, 0.8f, 0.0f, 1.0f), "Preview - loading full resolution...");
+            }
             
             // Handle crop mode
             if (cropMode) {
@@ -1426,11 +6271,11 @@ public:
                     // Handle mouse events
                     if (ImGui::IsMouseClicked(ImGuiMouseButton_Left)) {
                         isDragging = true;
-                        dragStart = ImVec2(relativeX * imageWidth, relativeY * imageHeight);
+                        dragStart = ImVec2(relativeX * frame.width, relativeY * frame.height);
                         dragEnd = dragStart;
                     } 
                     else if (ImGui::IsMouseDragging(ImGuiMouseButton_Left) && isDragging) {
-                        dragEnd = ImVec2(relativeX * imageWidth, relativeY * imageHeight);
+                        dragEnd = ImVec2(relativeX * frame.width, relativeY * frame.height);
                         
                         // Update crop rectangle
                         cropRect.x = static_cast<int>(std::min(dragStart.x, dragEnd.x));
@@ -1443,12 +6288,12 @@ public:
                         
                         // Convert image coordinates back to screen coordinates for drawing
                         ImVec2 rectMin = ImVec2(
-                            imagePos.x + (std::min(dragStart.x, dragEnd.x) / imageWidth) * imageSize.x,
-                            imagePos.y + (std::min(dragStart.y, dragEnd.y) / imageHeight) * imageSize.y
+                            imagePos.x + (std::min(dragStart.x, dragEnd.x) / frame.width) * imageSize.x,
+                            imagePos.y + (std::min(dragStart.y, dragEnd.y) / frame.height) * imageSize.y
                         );
                         ImVec2 rectMax = ImVec2(
-                            imagePos.x + (std::max(dragStart.x, dragEnd.x) / imageWidth) * imageSize.x,
-                            imagePos.y + (std::max(dragStart.y, dragEnd.y) / imageHeight) * imageSize.y
+                            imagePos.x + (std::max(dragStart.x, dragEnd.x) / frame.width) * imageSize.x,
+                            imagePos.y + (std::max(dragStart.y, dragEnd.y) / frame.height) * imageSize.y
                         );
                         
                         // Draw filled rectangle with semi-transparent color
@@ -1468,10 +6313,34 @@ public:
                     applyCrop();
                 }
                 ImGui::SameLine();
+                if (ImGui::Button("Use as Region", ImVec2(180, 50))) {
+                    useCropAsRegion();
+                }
+                ImGui::SameLine();
                 if (ImGui::Button("Cancel Crop", ImVec2(180, 50))) {
                     cancelCrop();
                 }
+            } else if (regionActive && !previewRotation) {
+                // Outline the region that operations apply to
+                ImDrawList* draw_list = ImGui::GetWindowDrawList();
+                ImVec2 rectMin = ImVec2(
+                    imagePos.x + (static_cast<float>(regionRect.x) / imageWidth) * imageSize.x,
+                    imagePos.y + (static_cast<float>(regionRect.y) / imageHeight) * imageSize.y
+                );
+                ImVec2 rectMax = ImVec2(
+                    imagePos.x + (static_cast<float>(regionRect.x + regionRect.width) / imageWidth) * imageSize.x,
+                    imagePos.y + (static_cast<float>(regionRect.y + regionRect.height) / imageHeight) * imageSize.y
+                );
+                draw_list->AddRect(rectMin, rectMax, IM_COL32(255, 200, 0, 255), 0.0f, ImDrawFlags_None, 2.0f);
+                
+                ImGui::TextColored(ImVec4(1.0f, 0.8f, 0.0f, 1.0f), "Operations apply to the selected region (%d x %d)",
+                                   regionRect.width, regionRect.height);
+                if (ImGui::Button("Clear Region", ImVec2(180, 50))) {
+                    clearRegion();
+                }
             }
+        } else if (backgroundLoad) {
+            ImGui::Text("Loading image...");
         } else {
             ImGui::Text("No image loaded. Use File > Open Image to load an image.");
         }
@@ -1501,6 +6370,8 @@ public:
                 {"Save Image", [this]() { saveImageDialog(); }},
                 {"Reset", [this]() { resetImage(); }},
                 {"Undo", [this]() { undo(); }},
+                {"Redo", [this]() { redo(); }},
+                {"History", [this]() { showHistoryBrowser = true; }},
                 {"Grayscale", [this]() { applyGrayscale(); }},
                 {"Sharpen", [this]() { applySharpen(); }},
                 {"Invert", [this]() { applyInvert(); }},
@@ -1513,9 +6384,19 @@ public:
                 {"Blend", [this]() { activeOperation = BLEND; }},
                 {"Noise", [this]() { activeOperation = NOISE; }},
                 {"Convolution", [this]() { activeOperation = CONVOLUTION; }},
+                {"3D LUT", [this]() { activeOperation = COLOR_LUT; }},
+                {"Curves/Levels", [this]() { activeOperation = CURVES_LEVELS; }},
+                {"Smooth", [this]() { activeOperation = SMOOTH; }},
+                {"Morphology", [this]() { activeOperation = MORPHOLOGY; }},
+                {"Resize", [this]() { activeOperation = RESIZE; }},
+                {"Median", [this]() { activeOperation = MEDIAN; }},
+                {"Equalize", [this]() { activeOperation = EQUALIZE; }},
                 {"Crop Image", [this]() { enterCropMode(); }},
                 {"Split Channels", [this]() { splitImageChannels(); }}
             };
+            for (const IEOperation* op : PluginRegistry::instance().operations()) {
+                buttons.push_back({op->name, [this, op]() { selectPlugin(op); }});
+            }
             
             // Render buttons in a grid with increased spacing and size
             for (size_t i = 0; i < buttons.size(); i++) {
@@ -1615,9 +6496,16 @@ public:
                 const char* noiseTypes[] = { "Perlin", "Simplex", "Worley", "Value", "Fractal Brownian Motion" };
                 const char* kernelSizes[] = { "3x3", "5x5" };
                 const char* presets[] = { "Custom", "Sharpen", "Emboss", "Edge Enhance" };
+                const char* curveChannels[] = { "RGB", "Red", "Green", "Blue" };
+                const char* morphOperations[] = { "Erode", "Dilate", "Open", "Close", "Top-hat", "Black-hat", "Gradient" };
+                const char* morphShapes[] = { "Rectangle", "Line" };
+                const char* lineAngles[] = { "0", "45", "90", "135" };
+                const char* resizeModes[] = { "Percentage", "Longest Side" };
+                const char* resizeFilters[] = { "Area", "Lanczos3", "Mitchell" };
+                const char* equalizeMethods[] = { "Global", "CLAHE" };
+                Size resizedSize;
                 
                 vector<vector<int>> histogram;
-                int maxCount = 0;
                 ImDrawList* draw_list;
                 ImVec2 canvas_pos;
                 ImVec2 canvas_size;
@@ -1625,16 +6513,14 @@ public:
                 int currentSize;
                 float cellWidth;
                 
-                // Calculate histogram if needed for threshold
-                if (activeOperation == THRESHOLD) {
-                    histogram = calculateHistogram();
-                    
-                    // Find maximum value for scaling
-                    for (const auto& channel : histogram) {
-                        for (int count : channel) {
-                            maxCount = max(maxCount, count);
-                        }
+                // Calculate histogram if needed for threshold or curves
+                if (activeOperation == THRESHOLD || activeOperation == CURVES_LEVELS) {
+                    // Binning the whole image is only needed when it changed
+                    if (histogramVersion != imageVersion) {
+                        cachedHistogram = calculateHistogram();
+                        histogramVersion = imageVersion;
                     }
+                    histogram = cachedHistogram;
                 }
                 
                 switch (activeOperation) {
@@ -1676,16 +6562,20 @@ public:
                         ImGui::Text("Rotation Properties");
                         ImGui::Separator();
                         
-                        // Rotation slider
-                        if (ImGui::SliderFloat("Rotation Angle", &params.rotationAngle, 0.0f, 360.0f, "%.1f")) {
-                            updateImage();
-            }
-            
-            ImGui::Spacing();
-            
+                        // The sliders only move the preview; the image is resampled once on apply
+                        ImGui::SliderFloat("Rotation Angle", &params.rotationAngle, 0.0f, 360.0f, "%.1f");
+                        ImGui::SliderFloat("Scale (%)", &params.rotationScale, 10.0f, 300.0f, "%.0f");
+                        ImGui::Checkbox("Expand Canvas", &params.rotationExpandCanvas);
+                        ImGui::TextWrapped("A crop drawn on the preview is applied in the same pass.");
+                        
+                        ImGui::Spacing();
+                        
                         // Apply button
                         if (ImGui::Button("Apply Rotation", ImVec2(220, 50))) {
-                            updateImage();
+                            commitRotation();
+                        }
+                        if (ImGui::Button("Cancel Rotation", ImVec2(220, 50))) {
+                            resetRotation();
                         }
                         break;
                         
@@ -1738,11 +6628,188 @@ public:
                         ImGui::Spacing();
                         
                         // Apply button
-                        if (ImGui::Button("Apply Blur", ImVec2(220, 50))) {
-                applyBlur();
-            }
+                        if (ImGui::Button("Apply Blur", ImVec2(220, 50))) {
+                applyBlur();
+            }
+                        break;
+                        
+                    case SMOOTH:
+                        ImGui::Text("Edge-Preserving Smooth Properties");
+                        ImGui::Separator();
+                        
+                        // Guided filter window and the contrast that counts as an edge
+                        ImGui::SliderInt("Radius", &params.smoothRadius, 1, 100);
+                        ImGui::SliderFloat("Edge Threshold", &params.smoothEdgeThreshold, 1.0f, 100.0f, "%.1f");
+                        ImGui::TextWrapped("Detail with less contrast than the threshold is smoothed; stronger edges are kept.");
+                        
+                        ImGui::Spacing();
+                        
+                        // The preview runs at the size the image is shown at
+                        ImGui::Checkbox("Live Preview", &livePreview);
+                        updateLivePreview();
+                        
+                        // Apply button
+                        if (ImGui::Button("Apply Smooth", ImVec2(220, 50))) {
+                            applySmooth();
+                        }
+                        break;
+                    
+                    case EQUALIZE:
+                        ImGui::Text("Histogram Equalization Properties");
+                        ImGui::Separator();
+                        
+                        ImGui::Combo("Method", &params.equalizeMethod, equalizeMethods, IM_ARRAYSIZE(equalizeMethods));
+                        if (params.equalizeMethod == 1) {
+                            // Tables per block, blended between block centres
+                            ImGui::SliderInt("Tiles", &params.claheTiles, 2, 32);
+                            ImGui::SliderFloat("Clip Limit", &params.claheClipLimit, 1.0f, 10.0f, "%.1f");
+                            ImGui::TextWrapped("More tiles enhance smaller details; a lower clip limit keeps noise and flat areas from being stretched.");
+                        }
+                        ImGui::TextWrapped("Only the luminance is equalized, so colours keep their hue.");
+                        
+                        ImGui::Spacing();
+                        
+                        // The preview runs at the size the image is shown at
+                        ImGui::Checkbox("Live Preview", &livePreview);
+                        updateLivePreview();
+                        
+                        // Apply button
+                        if (ImGui::Button("Apply Equalize", ImVec2(220, 50))) {
+                            applyEqualize();
+                        }
+                        break;
+                    
+                    case MORPHOLOGY:
+                        ImGui::Text("Morphology Properties");
+                        ImGui::Separator();
+                        
+                        ImGui::Combo("Operation", &params.morphOperation, morphOperations, IM_ARRAYSIZE(morphOperations));
+                        ImGui::Combo("Element", &params.morphShape, morphShapes, IM_ARRAYSIZE(morphShapes));
+                        
+                        ImGui::Spacing();
+                        
+                        // Element sizes stay odd so the element is centred; the cost does not depend on them
+                        if (params.morphShape == 0) {
+                            if (ImGui::SliderInt("Width", &params.morphWidth, 1, 401)) {
+                                params.morphWidth |= 1;
+                            }
+                            if (ImGui::SliderInt("Height", &params.morphHeight, 1, 401)) {
+                                params.morphHeight |= 1;
+                            }
+                        } else {
+                            if (ImGui::SliderInt("Length", &params.morphLineLength, 1, 401)) {
+                                params.morphLineLength |= 1;
+                            }
+                            ImGui::Combo("Angle", &params.morphLineAngle, lineAngles, IM_ARRAYSIZE(lineAngles));
+                        }
+                        
+                        ImGui::Spacing();
+                        
+                        // Apply button
+                        if (ImGui::Button("Apply Morphology", ImVec2(220, 50))) {
+                            applyMorphology();
+                        }
+                        break;
+                    
+                    case RESIZE:
+                        ImGui::Text("Resize Properties");
+                        ImGui::Separator();
+                        
+                        ImGui::Combo("Size By", &params.resizeMode, resizeModes, IM_ARRAYSIZE(resizeModes));
+                        if (params.resizeMode == 0) {
+                            ImGui::SliderFloat("Scale (%)", &params.resizeRatio, 1.0f, 300.0f, "%.1f");
+                        } else {
+                            ImGui::InputInt("Longest Side", &params.resizeLongestSide);
+                            params.resizeLongestSide = std::max(params.resizeLongestSide, 1);
+                        }
+                        ImGui::Combo("Filter", &params.resizeFilter, resizeFilters, IM_ARRAYSIZE(resizeFilters));
+                        
+                        if (!workingImage.empty()) {
+                            resizedSize = resizeTarget(workingImage.size(), params);
+                            ImGui::Text("%dx%d -> %dx%d", workingImage.cols, workingImage.rows, resizedSize.width, resizedSize.height);
+                        }
+                        
+                        ImGui::Spacing();
+                        
+                        // Apply button
+                        if (ImGui::Button("Apply Resize", ImVec2(220, 50))) {
+                            applyResize();
+                        }
+                        break;
+                    
+                    case PLUGIN: {
+                        const IEOperation* op = PluginRegistry::instance().find(params.pluginName);
+                        if (!op) {
+                            ImGui::Text("Plugin operation not loaded: %s", params.pluginName.c_str());
+                            break;
+                        }
+                        
+                        ImGui::Text("%s Properties", op->name);
+                        ImGui::Separator();
+                        if (op->description) {
+                            ImGui::TextWrapped("%s", op->description);
+                            ImGui::Spacing();
+                        }
+                        
+                        // Widgets generated from the parameters the plugin declares
+                        for (int i = 0; i < op->param_count; i++) {
+                            const IEParam& param = op->params[i];
+                            float& value = params.pluginValues[i];
+                            switch (param.type) {
+                                case IE_PARAM_FLOAT:
+                                    ImGui::SliderFloat(param.name, &value, param.min_value, param.max_value);
+                                    break;
+                                case IE_PARAM_INT: {
+                                    int whole = static_cast<int>(value);
+                                    if (ImGui::SliderInt(param.name, &whole, static_cast<int>(param.min_value), static_cast<int>(param.max_value))) {
+                                        value = static_cast<float>(whole);
+                                    }
+                                    break;
+                                }
+                                case IE_PARAM_BOOL: {
+                                    bool checked = value != 0.0f;
+                                    if (ImGui::Checkbox(param.name, &checked)) {
+                                        value = checked ? 1.0f : 0.0f;
+                                    }
+                                    break;
+                                }
+                                case IE_PARAM_CHOICE: {
+                                    int choice = static_cast<int>(value);
+                                    if (ImGui::Combo(param.name, &choice, param.choices ? param.choices : "\0")) {
+                                        value = static_cast<float>(choice);
+                                    }
+                                    break;
+                                }
+                            }
+                        }
+                        
+                        ImGui::Spacing();
+                        
+                        // Apply button
+                        string applyLabel = string("Apply ") + op->name;
+                        if (ImGui::Button(applyLabel.c_str(), ImVec2(220, 50))) {
+                            applyPlugin();
+                        }
+                        break;
+                    }
+                    
+                    case MEDIAN:
+                        ImGui::Text("Median / Rank Filter Properties");
+                        ImGui::Separator();
+                        
+                        // The cost is the same at every radius
+                        ImGui::SliderInt("Radius", &params.medianRadius, 1, 100);
+                        ImGui::SliderFloat("Percentile", &params.medianPercentile, 0.0f, 100.0f, "%.0f");
+                        ImGui::TextWrapped("50 is the median; 0 and 100 give the minimum and maximum of the window.");
+                        
+                        ImGui::Spacing();
+                        
+                        // Apply button
+                        if (ImGui::Button("Apply Median", ImVec2(220, 50))) {
+                            applyMedian();
+                        }
                         break;
-                        
+                    
                     case THRESHOLD:
                         ImGui::Text("Threshold Properties");
                         ImGui::Separator();
@@ -1759,15 +6826,25 @@ public:
                             }
                             ImGui::SliderInt("Max Value", &params.thresholdMaxValue, 0, 255);
                         } else if (params.thresholdMethod == 1) { // Adaptive threshold
-                            // Ensure block size is odd
+                            const char* adaptiveMethods[] = { "Gaussian", "Mean", "Sauvola", "Niblack" };
+                            ImGui::Combo("Adaptive Method", &params.adaptiveMethod, adaptiveMethods, IM_ARRAYSIZE(adaptiveMethods));
+                            
+                            // Ensure block size is odd. Methods other than Gaussian cost the same at any size
                             int blockSize = params.adaptiveBlockSize;
                             if (blockSize % 2 == 0) blockSize++;
+                            int maxBlockSize = params.adaptiveMethod == 0 ? 99 : 501;
                             
-                            if (ImGui::SliderInt("Block Size", &blockSize, 3, 99)) {
+                            if (ImGui::SliderInt("Block Size", &blockSize, 3, maxBlockSize)) {
                                 // Ensure it stays odd
                                 params.adaptiveBlockSize = (blockSize % 2 == 0) ? blockSize + 1 : blockSize;
                             }
-                            ImGui::SliderInt("C Value", &params.adaptiveC, -10, 10);
+                            if (params.adaptiveMethod == 2) {
+                                ImGui::SliderFloat("k", &params.sauvolaK, 0.0f, 1.0f, "%.2f");
+                            } else if (params.adaptiveMethod == 3) {
+                                ImGui::SliderFloat("k", &params.niblackK, -1.0f, 1.0f, "%.2f");
+                            } else {
+                                ImGui::SliderInt("C Value", &params.adaptiveC, -10, 10);
+                            }
                             ImGui::SliderInt("Max Value", &params.thresholdMaxValue, 0, 255);
                         } else if (params.thresholdMethod == 2) { // Otsu threshold
                             ImGui::SliderInt("Max Value", &params.thresholdMaxValue, 0, 255);
@@ -1790,60 +6867,31 @@ public:
                         draw_list->AddRectFilled(canvas_pos, ImVec2(canvas_pos.x + canvas_size.x, canvas_pos.y + canvas_size.y), 
                                                 IM_COL32(30, 30, 30, 255));
                         
-                        // Draw histogram bars
+                        // Width of one histogram bin
                         bar_width = canvas_size.x / 256.0f;
                         
-                        // For binary threshold, show grayscale histogram
+                        // For binary threshold, show the luma histogram the threshold compares against
                         if (params.thresholdMethod == 0) {
+                            drawHistogramBars(draw_list, canvas_pos, canvas_size, histogram, 3);
+                            
                             // Draw threshold line
                             float threshold_x = canvas_pos.x + params.thresholdValue * bar_width;
                             draw_list->AddLine(ImVec2(threshold_x, canvas_pos.y), 
                                               ImVec2(threshold_x, canvas_pos.y + canvas_size.y), 
                                               IM_COL32(255, 0, 0, 255), 2.0f);
-                            
-                            // Draw histogram bars
-                            for (int i = 0; i < 256; i++) {
-                                float bar_height = (histogram[0][i] / (float)maxCount) * canvas_size.y;
-                                draw_list->AddRectFilled(
-                                    ImVec2(canvas_pos.x + i * bar_width, canvas_pos.y + canvas_size.y - bar_height),
-                                    ImVec2(canvas_pos.x + (i + 1) * bar_width, canvas_pos.y + canvas_size.y),
-                                    IM_COL32(200, 200, 200, 255)
-                                );
-                            }
                         } else {
                             // For other methods, show color histogram
-                            for (int i = 0; i < 256; i++) {
-                                float bar_height_b = (histogram[0][i] / (float)maxCount) * canvas_size.y / 3.0f;
-                                float bar_height_g = (histogram[1][i] / (float)maxCount) * canvas_size.y / 3.0f;
-                                float bar_height_r = (histogram[2][i] / (float)maxCount) * canvas_size.y / 3.0f;
-                                
-                                // Blue channel
-                                draw_list->AddRectFilled(
-                                    ImVec2(canvas_pos.x + i * bar_width, canvas_pos.y + canvas_size.y - bar_height_b),
-                                    ImVec2(canvas_pos.x + (i + 1) * bar_width, canvas_pos.y + canvas_size.y),
-                                    IM_COL32(0, 0, 255, 255)
-                                );
-                                
-                                // Green channel
-                                draw_list->AddRectFilled(
-                                    ImVec2(canvas_pos.x + i * bar_width, canvas_pos.y + canvas_size.y - bar_height_b - bar_height_g),
-                                    ImVec2(canvas_pos.x + (i + 1) * bar_width, canvas_pos.y + canvas_size.y - bar_height_b),
-                                    IM_COL32(0, 255, 0, 255)
-                                );
-                                
-                                // Red channel
-                                draw_list->AddRectFilled(
-                                    ImVec2(canvas_pos.x + i * bar_width, canvas_pos.y + canvas_size.y - bar_height_b - bar_height_g - bar_height_r),
-                                    ImVec2(canvas_pos.x + (i + 1) * bar_width, canvas_pos.y + canvas_size.y - bar_height_b - bar_height_g),
-                                    IM_COL32(255, 0, 0, 255)
-                                );
-                            }
+                            drawHistogramBars(draw_list, canvas_pos, canvas_size, histogram, -1);
                         }
                         
                         ImGui::EndChild();
                         
                         ImGui::Spacing();
                         
+                        // The preview shares the grayscale planes with the apply
+                        ImGui::Checkbox("Live Preview", &livePreview);
+                        updateLivePreview();
+                        
                         // Apply button
                         if (ImGui::Button("Apply Threshold", ImVec2(220, 50))) {
                             applyThreshold();
@@ -1895,6 +6943,10 @@ public:
                         
                         ImGui::Spacing();
                         
+                        // The preview shares the grayscale and gradient planes with the apply
+                        ImGui::Checkbox("Live Preview", &livePreview);
+                        updateLivePreview();
+                        
                         // Apply button
                         if (ImGui::Button("Apply Edge Detection", ImVec2(220, 50))) {
                             applyEdgeDetection();
@@ -1941,6 +6993,77 @@ public:
                         }
                         break;
                         
+                    case COLOR_LUT:
+                        ImGui::Text("3D LUT Properties");
+                        ImGui::Separator();
+                        
+                        // LUT file selection
+                        ImGui::Text("LUT File (.cube):");
+                        if (params.lutPath.empty()) {
+                            ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "No LUT selected");
+                        } else {
+                            ImGui::Text("%s", params.lutPath.c_str());
+                            if (colorLut && colorLutPath == params.lutPath) {
+                                int n = colorLut->latticeSize();
+                                ImGui::Text("Lattice: %dx%dx%d", n, n, n);
+                            }
+                        }
+                        
+                        if (ImGui::Button("Select LUT File", ImVec2(180, 50))) {
+                            string path = openFileDialog();
+                            if (!path.empty()) {
+                                params.lutPath = path;
+                                colorLutFor(path);  // Parse now so errors and the lattice size show up
+                            }
+                        }
+                        
+                        ImGui::Spacing();
+                        
+                        // Strength slider
+                        ImGui::SliderFloat("Strength", &params.lutStrength, 0.0f, 1.0f, "%.2f");
+                        
+                        ImGui::Spacing();
+                        
+                        // Apply button
+                        if (ImGui::Button("Apply LUT", ImVec2(220, 50))) {
+                            applyColorLut();
+                        }
+                        break;
+                    
+                    case CURVES_LEVELS:
+                        ImGui::Text("Curves and Levels Properties");
+                        ImGui::Separator();
+                        
+                        // Levels run first, then the master curve, then the colour curves
+                        ImGui::Text("Levels:");
+                        ImGui::SliderFloat("Black Point", &params.levelsBlack, 0.0f, 254.0f, "%.0f");
+                        ImGui::SliderFloat("White Point", &params.levelsWhite, 1.0f, 255.0f, "%.0f");
+                        ImGui::SliderFloat("Gamma", &params.levelsGamma, 0.1f, 10.0f, "%.2f");
+                        params.levelsWhite = std::max(params.levelsWhite, params.levelsBlack + 1.0f);
+                        
+                        ImGui::Spacing();
+                        
+                        // Curve editor over the channel's histogram
+                        ImGui::Combo("Curve", &curveChannel, curveChannels, IM_ARRAYSIZE(curveChannels));
+                        drawCurveEditor(histogram);
+                        ImGui::TextWrapped("Click to add or drag a point, right-click to remove one.");
+                        
+                        if (ImGui::Button("Reset Curves and Levels", ImVec2(220, 40))) {
+                            resetCurvesLevels();
+                        }
+                        
+                        ImGui::Spacing();
+                        
+                        // Editing only recompiles the small table; the preview is one lookup pass
+                        ImGui::Checkbox("Live Preview", &livePreview);
+                        updateLivePreview();
+                        
+                        // Apply button
+                        if (ImGui::Button("Apply Curves/Levels", ImVec2(220, 50))) {
+                            applyCurvesLevels();
+                        }
+                        break;
+                    
                     case NOISE:
                         ImGui::Text("Noise Generation Properties");
                         ImGui::Separator();
@@ -1961,6 +7084,15 @@ public:
                             ImGui::SliderFloat("Lacunarity", &params.noiseLacunarity, 1.0f, 4.0f, "%.2f");
                         }
                         
+                        // Worley feature points come from the seed
+                        if (params.noiseType == 2) {
+                            ImGui::InputInt("Seed", &params.noiseSeed);
+                            ImGui::SameLine();
+                            if (ImGui::Button("New Seed")) {
+                                params.noiseSeed = theRNG().uniform(1, 1 << 30);
+                            }
+                        }
+                        
                         ImGui::Spacing();
                         
                         // Invert option
@@ -2049,6 +7181,7 @@ public:
                     ImGui::Separator();
                     
                     ImGui::Text("Draw a rectangle on the image to select the crop area.");
+                    ImGui::Text("Use as Region keeps the image size and limits operations to the rectangle.");
                     
                     ImGui::Spacing();
                     
@@ -2057,6 +7190,10 @@ public:
                         applyCrop();
                     }
                     ImGui::SameLine();
+                    if (ImGui::Button("Use as Region", ImVec2(180, 50))) {
+                        useCropAsRegion();
+                    }
+                    ImGui::SameLine();
                     if (ImGui::Button("Cancel Crop", ImVec2(180, 50))) {
                         cancelCrop();
                     }
@@ -2094,7 +7231,13 @@ public:
             if (!workingImage.empty()) {
                 ImGui::Text("Dimensions: %d x %d", workingImage.cols, workingImage.rows);
                 ImGui::Text("Channels: %d", workingImage.channels());
-                ImGui::Text("Type: %s", workingImage.type() == CV_8UC3 ? "8-bit BGR" : "Other");
+                ImGui::Text("Type: %s", describeStorage(workingImage));
+                if (timeToFullImageMs >= 0.0) {
+                    ImGui::Text("Load Time: first pixel %.0f ms, full image %.0f ms", timeToFirstPixelMs, timeToFullImageMs);
+                }
+                BufferPool::Stats pool = BufferPool::instance().stats();
+                ImGui::Text("Buffer Pool: %.0f%% reused, %.1f MB in use, %.1f MB idle",
+                            pool.hitRate() * 100.0, pool.bytesInUse / 1048576.0, pool.bytesIdle / 1048576.0);
                 
                 // Get file size and format
                 if (!imagePath.empty()) {
@@ -2130,6 +7273,27 @@ public:
             ImGui::EndChild();
         }
         
+        // Recorded operations, with the estimated saving of the optimizer
+        if (ImGui::CollapsingHeader("Pipeline")) {
+            if (recordedOps.empty()) {
+                ImGui::Text("No operations recorded");
+            } else {
+                for (const RecordedOp& op : recordedOps) {
+                    bool inRegion = op.kind != OP_CROP && op.region.area() > 0;
+                    ImGui::BulletText("%s%s", operationName(op.kind), inRegion ? " (region)" : "");
+                }
+                
+                vector<RecordedOp> optimized = optimizePipeline(recordedOps, originalImage.size());
+                ImGui::Text("Estimated cost: %.1f M ops", estimatePipelineCost(recordedOps, originalImage.size()) / 1e6);
+                ImGui::Text("Optimized: %d steps, %.1f M ops", static_cast<int>(optimized.size()),
+                            estimatePipelineCost(optimized, originalImage.size()) / 1e6);
+                
+                if (ImGui::Button("Apply to Images...", ImVec2(180, 50))) {
+                    applyPipelineToImagesDialog();
+                }
+            }
+        }
+        
         ImGui::EndChild();
         
         ImGui::Columns(1);
@@ -2152,6 +7316,49 @@ public:
             ImGui::End();
         }
         
+        if (showFolderBrowser) {
+            drawFolderBrowser();
+        }
+        
+        // History browser: one thumbnail per state, clicking one goes straight to it
+        if (showHistoryBrowser) {
+            ImGui::Begin("History", &showHistoryBrowser);
+            if (workingImage.empty()) {
+                ImGui::Text("No image loaded");
+            }
+            
+            for (size_t state = 0; !workingImage.empty() && state <= historyStack.size(); state++) {
+                ImGui::PushID(static_cast<int>(state));
+                
+                GLuint texture = historyThumbnailTexture(state);
+                ImVec2 thumbnailSize(96.0f, 72.0f);
+                if (texture != 0) {
+                    const Mat& thumbnail = historyThumbnails[state].image;
+                    thumbnailSize.y = 96.0f * thumbnail.rows / thumbnail.cols;
+                    ImGui::Image(reinterpret_cast<ImTextureID>(static_cast<unsigned long long>(texture)), thumbnailSize);
+                } else {
+                    // Not visited since it was stored as a region patch
+                    ImGui::Button("...", thumbnailSize);
+                }
+                bool clicked = ImGui::IsItemClicked();
+                
+                ImGui::SameLine();
+                const char* label = state == 0 ? "Loaded image" : historyStack[state - 1].label;
+                if (state == currentHistoryIndex) {
+                    ImGui::TextColored(ImVec4(1.0f, 0.8f, 0.0f, 1.0f), "%zu. %s (current)", state, label);
+                } else {
+                    ImGui::Text("%zu. %s", state, label);
+                    clicked = clicked || ImGui::IsItemClicked();
+                }
+                
+                if (clicked) {
+                    jumpToState(state);
+                }
+                ImGui::PopID();
+            }
+            ImGui::End();
+        }
+        
         // Help window
         if (showHelpWindow) {
             ImGui::Begin("Help", &showHelpWindow, ImGuiWindowFlags_AlwaysAutoResize);
@@ -2161,6 +7368,9 @@ public:
             ImGui::BulletText("Open Image: Load an image file");
             ImGui::BulletText("Save Image: Save the current image");
             ImGui::BulletText("Reset: Reset the image to its original state");
+            ImGui::BulletText("Undo / Redo: Step backwards or forwards through the history");
+            ImGui::BulletText("History: Browse thumbnails of every state and jump to any of them");
+            ImGui::BulletText("Folder Browser (File menu): Browse thumbnails of a folder and open any image");
             ImGui::Separator();
             ImGui::Text("Image Operations:");
             ImGui::BulletText("Grayscale: Convert image to grayscale");
@@ -2172,11 +7382,17 @@ public:
             ImGui::Text("Crop Operations:");
             ImGui::BulletText("Crop Mode: Enter crop mode");
             ImGui::BulletText("Apply Crop: Apply the selected crop region");
+            ImGui::BulletText("Use as Region: Limit operations to the selected rectangle");
             ImGui::BulletText("Cancel Crop: Cancel the crop operation");
             ImGui::End();
         }
     }
     
+    // Whether the UI is showing something that changes without input
+    bool isAnimating() const {
+        return continuousRendering || showDemoWindow;
+    }
+    
     // Main run loop
     void run() {
         // Initialize GLFW
@@ -2252,19 +7468,62 @@ public:
         // Setup style
         ImGui::StyleColorsDark();
         
+        // Any input or window event marks the UI dirty. These are installed before the
+        // ImGui backend, which chains to them from its own callbacks
+        glfwSetCursorPosCallback(window, [](GLFWwindow*, double, double) { inputArrived = true; });
+        glfwSetMouseButtonCallback(window, [](GLFWwindow*, int, int, int) { inputArrived = true; });
+        glfwSetScrollCallback(window, [](GLFWwindow*, double, double) { inputArrived = true; });
+        glfwSetKeyCallback(window, [](GLFWwindow*, int, int, int, int) { inputArrived = true; });
+        glfwSetCharCallback(window, [](GLFWwindow*, unsigned int) { inputArrived = true; });
+        glfwSetCursorEnterCallback(window, [](GLFWwindow*, int) { inputArrived = true; });
+        glfwSetWindowFocusCallback(window, [](GLFWwindow*, int) { inputArrived = true; });
+        glfwSetWindowRefreshCallback(window, [](GLFWwindow*) { inputArrived = true; });
+        glfwSetFramebufferSizeCallback(window, [](GLFWwindow*, int, int) { inputArrived = true; });
+        
         // Setup Platform/Renderer backends
         ImGui_ImplGlfw_InitForOpenGL(window, true);
         ImGui_ImplOpenGL3_Init("#version 130");
         
-        // If no image is loaded yet, open dialog
+        // Start loading the first image given on the command line, or ask for one.
+        // Both happen in the background while the window already renders
         if (originalImage.empty()) {
-            openImageDialog();
+            if (queuedPaths.empty()) {
+                openImageDialog();
+            } else {
+                openNextImage();
+            }
         }
         
         // Main loop
         while (!glfwWindowShouldClose(window)) {
-            // Poll and handle events
-            glfwPollEvents();
+            // Poll and handle events. With nothing to draw, sleep until an event arrives;
+            // background loads post an empty event when they finish. The timeout is a safety net
+            if (framesToRender > 0 || isAnimating()) {
+                glfwPollEvents();
+            } else {
+                glfwWaitEventsTimeout(backgroundLoad ? 0.1 : 1.0);
+            }
+            
+            if (inputArrived) {
+                inputArrived = false;
+                framesToRender = std::max(framesToRender, 3);
+            }
+            
+            // Show whatever the background load has decoded so far
+            if (pollBackgroundLoad()) {
+                framesToRender = std::max(framesToRender, 3);
+            }
+            if (pollFolderBrowser()) {
+                framesToRender = std::max(framesToRender, 3);
+            }
+            BufferPool::instance().maintain();
+            
+            if (framesToRender == 0 && !isAnimating()) {
+                continue;
+            }
+            if (framesToRender > 0) {
+                framesToRender--;
+            }
             
             // Start the ImGui frame
             ImGui_ImplOpenGL3_NewFrame();
@@ -2284,9 +7543,20 @@ public:
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
             
             glfwSwapBuffers(window);
+            reportFrameTiming();
+            
+            // Keep the frame times of the last second for the render rate indicator
+            auto now = std::chrono::steady_clock::now();
+            recentFrames.push_back(now);
+            while (now - recentFrames.front() > std::chrono::seconds(1)) {
+                recentFrames.pop_front();
+            }
         }
         
-        // Cleanup
+        // Cleanup. The thumbnail and loader threads wake the main loop through GLFW, so they
+        // are joined before it terminates
+        closeFolder();
+        joinLoader();
         ImGui_ImplOpenGL3_Shutdown();
         ImGui_ImplGlfw_Shutdown();
         ImGui::DestroyContext();
@@ -2296,16 +7566,636 @@ public:
     }
 };
 
+#ifndef _WIN32
+// Headless render server for other tools on the same machine. Clients connect to a Unix
+// domain socket and send requests as text lines:
+//
+//     RENDER <input segment> <width> <height> <channels> <8U|16U|32F>
+//     <pipeline description, see ImageEditorGUI::parsePipeline>
+//     END
+//
+// The input pixels are read from the named POSIX shared-memory segment (rows packed, no
+// padding) without being encoded or copied through the socket. The pipeline is optimised
+// and run, and the result is written to a new segment, answered with
+//
+//     OK <output segment> <width> <height> <channels> <8U|16U|32F> <milliseconds>
+//
+// or ERROR <message>. The client owns the output segment and must shm_unlink it. A
+// connection may send any number of requests; `concurrency` of them are served at once,
+// each by its own editor instance, and all of them share the tile scheduler
+class RenderServer {
+public:
+    RenderServer(const string& socketPath, int concurrency)
+        : socketPath(socketPath), concurrency(std::max(1, concurrency)) {}
+    
+    // Serve until the process is stopped; returns an exit code when the socket cannot be set up
+    int run() {
+        // A client that goes away mid-answer must not take the server down
+        signal(SIGPIPE, SIG_IGN);
+        
+        sockaddr_un address{};
+        if (socketPath.size() >= sizeof(address.sun_path)) {
+            cerr << "Socket path too long: " << socketPath << endl;
+            return 1;
+        }
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+        
+        listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(socketPath.c_str());
+        if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            listen(listener, 64) != 0) {
+            cerr << "Cannot listen on " << socketPath << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        // Only the user running the server may connect
+        chmod(socketPath.c_str(), 0600);
+        cout << "Render server listening on " << socketPath << " (" << concurrency << " concurrent requests)" << endl;
+        
+        // Every thread accepts connections itself and serves them one at a time
+        vector<std::thread> threads;
+        for (int i = 0; i < concurrency; i++) {
+            threads.emplace_back([this]() { acceptLoop(); });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        close(listener);
+        unlink(socketPath.c_str());
+        return 0;
+    }
+
+    // Serve the requests of one connected client until it hangs up, with an editor of its own
+    void serve(int client) {
+        auto editor = std::make_unique<ImageEditorGUI>();
+        serveConnection(client, editor);
+    }
+
+private:
+    void acceptLoop() {
+        auto editor = std::make_unique<ImageEditorGUI>();
+        while (true) {
+            int client = accept(listener, nullptr, nullptr);
+            if (client < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                cerr << "Render server stopped accepting: " << strerror(errno) << endl;
+                return;
+            }
+            serveConnection(client, editor);
+            close(client);
+        }
+    }
+    
+    // Read one line from the client, without its newline; false once the client is gone
+    static bool readLine(int client, string& pending, string& line) {
+        while (true) {
+            size_t newline = pending.find('\n');
+            if (newline != string::npos) {
+                line = pending.substr(0, newline);
+                pending.erase(0, newline + 1);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                return true;
+            }
+            char buffer[4096];
+            ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+            if (received < 0 && errno == EINTR) continue;
+            if (received <= 0) return false;
+            pending.append(buffer, static_cast<size_t>(received));
+        }
+    }
+    
+    static bool sendLine(int client, const string& line) {
+        string text = line + "\n";
+        size_t sent = 0;
+        while (sent < text.size()) {
+            ssize_t written = send(client, text.data() + sent, text.size() - sent, 0);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) return false;
+            sent += static_cast<size_t>(written);
+        }
+        return true;
+    }
+    
+    static int depthFromName(const string& name) {
+        if (name == "8U") return CV_8U;
+        if (name == "16U") return CV_16U;
+        if (name == "32F") return CV_32F;
+        return -1;
+    }
+    
+    static const char* depthName(int depth) {
+        switch (depth) {
+            case CV_8U: return "8U";
+            case CV_16U: return "16U";
+            default: return "32F";
+        }
+    }
+    
+    void serveConnection(int client, std::unique_ptr<ImageEditorGUI>& editor) {
+        string pending, line;
+        while (readLine(client, pending, line)) {
+            if (line.empty()) continue;
+            
+            // Header, then the pipeline up to END
+            stringstream header(line);
+            string command, segment, depthText;
+            int width = 0, height = 0, channels = 0;
+            header >> command >> segment >> width >> height >> channels >> depthText;
+            
+            string pipeline;
+            bool complete = false;
+            while (readLine(client, pending, line)) {
+                if (line == "END") {
+                    complete = true;
+                    break;
+                }
+                pipeline += line + "\n";
+            }
+            if (!complete) return;
+            
+            string reply;
+            if (command != "RENDER") {
+                reply = "ERROR unknown command " + command;
+            } else {
+                reply = render(editor, segment, width, height, channels, depthFromName(depthText), pipeline);
+            }
+            if (!sendLine(client, reply)) return;
+        }
+    }
+    
+    // Handle one RENDER request and return the reply line
+    string render(std::unique_ptr<ImageEditorGUI>& editor, const string& segment, int width, int height, int channels, int depth, const string& pipeline) {
+        if (width <= 0 || height <= 0 || (channels != 1 && channels != 3 && channels != 4) || depth < 0) {
+            return "ERROR expected RENDER <segment> <width> <height> <1|3|4> <8U|16U|32F>";
+        }
+        vector<ImageEditorGUI::RecordedOp> ops;
+        string error;
+        if (!ImageEditorGUI::parsePipeline(pipeline, ops, error)) {
+            return "ERROR " + error;
+        }
+        
+        // Map the input; the pipeline copies it before the first operation writes
+        auto start = std::chrono::steady_clock::now();
+        int type = CV_MAKETYPE(depth, channels);
+        size_t inputBytes = static_cast<size_t>(width) * height * CV_ELEM_SIZE(type);
+        int inputFd = shm_open(segment.c_str(), O_RDONLY, 0);
+        struct stat info;
+        if (inputFd < 0 || fstat(inputFd, &info) != 0 || static_cast<size_t>(info.st_size) < inputBytes) {
+            if (inputFd >= 0) close(inputFd);
+            return "ERROR cannot read " + to_string(inputBytes) + " bytes from shared memory " + segment;
+        }
+        void* inputData = mmap(nullptr, inputBytes, PROT_READ, MAP_SHARED, inputFd, 0);
+        close(inputFd);
+        if (inputData == MAP_FAILED) {
+            return "ERROR cannot map shared memory " + segment + ": " + strerror(errno);
+        }
+        
+        // The editor works on BGR at its storage depth, as for images loaded from disk
+        Mat result;
+        try {
+            Mat input(height, width, type, inputData);
+            Mat source;
+            if (channels == 1) {
+                cvtColor(input, source, COLOR_GRAY2BGR);
+            } else if (channels == 4) {
+                cvtColor(input, source, COLOR_BGRA2BGR);
+            } else {
+                source = input;
+            }
+            source = editor->toStorageDepth(source);
+            result = editor->runPipeline(source, editor->optimizePipeline(ops, source.size()));
+        } catch (const std::exception& exception) {
+            // OpenCV errors, failed plugins and allocation failures alike
+            munmap(inputData, inputBytes);
+            // The editor is left mid-pipeline, so the next request gets a fresh one
+            editor = std::make_unique<ImageEditorGUI>();
+            string message = exception.what();
+            std::replace(message.begin(), message.end(), '\n', ' ');
+            return "ERROR " + message;
+        }
+        munmap(inputData, inputBytes);
+        if (result.depth() == CV_16F) {
+            result.convertTo(result, CV_32F);
+        }
+        
+        // Hand the result over in a new segment
+        string output = "/image_editor_" + to_string(getpid()) + "_" + to_string(nextSegment++);
+        size_t outputBytes = result.total() * result.elemSize();
+        int outputFd = shm_open(output.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (outputFd < 0 || ftruncate(outputFd, static_cast<off_t>(outputBytes)) != 0) {
+            if (outputFd >= 0) {
+                close(outputFd);
+                shm_unlink(output.c_str());
+            }
+            return "ERROR cannot create shared memory " + output + ": " + strerror(errno);
+        }
+        void* outputData = mmap(nullptr, outputBytes, PROT_READ | PROT_WRITE, MAP_SHARED, outputFd, 0);
+        close(outputFd);
+        if (outputData == MAP_FAILED) {
+            shm_unlink(output.c_str());
+            return "ERROR cannot map shared memory " + output + ": " + strerror(errno);
+        }
+        result.copyTo(Mat(result.size(), result.type(), outputData));
+        munmap(outputData, outputBytes);
+        
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        cout << "Rendered " << ops.size() << " operations on " << width << "x" << height << " in " << milliseconds << " ms" << endl;
+        
+        stringstream reply;
+        reply << "OK " << output << " " << result.cols << " " << result.rows << " " << result.channels() << " "
+              << depthName(result.depth()) << " " << milliseconds;
+        return reply.str();
+    }
+    
+    string socketPath;
+    int concurrency;
+    int listener = -1;
+    std::atomic<int> nextSegment{0};
+};
+#endif
+
+#ifdef __linux__
+// Watch mode for hot folders that cameras and scanners drop images into. Every image closed
+// after writing (IN_CLOSE_WRITE) or moved into `folder` (IN_MOVED_TO), and every image already
+// there at startup, is run through the pipeline description (see ImageEditorGUI::parsePipeline)
+// and saved under the same name in `outputFolder`. `workers` images are processed at once,
+// each by its own editor, and all of them share the tile scheduler.
+//
+// Back-pressure: at most `queueLimit` images wait for a worker. When the queue is full the
+// watcher stops reading events, so they wait in the kernel instead; if its event queue
+// overflows the folder is scanned again. A file written again while it waits is only
+// processed once.
+//
+// Results are written under a hidden temporary name and renamed, so whatever consumes the
+// output folder never sees a partial file. Files are identified by a hash of their content:
+// content that was already processed (by this run or an earlier one, recorded in the log)
+// is skipped, whatever its name. Every processed file is appended to
+// <outputFolder>/.watch_log.csv with its latency from arrival, split into time spent waiting
+// and time spent reading, processing and writing. Arrival is the file's status change time
+// (st_ctime, set by the write or the move into the folder), so waiting includes the time
+// its event spent in the kernel under back-pressure, not only the time in the queue. Files
+// that were there before the watch started count from the start
+class FolderWatcher {
+public:
+    FolderWatcher(const string& folder, const string& outputFolder, const string& pipeline, int workers, int queueLimit)
+        : folder(folder), outputFolder(outputFolder), pipeline(pipeline), workers(std::max(1, workers)),
+          queueLimit(static_cast<size_t>(std::max(1, queueLimit))) {}
+    
+    // Watch until the process is stopped or the folder goes away; returns the exit code
+    int run() {
+        string error;
+        if (!ImageEditorGUI::parsePipeline(pipeline, ops, error)) {
+            cerr << "Invalid pipeline: " << error << endl;
+            return 1;
+        }
+        
+        std::error_code fsError;
+        if (!std::filesystem::is_directory(folder, fsError)) {
+            cerr << "Not a folder: " << folder << endl;
+            return 1;
+        }
+        std::filesystem::create_directories(outputFolder, fsError);
+        if (std::filesystem::equivalent(folder, outputFolder, fsError)) {
+            cerr << "The output folder must differ from the watched folder." << endl;
+            return 1;
+        }
+        logPath = (std::filesystem::path(outputFolder) / ".watch_log.csv").string();
+        readLog();
+        
+        // Watch before scanning, so a file arriving in between is not missed
+        int notify = inotify_init1(IN_CLOEXEC);
+        if (notify < 0 || inotify_add_watch(notify, folder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF) < 0) {
+            cerr << "Cannot watch " << folder << ": " << strerror(errno) << endl;
+            if (notify >= 0) close(notify);
+            return 1;
+        }
+        cout << "Watching " << folder << " with " << workers << " workers, results in " << outputFolder << endl;
+        watchStarted = std::chrono::system_clock::now();
+        
+        vector<std::thread> threads;
+        for (int i = 0; i < workers; i++) {
+            threads.emplace_back([this]() { workerLoop(); });
+        }
+        scanFolder();
+        
+        alignas(struct inotify_event) char buffer[64 * 1024];
+        bool watching = true;
+        while (watching) {
+            ssize_t length = read(notify, buffer, sizeof(buffer));
+            if (length < 0 && errno == EINTR) continue;
+            if (length <= 0) {
+                cerr << "Stopped watching " << folder << ": " << strerror(errno) << endl;
+                break;
+            }
+            
+            for (char* next = buffer; next < buffer + length;) {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(next);
+                next += sizeof(inotify_event) + event->len;
+                if (event->mask & IN_Q_OVERFLOW) {
+                    cout << "Missed events, scanning " << folder << " again." << endl;
+                    scanFolder();
+                } else if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                    cerr << "The watched folder " << folder << " was removed." << endl;
+                    watching = false;
+                } else if (event->len > 0 && !(event->mask & IN_ISDIR)) {
+                    enqueue((std::filesystem::path(folder) / event->name).string());
+                }
+            }
+        }
+        close(notify);
+        
+        // Let the workers finish what is queued
+        {
+            std::lock_guard<std::mutex> guard(queueLock);
+            stopping = true;
+        }
+        workAvailable.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        return watching ? 1 : 0;
+    }
+
+private:
+    struct Job {
+        string path;
+        std::chrono::system_clock::time_point arrived;
+    };
+    
+    // Images by extension; hidden files are skipped, as other tools write their partial files that way
+    static bool isImageName(const string& name) {
+        if (name.empty() || name[0] == '.') return false;
+        string extension = std::filesystem::path(name).extension().string();
+        transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        return extension == ".jpg" || extension == ".jpeg" || extension == ".png" || extension == ".bmp" ||
+               extension == ".tif" || extension == ".tiff" || extension == ".webp";
+    }
+    
+    // 64-bit FNV-1a over the content, eight bytes at a time, with the size; stable across
+    // builds so the log stays valid
+    static string contentKey(const vector<uchar>& bytes) {
+        uint64_t hash = 14695981039346656037ull;
+        size_t words = bytes.size() / 8;
+        for (size_t i = 0; i < words; i++) {
+            uint64_t word;
+            memcpy(&word, &bytes[i * 8], 8);
+            hash = (hash ^ word) * 1099511628211ull;
+        }
+        for (size_t i = words * 8; i < bytes.size(); i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        char key[48];
+        snprintf(key, sizeof(key), "%016llx,%zu", static_cast<unsigned long long>(hash), bytes.size());
+        return key;
+    }
+    
+    // Content keys of everything an earlier run processed
+    void readLog() {
+        ifstream log(logPath);
+        string line;
+        while (getline(log, line)) {
+            size_t second = line.find(',', line.find(',') + 1);
+            if (second != string::npos && line.compare(0, 4, "hash") != 0) {
+                processed.insert(line.substr(0, second));
+            }
+        }
+        if (!processed.empty()) {
+            cout << processed.size() << " files already processed according to " << logPath << endl;
+        }
+    }
+    
+    void scanFolder() {
+        std::error_code error;
+        vector<string> paths;
+        for (const auto& entry : std::filesystem::directory_iterator(folder, error)) {
+            if (entry.is_regular_file(error)) paths.push_back(entry.path().string());
+        }
+        std::sort(paths.begin(), paths.end());
+        for (const string& path : paths) {
+            enqueue(path);
+        }
+    }
+    
+    // When the file at `path` arrived: its last status change, but not before the watch
+    // started. Wall-clock time, as the kernel stamps files with it
+    std::chrono::system_clock::time_point arrivalTime(const string& path) const {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) {
+            return std::chrono::system_clock::now();
+        }
+        auto changed = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::seconds(info.st_ctim.tv_sec) + std::chrono::nanoseconds(info.st_ctim.tv_nsec)));
+        return std::max(changed, watchStarted);
+    }
+    
+    // Queue an image for the workers, waiting while the queue is full
+    void enqueue(const string& path) {
+        if (!isImageName(std::filesystem::path(path).filename().string())) return;
+        auto arrived = arrivalTime(path);
+        std::unique_lock<std::mutex> guard(queueLock);
+        if (queuedPaths.count(path)) return;  // Its worker reads the latest content anyway
+        spaceAvailable.wait(guard, [this]() { return queue.size() < queueLimit; });
+        queue.push_back({path, arrived});
+        queuedPaths.insert(path);
+        guard.unlock();
+        workAvailable.notify_one();
+    }
+    
+    void workerLoop() {
+        auto editor = std::make_unique<ImageEditorGUI>();
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> guard(queueLock);
+                workAvailable.wait(guard, [this]() { return stopping || !queue.empty(); });
+                if (queue.empty()) return;
+                job = queue.front();
+                queue.pop_front();
+                queuedPaths.erase(job.path);
+            }
+            spaceAvailable.notify_one();
+            process(editor, job);
+        }
+    }
+    
+    // Process one file. Whatever fails on the way (decoding, the pipeline, encoding, the
+    // filesystem, memory) is reported and the file may be retried once written again
+    void process(std::unique_ptr<ImageEditorGUI>& editor, const Job& job) {
+        string key;
+        try {
+            processFile(editor, job, key);
+        } catch (const std::exception& exception) {
+            // The editor may be left mid-pipeline, so the next file gets a fresh one
+            editor = std::make_unique<ImageEditorGUI>();
+            cerr << "Failed to process " << job.path << ": " << exception.what() << endl;
+            if (!key.empty()) forget(key);
+        }
+    }
+    
+    // Let content be processed again after a failure
+    void forget(const string& key) {
+        std::lock_guard<std::mutex> guard(logLock);
+        processed.erase(key);
+    }
+    
+    // Read, process and write one file; `key` is set once its content is claimed
+    void processFile(std::unique_ptr<ImageEditorGUI>& editor, const Job& job, string& key) {
+        auto startedClock = std::chrono::system_clock::now();
+        auto started = std::chrono::steady_clock::now();
+        string name = std::filesystem::path(job.path).filename().string();
+        
+        // Read once: the same bytes are hashed and decoded
+        ifstream file(job.path, std::ios::binary);
+        vector<uchar> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (bytes.empty()) {
+            cerr << "Error: Could not read " << job.path << endl;
+            return;
+        }
+        string contentId = contentKey(bytes);
+        {
+            std::lock_guard<std::mutex> guard(logLock);
+            if (!processed.insert(contentId).second) {
+                cout << name << ": already processed, skipped." << endl;
+                return;
+            }
+        }
+        key = contentId;
+        
+        Mat loaded = imdecode(bytes, IMREAD_ANYDEPTH | IMREAD_COLOR);
+        if (loaded.empty()) {
+            cerr << "Error: Could not decode the image: " << job.path << endl;
+            forget(key);
+            return;
+        }
+        Mat source = editor->toStorageDepth(loaded);
+        Mat result = editor->runPipeline(source, editor->optimizePipeline(ops, source.size()));
+        
+        std::filesystem::path output = std::filesystem::path(outputFolder) / name;
+        std::filesystem::path temporary = std::filesystem::path(outputFolder) /
+            ("." + output.stem().string() + ".partial" + to_string(nextTemporary++) + output.extension().string());
+        std::error_code error;
+        if (!imwrite(temporary.string(), editor->prepareForExport(result, output.string()))) {
+            cerr << "Failed to save image to " << output.string() << endl;
+            std::filesystem::remove(temporary, error);
+            forget(key);
+            return;
+        }
+        std::filesystem::rename(temporary, output, error);
+        if (error) {
+            cerr << "Failed to save image to " << output.string() << ": " << error.message() << endl;
+            std::filesystem::remove(temporary, error);
+            forget(key);
+            return;
+        }
+        
+        auto finished = std::chrono::steady_clock::now();
+        auto ms = [](auto duration) {
+            return std::chrono::duration<double, std::milli>(duration).count();
+        };
+        double waitingMs = std::max(0.0, ms(startedClock - job.arrived));
+        double processingMs = ms(finished - started);
+        double totalMs = waitingMs + processingMs;
+        cout << name << ": " << totalMs << " ms from arrival (" << waitingMs << " ms waiting, " << processingMs << " ms processing)" << endl;
+        
+        std::lock_guard<std::mutex> guard(logLock);
+        bool newLog = !std::filesystem::exists(logPath, error);
+        ofstream log(logPath, std::ios::app);
+        if (newLog) {
+            log << "hash,bytes,file,waiting_ms,processing_ms,total_ms\n";
+        }
+        log << key << "," << name << "," << waitingMs << "," << processingMs << "," << totalMs << "\n";
+    }
+    
+    string folder;
+    string outputFolder;
+    string pipeline;
+    int workers;
+    size_t queueLimit;
+    vector<ImageEditorGUI::RecordedOp> ops;
+    string logPath;
+    std::chrono::system_clock::time_point watchStarted;
+    
+    std::mutex queueLock;
+    std::condition_variable workAvailable;
+    std::condition_variable spaceAvailable;
+    deque<Job> queue;
+    std::set<string> queuedPaths;
+    bool stopping = false;
+    
+    std::mutex logLock;
+    std::set<string> processed;   // Content keys of files processed or being processed
+    std::atomic<int> nextTemporary{0};
+};
+#endif
+
 // Main function
+#ifndef IMAGE_EDITOR_NO_MAIN
 int main(int argc, char* argv[]) {
-    string imagePath = "";
-
+    // Recycle large pixel buffers across operations and frames
+    Mat::setDefaultAllocator(&BufferPool::instance());
+    
+    // Operations from plugin libraries get their buttons next to the built-in ones
+    PluginRegistry::instance().loadDirectory(PluginRegistry::defaultDirectory(argv[0]));
+    
+#ifndef _WIN32
+    // --serve <socket> [--concurrency <n>] runs the headless render server instead of the window
+    if (argc > 2 && string(argv[1]) == "--serve") {
+        int concurrency = 2;
+        if (argc > 4 && string(argv[3]) == "--concurrency") {
+            concurrency = atoi(argv[4]);
+        }
+        RenderServer server(argv[2], concurrency);
+        return server.run();
+    }
+#endif
+#ifdef __linux__
+    // --watch <folder> --output <folder> --pipeline <file> [--workers <n>] [--queue <n>]
+    // processes every image dropped into the folder instead of opening the window
+    if (argc > 2 && string(argv[1]) == "--watch") {
+        string outputFolder, pipelinePath;
+        int workers = 2;
+        int queueLimit = 64;
+        for (int i = 3; i + 1 < argc; i += 2) {
+            string option = argv[i];
+            if (option == "--output") {
+                outputFolder = argv[i + 1];
+            } else if (option == "--pipeline") {
+                pipelinePath = argv[i + 1];
+            } else if (option == "--workers") {
+                workers = atoi(argv[i + 1]);
+            } else if (option == "--queue") {
+                queueLimit = atoi(argv[i + 1]);
+            } else {
+                cerr << "Unknown option " << option << endl;
+                return 1;
+            }
+        }
+        if (outputFolder.empty() || pipelinePath.empty()) {
+            cerr << "--watch needs --output <folder> and --pipeline <file>" << endl;
+            return 1;
+        }
+        
+        ifstream pipelineFile(pipelinePath);
+        if (!pipelineFile) {
+            cerr << "Cannot read the pipeline " << pipelinePath << endl;
+            return 1;
+        }
+        stringstream pipeline;
+        pipeline << pipelineFile.rdbuf();
+        FolderWatcher watcher(argv[2], outputFolder, pipeline.str(), workers, queueLimit);
+        return watcher.run();
+    }
+#endif
+    
+    // Image paths may be given on the command line; the first one is opened at startup
+    vector<string> imagePaths(argv + 1, argv + argc);
     
     // Create an instance of the editor
-    ImageEditorGUI editor(imagePath);
+    ImageEditorGUI editor(imagePaths);
     
     // Start the application
     editor.run();
     
     return 0;
-}
\ No newline at end of file
+}
+#endif
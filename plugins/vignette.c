@@ -0,0 +1,81 @@
+/*
+ * Example operation plugin: darkens the image towards its corners.
+ * Built by CMake into the "plugins" folder next to the editor.
+ */
+#include "image_editor_plugin.h"
+
+#include <math.h>
+
+enum { STRENGTH, RADIUS, FEATHER, SHAPE };
+
+static const IEParam vignetteParams[] = {
+    {"Strength", IE_PARAM_FLOAT, 0.0f, 1.0f, 0.6f, NULL},
+    {"Radius", IE_PARAM_FLOAT, 0.1f, 1.5f, 0.7f, NULL},
+    {"Feather", IE_PARAM_FLOAT, 0.01f, 1.0f, 0.5f, NULL},
+    {"Shape", IE_PARAM_CHOICE, 0.0f, 0.0f, 0.0f, "Circle\0Ellipse\0"}
+};
+
+/* Darkening factor at image position (x, y): 1 inside the radius, falling off smoothly
+ * over the feather width. Distances are relative to half the image diagonal for the
+ * circle and to half the width and height for the ellipse */
+static float vignetteFactor(int x, int y, const IETile* tile, const float* values) {
+    float halfWidth = tile->image_width * 0.5f;
+    float halfHeight = tile->image_height * 0.5f;
+    float dx = x + 0.5f - halfWidth;
+    float dy = y + 0.5f - halfHeight;
+    float distance;
+    if (values[SHAPE] == 0.0f) {
+        distance = sqrtf(dx * dx + dy * dy) / sqrtf(halfWidth * halfWidth + halfHeight * halfHeight);
+    } else {
+        distance = sqrtf((dx * dx) / (halfWidth * halfWidth) + (dy * dy) / (halfHeight * halfHeight));
+    }
+
+    float t = (distance - values[RADIUS]) / values[FEATHER];
+    t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+    return 1.0f - values[STRENGTH] * t * t * (3.0f - 2.0f * t);
+}
+
+static int vignetteProcess(const IEImage* in, IEImage* out, const IETile* tile, const float* values) {
+    for (int row = 0; row < in->height; row++) {
+        const char* src = (const char*)in->data + row * in->stride;
+        char* dst = (char*)out->data + row * out->stride;
+        for (int col = 0; col < in->width; col++) {
+            float factor = vignetteFactor(tile->x + col, tile->y + row, tile, values);
+            for (int c = 0; c < in->channels; c++) {
+                int i = col * in->channels + c;
+                switch (in->format) {
+                    case IE_FORMAT_8U:
+                        ((unsigned char*)dst)[i] = (unsigned char)(((const unsigned char*)src)[i] * factor + 0.5f);
+                        break;
+                    case IE_FORMAT_16U:
+                        ((unsigned short*)dst)[i] = (unsigned short)(((const unsigned short*)src)[i] * factor + 0.5f);
+                        break;
+                    case IE_FORMAT_32F:
+                        ((float*)dst)[i] = ((const float*)src)[i] * factor;
+                        break;
+                    default:
+                        return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static const IEOperation vignetteOperations[] = {
+    {
+        "Vignette",
+        "Darkens the image towards its edges. Radius and Feather are fractions of the distance from the centre to the corners (Circle) or the edges (Ellipse).",
+        vignetteParams,
+        sizeof(vignetteParams) / sizeof(vignetteParams[0]),
+        IE_FORMAT_8U | IE_FORMAT_16U | IE_FORMAT_32F,
+        NULL,
+        vignetteProcess
+    }
+};
+
+IE_PLUGIN_EXPORT const IEOperation* image_editor_plugin_operations(uint32_t host_api_version, int* count) {
+    if (host_api_version != IE_PLUGIN_API_VERSION) return NULL;
+    *count = sizeof(vignetteOperations) / sizeof(vignetteOperations[0]);
+    return vignetteOperations;
+}